@@ -0,0 +1,1547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <stdatomic.h>
+
+// librerie in /includes
+#include <fileQueue.h>
+#include <threadpool.h>
+#include <partialIO.h>
+#include <protocol.h>
+#include <api.h>
+
+#define BENCH_FILES 1024		// numero di file precaricati nella coda
+#define BENCH_OPS 200000		// numero di operazioni eseguite da ogni thread
+#define BENCH_FILESIZE 256		// dimensione del contenuto di ogni file (in bytes)
+#define BENCH_KEYS 10000		// numero di file distinti nel carico Zipf
+#define BENCH_ACCESSES 1000000	// numero di accessi del carico Zipf
+#define BENCH_CHURN 100			// numero massimo di file nella coda durante il benchmark sugli allocatori (come in test3)
+#define BENCH_REQUESTS 1000000	// numero di richieste codificate e decodificate nel benchmark sul protocollo
+#define BENCH_APIOPS 10000		// numero di ripetizioni di ogni operazione nel benchmark sulle API
+#define BENCH_APIFILE 4096		// dimensione del file scritto nel benchmark sulle API (in bytes)
+#define BENCH_PIPEFILES 32		// numero di file usati nel benchmark sul pipelining
+#define BENCH_PIPEFILE 128		// dimensione dei file usati nel benchmark sul pipelining (in bytes)
+#define BENCH_TASKS 1000000		// numero di task aggiunti alla threadpool nel benchmark sullo scheduling
+#define BENCH_TASKWORK 200		// iterazioni dei task non vuoti nel benchmark sullo scheduling (circa un microsecondo)
+#define BENCH_LATENCY 20000		// task isolati usati per misurare la latenza nel benchmark sullo scheduling
+#define BENCH_BULKFILES 16		// numero di file letti dal carico di fondo nel benchmark sulle priorita'
+#define BENCH_BULKFILE 1500		// dimensione dei file letti dal carico di fondo (in bytes, entro il maxSize di config.txt)
+
+// argomenti passati ai thread del benchmark
+typedef struct struct_bench {
+	queueT *queue;			// coda sulla quale operare
+	int id;					// identificativo del thread
+	unsigned int seed;		// seme per la scelta dei file
+	size_t ops;				// numero di operazioni completate
+} benchT;
+
+static void usage(char *prog);
+static double now();
+
+// benchmark sulla coda di file
+static int benchQueue(int maxThreads, size_t maxShards, policyT policy);
+static void* queueWorker(void *par);
+
+// benchmark sulle politiche di rimpiazzamento
+static int benchPolicy(size_t capacity, double alpha);
+
+// benchmark sugli allocatori dei metadati
+static int benchAlloc(int threads);
+static void* allocWorker(void *par);
+
+// benchmark sulla memoria occupata dai file
+static int benchMemory(int maxFiles);
+
+// benchmark sul numero di connessioni gestite dal server
+static int benchConnections(char *sockName, int maxConns, int requests);
+
+// benchmark sul formato delle richieste
+static int benchProtocol(int requests);
+
+// benchmark sulle allocazioni delle API (con il server avviato)
+static int benchApi(char *sockName, int requests);
+
+// benchmark sul pipelining delle richieste (con il server avviato)
+static int benchPipeline(char *sockName, int requests, int maxDepth);
+
+// benchmark sullo scheduling dei task della threadpool
+static int benchSched(int maxThreads, int tasks);
+
+// benchmark sulle classi di priorita' della threadpool (con il server avviato)
+static int benchLanes(char *sockName, int bulkClients, int requests);
+
+// contatori delle allocazioni: malloc e calloc vengono sostituite in fase di link (-Wl,--wrap=malloc,--wrap=calloc)
+static atomic_size_t mallocCount;
+static atomic_size_t mallocBytes;
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (strcmp(argv[1], "queue") == 0) {
+		int maxThreads = (argc > 2) ? (int) strtol(argv[2], NULL, 0) : 8;
+		size_t maxShards = (argc > 3) ? (size_t) strtol(argv[3], NULL, 0) : 16;
+		int policy = (argc > 4) ? parsePolicy(argv[4]) : POLICY_FIFO;
+
+		if (maxThreads <= 0 || maxShards <= 0 || policy == -1) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchQueue(maxThreads, maxShards, (policyT) policy) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "policy") == 0) {
+		long capacity = (argc > 2) ? strtol(argv[2], NULL, 0) : 1000;
+		double alpha = (argc > 3) ? strtod(argv[3], NULL) : 0.9;
+
+		if (capacity <= 0 || alpha <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchPolicy((size_t) capacity, alpha) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "alloc") == 0) {
+		int threads = (argc > 2) ? (int) strtol(argv[2], NULL, 0) : 4;
+
+		if (threads <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchAlloc(threads) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "memory") == 0) {
+		int maxFiles = (argc > 2) ? (int) strtol(argv[2], NULL, 0) : 100000;
+
+		if (maxFiles <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchMemory(maxFiles) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "connections") == 0) {
+		char *sockName = (argc > 2) ? argv[2] : "mysock";
+		int maxConns = (argc > 3) ? (int) strtol(argv[3], NULL, 0) : 16000;
+		int requests = (argc > 4) ? (int) strtol(argv[4], NULL, 0) : 10000;
+
+		if (maxConns < 0 || requests <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchConnections(sockName, maxConns, requests) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "protocol") == 0) {
+		int requests = (argc > 2) ? (int) strtol(argv[2], NULL, 0) : BENCH_REQUESTS;
+
+		if (requests <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchProtocol(requests) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "api") == 0) {
+		char *sockName = (argc > 2) ? argv[2] : "mysock";
+		int requests = (argc > 3) ? (int) strtol(argv[3], NULL, 0) : BENCH_APIOPS;
+
+		if (requests <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchApi(sockName, requests) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "pipeline") == 0) {
+		char *sockName = (argc > 2) ? argv[2] : "mysock";
+		int requests = (argc > 3) ? (int) strtol(argv[3], NULL, 0) : 100000;
+		int maxDepth = (argc > 4) ? (int) strtol(argv[4], NULL, 0) : MAX_INFLIGHT;
+
+		if (requests <= 0 || maxDepth <= 0 || maxDepth > MAX_INFLIGHT) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchPipeline(sockName, requests, maxDepth) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "sched") == 0) {
+		int maxThreads = (argc > 2) ? (int) strtol(argv[2], NULL, 0) : 64;
+		int tasks = (argc > 3) ? (int) strtol(argv[3], NULL, 0) : BENCH_TASKS;
+
+		if (maxThreads <= 0 || tasks <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchSched(maxThreads, tasks) == -1 ? 1 : 0;
+	}
+
+	if (strcmp(argv[1], "lanes") == 0) {
+		char *sockName = (argc > 2) ? argv[2] : "mysock";
+		int bulkClients = (argc > 3) ? (int) strtol(argv[3], NULL, 0) : 16;
+		int requests = (argc > 4) ? (int) strtol(argv[4], NULL, 0) : 20000;
+
+		if (bulkClients < 0 || requests <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return benchLanes(sockName, bulkClients, requests) == -1 ? 1 : 0;
+	}
+
+	usage(argv[0]);
+	return 1;
+}
+
+static void usage(char *prog) {
+	printf("Uso: %s queue [maxThreads] [maxShards] [policy]\n", prog);
+	printf("     %s policy [capacity] [alpha]\n", prog);
+	printf("     %s alloc [threads]\n", prog);
+	printf("     %s memory [maxFiles]\n", prog);
+	printf("     %s connections [sockName] [maxConns] [requests]   (con il server avviato)\n", prog);
+	printf("     %s protocol [requests]\n", prog);
+	printf("     %s api [sockName] [requests]   (con il server avviato)\n", prog);
+	printf("     %s pipeline [sockName] [requests] [maxDepth]   (con il server avviato)\n", prog);
+	printf("     %s sched [maxThreads] [tasks]\n", prog);
+	printf("     %s lanes [sockName] [bulkClients] [requests]   (con il server avviato)\n", prog);
+}
+
+// restituisce l'istante attuale in secondi
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// crea una coda con numShards shard e la riempie con BENCH_FILES file
+static queueT* fillQueue(size_t numShards, policyT policy) {
+	queueT *queue = createQueue(BENCH_FILES, BENCH_FILES * BENCH_FILESIZE * 2, numShards, policy);
+
+	if (!queue) {
+		return NULL;
+	}
+
+	char path[64];
+	char content[BENCH_FILESIZE];
+	memset(content, 'a', BENCH_FILESIZE);
+
+	for (int i = 0; i < BENCH_FILES; i++) {
+		snprintf(path, sizeof(path), "bench/file%d", i);
+
+		fileT *f = createFileT(path, 0, 0, 1);
+
+		if (!f || enqueue(queue, f, NULL) == -1) {
+			perror("fillQueue");
+			destroyFile(f);
+			destroyQueue(queue);
+			return NULL;
+		}
+
+		if (writeFileInQueue(queue, path, content, BENCH_FILESIZE, 0, NULL) == -1) {
+			perror("fillQueue write");
+			destroyQueue(queue);
+			return NULL;
+		}
+	}
+
+	return queue;
+}
+
+/**
+ * Ogni thread esegue un mix di operazioni simile a quello del server:
+ * 70% letture (acquireFile + copia del contenuto), 20% lock/unlock e 10% scritture.
+ */
+static void* queueWorker(void *par) {
+	benchT *b = (benchT*) par;
+	char path[64];
+	char buf[BENCH_FILESIZE];
+	memset(buf, 'b', BENCH_FILESIZE);
+
+	for (int i = 0; i < BENCH_OPS; i++) {
+		int n = rand_r(&b->seed) % BENCH_FILES;
+		int op = rand_r(&b->seed) % 10;
+		snprintf(path, sizeof(path), "bench/file%d", n);
+
+		if (op < 7) {
+			fileT *f = acquireFile(b->queue, path);
+
+			if (f) {
+				pthread_rwlock_rdlock(&f->rw);
+				readFileT(f, buf, 0, BENCH_FILESIZE);
+				pthread_rwlock_unlock(&f->rw);
+				releaseFile(f);
+				b->ops++;
+			}
+		}
+
+		else if (op < 9) {
+			// ogni thread usa un proprio id come owner; un fallimento per EPERM conta comunque come operazione
+			if (lockFileInQueue(b->queue, path, b->id) == 0) {
+				unlockFileInQueue(b->queue, path, b->id);
+			}
+			b->ops++;
+		}
+
+		else {
+			if (writeFileInQueue(b->queue, path, buf, BENCH_FILESIZE, 0, NULL) == 0) {
+				b->ops++;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Misura il throughput della coda al variare del numero di thread (1..maxThreads, in potenze di 2)
+ * e del numero di shard (1..maxShards, in potenze di 2).
+ */
+static int benchQueue(int maxThreads, size_t maxShards, policyT policy) {
+	pthread_t *tids = malloc(maxThreads * sizeof(pthread_t));
+	benchT *args = malloc(maxThreads * sizeof(benchT));
+
+	if (!tids || !args) {
+		perror("malloc");
+		free(tids);
+		free(args);
+		return -1;
+	}
+
+	printf("Politica di rimpiazzamento: %s\n", policyName(policy));
+	printf("%-8s %-8s %-12s %-14s\n", "shards", "threads", "secondi", "ops/sec");
+
+	for (size_t shards = 1; shards <= maxShards; shards *= 2) {
+		for (int threads = 1; threads <= maxThreads; threads *= 2) {
+			queueT *queue = fillQueue(shards, policy);
+
+			if (!queue) {
+				free(tids);
+				free(args);
+				return -1;
+			}
+
+			double start = now();
+
+			for (int i = 0; i < threads; i++) {
+				args[i].queue = queue;
+				args[i].id = i + 1;
+				args[i].seed = (unsigned int) (i + 1) * 7919;
+				args[i].ops = 0;
+
+				if (pthread_create(&tids[i], NULL, &queueWorker, &args[i]) != 0) {
+					perror("pthread_create");
+					destroyQueue(queue);
+					free(tids);
+					free(args);
+					return -1;
+				}
+			}
+
+			size_t total = 0;
+			for (int i = 0; i < threads; i++) {
+				pthread_join(tids[i], NULL);
+				total += args[i].ops;
+			}
+
+			double elapsed = now() - start;
+
+			printf("%-8zu %-8d %-12.3f %-14.0f\n", shards, threads, elapsed, total / elapsed);
+			fflush(stdout);
+
+			destroyQueue(queue);
+		}
+	}
+
+	free(tids);
+	free(args);
+
+	return 0;
+}
+
+/**
+ * Genera una sequenza di accessi con distribuzione di Zipf (parametro alpha) su BENCH_KEYS file:
+ * il file di rango k viene scelto con probabilita' proporzionale a 1/k^alpha.
+ */
+static int* zipfTrace(double alpha) {
+	double *cdf = malloc(BENCH_KEYS * sizeof(double));
+	int *trace = malloc(BENCH_ACCESSES * sizeof(int));
+
+	if (!cdf || !trace) {
+		perror("malloc");
+		free(cdf);
+		free(trace);
+		return NULL;
+	}
+
+	double sum = 0;
+	for (int k = 0; k < BENCH_KEYS; k++) {
+		sum += 1.0 / pow(k + 1, alpha);
+		cdf[k] = sum;
+	}
+
+	unsigned int seed = 12345;
+
+	for (int i = 0; i < BENCH_ACCESSES; i++) {
+		double u = (rand_r(&seed) / ((double) RAND_MAX + 1)) * sum;
+
+		// ricerca binaria sulla funzione di ripartizione
+		int lo = 0, hi = BENCH_KEYS - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+
+			if (cdf[mid] < u) {
+				lo = mid + 1;
+			}
+
+			else {
+				hi = mid;
+			}
+		}
+
+		// mescolo i ranghi, in modo che i file piu' richiesti non siano quelli inseriti per primi
+		trace[i] = (int) (((unsigned long) lo * 2654435761UL) % BENCH_KEYS);
+	}
+
+	free(cdf);
+	return trace;
+}
+
+// dimensione del file di rango k nel carico Zipf: fra 64 bytes e 64 KB, distribuita uniformemente in scala logaritmica
+static size_t zipfSize(int k) {
+	return (size_t) 64 << (((unsigned long) k * 40503UL) % 11);
+}
+
+/**
+ * Simula sulla coda (con un solo shard) lo stesso schema del server: a ogni accesso il file viene letto se presente,
+ * altrimenti (capacity miss) si riserva lo spazio con reserveSpace, espellendo i file scelti, e si scrive quello richiesto.
+ * La coda e' limitata in bytes: lo spazio corrisponde a capacity file di dimensione media.
+ * Stampa hit ratio e byte hit ratio di ogni politica.
+ */
+static int benchPolicy(size_t capacity, double alpha) {
+	int *trace = zipfTrace(alpha);
+	char *content = calloc(zipfSize(0) << 10, 1);
+
+	if (!trace || !content) {
+		perror("malloc");
+		free(trace);
+		free(content);
+		return -1;
+	}
+
+	double avgSize = 0;
+	for (int k = 0; k < BENCH_KEYS; k++) {
+		avgSize += zipfSize(k) / (double) BENCH_KEYS;
+	}
+
+	size_t maxSize = (size_t) (capacity * avgSize);
+
+	printf("Carico Zipf: alpha = %.2f, %d file, %d accessi, capacita' = %zu bytes (%zu file di dimensione media)\n", alpha, BENCH_KEYS, BENCH_ACCESSES, maxSize, capacity);
+	printf("%-8s %-12s %-12s %-10s %-14s\n", "policy", "hit", "miss", "hit ratio", "byte hit ratio");
+
+	char path[64];
+
+	for (policyT policy = POLICY_FIFO; policy <= POLICY_GDSF; policy++) {
+		queueT *queue = createQueue(BENCH_KEYS, maxSize, 1, policy);
+
+		if (!queue) {
+			perror("createQueue");
+			free(trace);
+			free(content);
+			return -1;
+		}
+
+		size_t hit = 0, miss = 0;
+		double hitBytes = 0, missBytes = 0;
+		double start = now();
+
+		for (int i = 0; i < BENCH_ACCESSES; i++) {
+			size_t size = zipfSize(trace[i]);
+			snprintf(path, sizeof(path), "bench/file%d", trace[i]);
+
+			fileT *f = acquireFile(queue, path);
+
+			if (f) {
+				releaseFile(f);
+				hit++;
+				hitBytes += size;
+				continue;
+			}
+
+			miss++;
+			missBytes += size;
+
+			// libero in un'unica passata lo spazio per il nuovo file e per il suo contenuto
+			reservationT res;
+			fileT **victims = NULL;
+			int n = reserveSpace(queue, size, 1, NULL, &res, &victims);
+
+			if (n == -1) {
+				perror("reserveSpace");
+				destroyQueue(queue);
+				free(trace);
+				free(content);
+				return -1;
+			}
+
+			for (int j = 0; j < n; j++) {
+				destroyFile(victims[j]);
+			}
+			free(victims);
+
+			if ((f = createFileT(path, 0, 0, 1)) == NULL || enqueue(queue, f, &res) == -1) {
+				perror("enqueue");
+				destroyFile(f);
+				cancelReservation(queue, &res);
+				destroyQueue(queue);
+				free(trace);
+				free(content);
+				return -1;
+			}
+
+			if (writeFileInQueue(queue, path, content, size, 0, &res) == -1) {
+				perror("writeFileInQueue");
+				cancelReservation(queue, &res);
+				destroyQueue(queue);
+				free(trace);
+				free(content);
+				return -1;
+			}
+		}
+
+		double elapsed = now() - start;
+
+		printf("%-8s %-12zu %-12zu %-10.4f %-14.4f (%.0f accessi/sec)\n", policyName(policy), hit, miss, 
+			hit / (double) BENCH_ACCESSES, hitBytes / (hitBytes + missBytes), BENCH_ACCESSES / elapsed);
+		fflush(stdout);
+
+		destroyQueue(queue);
+	}
+
+	free(trace);
+	free(content);
+
+	return 0;
+}
+
+/**
+ * Ogni thread crea continuamente file piccoli, con path di lunghezza variabile, in una coda che ne contiene al piu' 
+ * BENCH_CHURN: ogni creazione espelle un file (come i client di test3), quindi fileT, nodi, path ed elementi fantasma 
+ * vengono allocati e liberati di continuo.
+ */
+static void* allocWorker(void *par) {
+	benchT *b = (benchT*) par;
+	char path[256];
+	char content[64];
+	memset(content, 'c', sizeof(content));
+
+	for (int i = 0; i < BENCH_OPS; i++) {
+		int depth = rand_r(&b->seed) % 8;
+		int len = snprintf(path, sizeof(path), "/bench/t%d", b->id);
+
+		for (int j = 0; j < depth; j++) {
+			len += snprintf(path + len, sizeof(path) - len, "/dir%d", j);
+		}
+		snprintf(path + len, sizeof(path) - len, "/file%d", i);
+
+		reservationT res;
+		fileT **victims = NULL;
+		int n = reserveSpace(b->queue, sizeof(content), 1, NULL, &res, &victims);
+
+		if (n == -1) {
+			continue;
+		}
+
+		for (int j = 0; j < n; j++) {
+			destroyFile(victims[j]);
+		}
+		free(victims);
+
+		fileT *f = createFileT(path, 0, b->id, 1);
+
+		if (!f || enqueue(b->queue, f, &res) == -1) {
+			destroyFile(f);
+			cancelReservation(b->queue, &res);
+			continue;
+		}
+
+		if (appendFileInQueue(b->queue, path, content, sizeof(content), b->id, &res) == 0) {
+			b->ops++;
+		}
+
+		cancelReservation(b->queue, &res);
+	}
+
+	return NULL;
+}
+
+/**
+ * Misura il throughput di creazione ed espulsione di file con threads thread e stampa le statistiche degli allocatori:
+ * le acquisizioni della lock degli allocatori (refill) rispetto alle allocazioni mostrano l'effetto delle cache per thread,
+ * i blocchi allocati rispetto agli oggetti in uso mostrano quanta memoria resta inutilizzata.
+ */
+static int benchAlloc(int threads) {
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	benchT *args = malloc(threads * sizeof(benchT));
+	queueT *queue = createQueue(BENCH_CHURN, BENCH_CHURN * 1024, 1, POLICY_FIFO);
+
+	if (!tids || !args || !queue) {
+		perror("malloc");
+		free(tids);
+		free(args);
+		destroyQueue(queue);
+		return -1;
+	}
+
+	double start = now();
+
+	for (int i = 0; i < threads; i++) {
+		args[i].queue = queue;
+		args[i].id = i + 1;
+		args[i].seed = (unsigned int) (i + 1) * 7919;
+		args[i].ops = 0;
+
+		if (pthread_create(&tids[i], NULL, &allocWorker, &args[i]) != 0) {
+			perror("pthread_create");
+			destroyQueue(queue);
+			free(tids);
+			free(args);
+			return -1;
+		}
+	}
+
+	size_t total = 0;
+	for (int i = 0; i < threads; i++) {
+		pthread_join(tids[i], NULL);
+		total += args[i].ops;
+	}
+
+	double elapsed = now() - start;
+
+	printf("%d thread, %zu file creati ed espulsi in %.3f secondi (%.0f file/sec)\n", threads, total, elapsed, total / elapsed);
+
+	slabStatsT stats[ALLOC_POOLS];
+	int n = getAllocStats(stats);
+
+	printf("%-10s %-8s %-12s %-12s %-10s %-10s %-8s %-10s\n", "pool", "objSize", "alloc", "free", "live", "refill", "slabs", "KB");
+
+	for (int i = 0; i < n; i++) {
+		if (stats[i].allocs == 0) {
+			continue;
+		}
+
+		printf("%-10s %-8zu %-12zu %-12zu %-10zu %-10zu %-8zu %-10zu\n", stats[i].name, stats[i].objSize, stats[i].allocs, 
+			stats[i].frees, stats[i].live, stats[i].refills, stats[i].slabs, stats[i].reserved / 1024);
+	}
+
+	destroyQueue(queue);
+	free(tids);
+	free(args);
+
+	return 0;
+}
+
+/**
+ * Riempie una coda con 1000, 10000, ... fino a maxFiles file (80% con contenuto fino a 256 bytes, gli altri fino a 16 KB; 
+ * 90% con path corti) e confronta la memoria occupata dagli oggetti (fileT, nodi, path e chunk) con quella che servirebbe
+ * tenendo path e contenuto sempre fuori dal fileT.
+ */
+static int benchMemory(int maxFiles) {
+	char *content = calloc(16384, 1);
+
+	if (!content) {
+		perror("calloc");
+		return -1;
+	}
+
+	printf("%-10s %-14s %-10s %-14s %-10s %-10s\n", "file", "KB inline", "B/file", "KB separati", "B/file", "risparmio");
+
+	for (int files = 1000; files <= maxFiles; files *= 10) {
+		queueT *queue = createQueue(files, (size_t) files * 16384, 1, POLICY_FIFO);
+
+		if (!queue) {
+			perror("createQueue");
+			free(content);
+			return -1;
+		}
+
+		slabStatsT stats[ALLOC_POOLS];
+		getAllocStats(stats);
+
+		unsigned int seed = 4242;
+		char path[256];
+		double separate = 0;
+
+		for (int i = 0; i < files; i++) {
+			size_t size = (rand_r(&seed) % 10 < 8) ? (size_t) (rand_r(&seed) % 256) + 1 : (size_t) (rand_r(&seed) % 16128) + 257;
+
+			if (rand_r(&seed) % 10 < 9) {
+				snprintf(path, sizeof(path), "/home/utente/storage/dir%d/file%d.txt", i % 100, i);
+			}
+
+			else {
+				snprintf(path, sizeof(path), "/home/utente/storage/archivio/documenti/condivisi/dir%d/file%d.txt", i % 100, i);
+			}
+
+			fileT *f = createFileT(path, 0, 0, 1);
+
+			if (!f || enqueue(queue, f, NULL) == -1 || writeFileInQueue(queue, path, content, size, 0, NULL) == -1) {
+				perror("benchMemory");
+				destroyFile(f);
+				destroyQueue(queue);
+				free(content);
+				return -1;
+			}
+
+			// stessa disposizione senza dati inline: fileT ridotto, path nella sua classe di dimensione e contenuto in chunk
+			size_t pathClass = (strlen(path) / PATH_CLASS + 1) * PATH_CLASS;
+			size_t chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+			separate += (stats[0].objSize - INLINE_PATH - INLINE_DATA) + pathClass + chunks * stats[4].objSize;
+		}
+
+		// memoria occupata dagli oggetti attualmente in uso, in tutti gli allocatori
+		int n = getAllocStats(stats);
+		double used = 0;
+
+		for (int i = 0; i < n; i++) {
+			used += (double) stats[i].live * stats[i].objSize;
+		}
+
+		// i nodi della coda sono gli stessi nelle due disposizioni
+		separate += (double) stats[1].live * stats[1].objSize;
+
+		printf("%-10d %-14.0f %-10.0f %-14.0f %-10.0f %.1f%%\n", files, used / 1024, used / files, separate / 1024, 
+			separate / files, 100 * (1 - used / separate));
+		fflush(stdout);
+
+		destroyQueue(queue);
+	}
+
+	free(content);
+
+	return 0;
+}
+
+// apre una connessione con il server
+static int connectTo(char *sockName) {
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	strncpy(sa.sun_path, sockName, sizeof(sa.sun_path) - 1);
+	sa.sun_family = AF_UNIX;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr*) &sa, sizeof(sa)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// invia al server una openFile su un file inesistente e ne attende la risposta (errore ed errno)
+static int roundTrip(int fd) {
+	char cmd[PROTO_CMDSIZE];
+	char res[3 + sizeof(int)];
+
+	formatTextRequest(cmd, OP_OPEN, "/bench/inesistente", 0);
+
+	if (writen(fd, cmd, sizeof(cmd)) == -1 || readn(fd, res, 3) <= 0) {
+		return -1;
+	}
+
+	if (strcmp(res, "er") == 0 && readn(fd, res + 3, sizeof(int)) <= 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Apre un numero crescente di connessioni inattive (fino a maxConns) verso un server gia' avviato e, per ogni livello, 
+ * misura la latenza media di requests richieste inviate su un'altra connessione: se il costo del manager dipende solo
+ * dagli eventi, la latenza non cresce con il numero di client connessi.
+ */
+static int benchConnections(char *sockName, int maxConns, int requests) {
+	// ogni connessione occupa un descrittore: alzo il limite soft al massimo consentito
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	int *idle = malloc((maxConns + 1) * sizeof(int));
+	int active = connectTo(sockName);
+
+	if (!idle || active == -1) {
+		perror("benchConnections");
+		free(idle);
+		return -1;
+	}
+
+	int open = 0;
+	int ret = 0;
+
+	printf("%-12s %-14s %-14s\n", "connessioni", "usec/richiesta", "richieste/sec");
+
+	for (int level = 0; ; level = (level == 0) ? 1000 : level * 2) {
+		if (level > maxConns) {
+			level = maxConns;
+		}
+
+		// apro le connessioni inattive mancanti
+		while (open < level) {
+			if ((idle[open] = connectTo(sockName)) == -1) {
+				perror("connect");
+				ret = -1;
+				goto cleanup;
+			}
+
+			open++;
+		}
+
+		// riscaldamento, poi misura
+		for (int i = 0; i < 100; i++) {
+			roundTrip(active);
+		}
+
+		double start = now();
+
+		for (int i = 0; i < requests; i++) {
+			if (roundTrip(active) == -1) {
+				perror("roundTrip");
+				ret = -1;
+				goto cleanup;
+			}
+		}
+
+		double elapsed = now() - start;
+
+		printf("%-12d %-14.2f %-14.0f\n", open + 1, elapsed * 1e6 / requests, requests / elapsed);
+		fflush(stdout);
+
+		if (level == maxConns) {
+			break;
+		}
+	}
+
+	cleanup:
+		for (int i = 0; i < open; i++) {
+			close(idle[i]);
+		}
+
+		close(active);
+		free(idle);
+
+		return ret;
+}
+
+// richieste usate nel benchmark sul protocollo: le operazioni di una scrittura seguita da una lettura (come in test2)
+static const struct {
+	opT op;
+	const char *path;
+	long arg;
+} benchReqs[] = {
+	{OP_OPEN, "testFiles/3/file13", 3},
+	{OP_WRITE, "testFiles/3/file13", 4500},
+	{OP_UNLOCK, "testFiles/3/file13", 0},
+	{OP_READ, "testFiles/3/file13", 0},
+	{OP_APPEND, "testFiles/3/file13", 56},
+	{OP_READN, NULL, 0},
+	{OP_CLOSE, "testFiles/3/file13", 0}
+};
+
+#define BENCH_NREQS (sizeof(benchReqs) / sizeof(benchReqs[0]))
+
+/**
+ * Confronta il protocollo testuale e quello binario: per ogni formato misura il costo della codifica (client) e della
+ * decodifica (server, compresa la copia dei bytes ricevuti nel buffer della richiesta) e il numero di bytes inviati
+ * per ogni richiesta.
+ */
+static int benchProtocol(int requests) {
+	char wire[PROTO_CMDSIZE + PROTO_MAXPATH + 1];	// bytes inviati sul socket
+	char buf[PROTO_CMDSIZE + PROTO_MAXPATH + 1];	// buffer della richiesta lato server
+	size_t wireLen[BENCH_NREQS];
+	requestT req;
+	long check = 0;		// impedisce al compilatore di eliminare le decodifiche
+
+	printf("%-10s %-14s %-14s %-14s\n", "formato", "codifica (ns)", "decodifica (ns)", "bytes/richiesta");
+
+	for (int format = PROTO_TEXT; format <= PROTO_V2; format++) {
+		size_t bytes = 0;
+
+		// codifica
+		double start = now();
+
+		for (int i = 0; i < requests; i++) {
+			size_t k = i % BENCH_NREQS;
+
+			if (format == PROTO_TEXT) {
+				formatTextRequest(wire, benchReqs[k].op, benchReqs[k].path, benchReqs[k].arg);
+				wireLen[k] = PROTO_CMDSIZE;
+			}
+
+			else {
+				protoHeaderT hdr;
+				int flags = (benchReqs[k].op == OP_OPEN) ? (int) benchReqs[k].arg : 0;
+				ssize_t len = encodeRequest(&hdr, PROTO_V2, benchReqs[k].op, flags, i, benchReqs[k].path, benchReqs[k].arg);
+
+				memcpy(wire, &hdr, sizeof(protoHeaderT));
+
+				if (benchReqs[k].path) {
+					memcpy(wire + sizeof(protoHeaderT), benchReqs[k].path, len - sizeof(protoHeaderT));
+				}
+
+				wireLen[k] = len;
+			}
+
+			bytes += wireLen[k];
+			check += wire[3];
+		}
+
+		double encode = now() - start;
+
+		// decodifica: ricodifico le richieste una volta sola, poi le decodifico ripetutamente
+		char wires[BENCH_NREQS][PROTO_CMDSIZE + PROTO_MAXPATH + 1];
+
+		for (size_t k = 0; k < BENCH_NREQS; k++) {
+			if (format == PROTO_TEXT) {
+				formatTextRequest(wires[k], benchReqs[k].op, benchReqs[k].path, benchReqs[k].arg);
+			}
+
+			else {
+				protoHeaderT hdr;
+				int flags = (benchReqs[k].op == OP_OPEN) ? (int) benchReqs[k].arg : 0;
+				encodeRequest(&hdr, PROTO_V2, benchReqs[k].op, flags, k, benchReqs[k].path, benchReqs[k].arg);
+				memcpy(wires[k], &hdr, sizeof(protoHeaderT));
+
+				if (benchReqs[k].path) {
+					memcpy(wires[k] + sizeof(protoHeaderT), benchReqs[k].path, strlen(benchReqs[k].path));
+				}
+			}
+		}
+
+		start = now();
+
+		for (int i = 0; i < requests; i++) {
+			size_t k = i % BENCH_NREQS;
+
+			memcpy(buf, wires[k], wireLen[k]);
+
+			if (format == PROTO_TEXT) {
+				buf[PROTO_CMDSIZE - 1] = '\0';
+
+				if (parseTextRequest(buf, &req) == -1) {
+					perror("parseTextRequest");
+					return -1;
+				}
+			}
+
+			else {
+				protoHeaderT hdr;
+				memcpy(&hdr, buf, sizeof(protoHeaderT));
+
+				if (parseBinaryRequest(&hdr, buf + sizeof(protoHeaderT), &req) == -1) {
+					perror("parseBinaryRequest");
+					return -1;
+				}
+			}
+
+			check += req.op + (req.path ? req.path[0] : 0) + req.size;
+		}
+
+		double decode = now() - start;
+
+		printf("%-10s %-14.1f %-14.1f %-14.1f\n", (format == PROTO_TEXT) ? "testo" : "binario", encode * 1e9 / requests, 
+			decode * 1e9 / requests, (double) bytes / requests);
+	}
+
+	// stampo il controllo su stderr, in modo che le decodifiche non possano essere eliminate
+	fflush(stdout);
+	fprintf(stderr, "(controllo: %ld)\n", check);
+
+	return 0;
+}
+
+// conta le allocazioni eseguite tramite malloc
+void* __wrap_malloc(size_t size) {
+	atomic_fetch_add(&mallocCount, 1);
+	atomic_fetch_add(&mallocBytes, size);
+
+	return __real_malloc(size);
+}
+
+// conta le allocazioni eseguite tramite calloc
+void* __wrap_calloc(size_t nmemb, size_t size) {
+	atomic_fetch_add(&mallocCount, 1);
+	atomic_fetch_add(&mallocBytes, nmemb * size);
+
+	return __real_calloc(nmemb, size);
+}
+
+// operazioni misurate nel benchmark sulle API, eseguite in quest'ordine su uno stesso file
+enum { API_OPEN, API_WRITE, API_READ, API_UNLOCK, API_LOCK, API_CLOSE, API_REOPEN, API_REMOVE, API_COUNT };
+
+static const char *apiNames[API_COUNT] = {
+	"openFile", "writeFile", "readFile", "unlockFile", "lockFile", "closeFile", "openFile/L", "removeFile"
+};
+
+/**
+ * Esegue requests volte la sequenza openFile (O_CREATE|O_LOCK), writeFile, readFile, unlockFile, lockFile, closeFile,
+ * openFile (O_LOCK), removeFile su un file di BENCH_APIFILE bytes verso un server gia' avviato e, per ogni operazione, misura la latenza
+ * media e il numero (e la dimensione) delle allocazioni eseguite dalla libreria lato client. Il buffer restituito da
+ * readFile viene allocato per il chiamante e viene contato.
+ */
+static int benchApi(char *sockName, int requests) {
+	char path[] = "/tmp/benchApiXXXXXX";
+	char content[BENCH_APIFILE];
+	int fd = mkstemp(path);
+
+	memset(content, 'a', sizeof(content));
+
+	if (fd == -1 || writen(fd, content, sizeof(content)) == -1) {
+		perror("benchApi");
+
+		if (fd != -1) {
+			close(fd);
+			unlink(path);
+		}
+
+		return -1;
+	}
+
+	close(fd);
+
+	struct timespec abstime;
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += 5;
+
+	if (openConnection(sockName, 100, abstime) == -1) {
+		perror("openConnection");
+		unlink(path);
+		return -1;
+	}
+
+	double elapsed[API_COUNT] = {0};
+	size_t count[API_COUNT] = {0};
+	size_t bytes[API_COUNT] = {0};
+	int ret = 0;
+
+	for (int i = 0; i < requests && ret == 0; i++) {
+		for (int op = 0; op < API_COUNT; op++) {
+			void *buf = NULL;
+			size_t size = 0;
+			size_t c0 = atomic_load(&mallocCount);
+			size_t b0 = atomic_load(&mallocBytes);
+			double start = now();
+
+			switch (op) {
+				case API_OPEN: ret = openFile(path, O_CREATE | O_LOCK); break;
+				case API_WRITE: ret = writeFile(path, NULL); break;
+				case API_READ: ret = readFile(path, &buf, &size); break;
+				case API_UNLOCK: ret = unlockFile(path); break;
+				case API_LOCK: ret = lockFile(path); break;
+				case API_CLOSE: ret = closeFile(path); break;
+				case API_REOPEN: ret = openFile(path, O_LOCK); break;
+				case API_REMOVE: ret = removeFile(path); break;
+			}
+
+			elapsed[op] += now() - start;
+			count[op] += atomic_load(&mallocCount) - c0;
+			bytes[op] += atomic_load(&mallocBytes) - b0;
+			free(buf);
+
+			if (ret == -1) {
+				fprintf(stderr, "%s: %s\n", apiNames[op], strerror(errno));
+				break;
+			}
+		}
+	}
+
+	closeConnection(sockName);
+	unlink(path);
+
+	if (ret == -1) {
+		return -1;
+	}
+
+	printf("%-12s %-12s %-14s %-14s\n", "operazione", "usec/op", "malloc/op", "KB allocati/op");
+
+	for (int op = 0; op < API_COUNT; op++) {
+		printf("%-12s %-12.2f %-14.2f %-14.2f\n", apiNames[op], elapsed[op] * 1e6 / requests,
+			(double) count[op] / requests, bytes[op] / 1024.0 / requests);
+	}
+
+	return 0;
+}
+
+// path dell'i-esimo file del benchmark sul pipelining
+static void pipePath(char *path, int i) {
+	snprintf(path, PROTO_MAXPATH, "/bench/pipeline/file%d", i % BENCH_PIPEFILES);
+}
+
+/**
+ * Esegue requests operazioni op (OP_READ, oppure OP_LOCK e OP_UNLOCK alternate) sui file del benchmark, tenendo al piu'
+ * depth richieste in volo: con depth = 0 usa le funzioni sincrone. Restituisce il tempo impiegato, -1 se errore.
+ */
+static double pipeRun(int op, int requests, int depth) {
+	char path[PROTO_MAXPATH + 1];
+	double start = now();
+
+	for (int i = 0; i < requests; i++) {
+		int reqOp = (op == OP_READ) ? OP_READ : ((i % 2 == 0) ? OP_LOCK : OP_UNLOCK);
+		pipePath(path, (op == OP_READ) ? i : i / 2);
+
+		// operazioni sincrone
+		if (depth == 0) {
+			void *buf = NULL;
+			size_t size;
+			int r = (reqOp == OP_READ) ? readFile(path, &buf, &size) : ((reqOp == OP_LOCK) ? lockFile(path) : unlockFile(path));
+
+			free(buf);
+
+			if (r == -1) {
+				perror(opName(reqOp));
+				return -1;
+			}
+
+			continue;
+		}
+
+		// con depth richieste in volo, attendo la piu' vecchia prima di inviarne un'altra
+		if (pipelinePending() == depth && pipelineWait(NULL, NULL, NULL) == -1) {
+			perror("pipelineWait");
+			return -1;
+		}
+
+		if (pipelineRequest(reqOp, path, 0, NULL, 0) == -1) {
+			perror("pipelineRequest");
+			return -1;
+		}
+	}
+
+	while (pipelinePending() > 0) {
+		if (pipelineWait(NULL, NULL, NULL) == -1) {
+			perror("pipelineWait");
+			return -1;
+		}
+	}
+
+	return now() - start;
+}
+
+/**
+ * Misura le richieste al secondo servite su una sola connessione al variare del numero di richieste in volo (pipelining,
+ * protocollo v3), per letture di file piccoli e per coppie lockFile/unlockFile, confrontandole con le funzioni sincrone.
+ */
+static int benchPipeline(char *sockName, int requests, int maxDepth) {
+	char path[PROTO_MAXPATH + 1];
+	char content[BENCH_PIPEFILE];
+	struct timespec abstime;
+	int ret = 0;
+
+	memset(content, 'p', sizeof(content));
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += 5;
+
+	if (openConnection(sockName, 100, abstime) == -1) {
+		perror("openConnection");
+		return -1;
+	}
+
+	// creo i file del benchmark
+	for (int i = 0; i < BENCH_PIPEFILES && ret == 0; i++) {
+		pipePath(path, i);
+
+		if (pipelineRequest(OP_OPEN, path, O_CREATE | O_LOCK, NULL, 0) == -1 || 
+			pipelineRequest(OP_WRITE, path, 0, content, sizeof(content)) == -1 ||
+			pipelineWait(NULL, NULL, NULL) == -1 || pipelineWait(NULL, NULL, NULL) == -1) {
+			perror("creazione dei file");
+			ret = -1;
+		}
+	}
+
+	if (ret == 0) {
+		printf("%-10s %-18s %-18s\n", "in volo", "readFile (req/s)", "lock/unlock (req/s)");
+	}
+
+	for (int depth = 0; depth <= maxDepth && ret == 0; depth = (depth == 0) ? 1 : depth * 2) {
+		double reads = pipeRun(OP_READ, requests, depth);
+		double locks = pipeRun(OP_LOCK, requests, depth);
+
+		if (reads == -1 || locks == -1) {
+			ret = -1;
+			break;
+		}
+
+		char label[16];
+		snprintf(label, sizeof(label), (depth == 0) ? "sincrono" : "%d", depth);
+		printf("%-10s %-18.0f %-18.0f\n", label, requests / reads, requests / locks);
+		fflush(stdout);
+	}
+
+	// rimuovo i file del benchmark
+	for (int i = 0; i < BENCH_PIPEFILES; i++) {
+		pipePath(path, i);
+
+		if (pipelineRequest(OP_LOCK, path, 0, NULL, 0) == -1 || pipelineRequest(OP_REMOVE, path, 0, NULL, 0) == -1) {
+			break;
+		}
+
+		pipelineWait(NULL, NULL, NULL);
+		pipelineWait(NULL, NULL, NULL);
+	}
+
+	closeConnection(sockName);
+
+	return ret;
+}
+
+// task del benchmark sullo scheduling: conta le esecuzioni e, se work > 0, simula un po' di lavoro
+static atomic_size_t schedDone;
+static atomic_int schedWork;
+
+static void schedTask(void *arg) {
+	volatile int x = 0;
+	int work = atomic_load_explicit(&schedWork, memory_order_relaxed);
+
+	for (int i = 0; i < work; i++) {
+		x += i;
+	}
+
+	atomic_fetch_add_explicit(&schedDone, 1, memory_order_relaxed);
+}
+
+// task del benchmark sulla latenza: registra l'istante in cui viene eseguito
+static double schedStarted;
+static atomic_int schedRan;
+
+static void latencyTask(void *arg) {
+	schedStarted = now();
+	atomic_store_explicit(&schedRan, 1, memory_order_release);
+}
+
+/**
+ * Aggiunge tasks task a una threadpool di threads worker (con 1024 task pendenti, come un server molto carico) da un
+ * solo thread, come il manager del server, e restituisce il tempo impiegato per eseguirli tutti (-1 se errore). 
+ * Quando la coda e' piena l'inserimento viene ripetuto: rejected conta i rifiuti.
+ */
+static double schedRun(int threads, poolModeT mode, int tasks, int work, size_t *rejected) {
+	threadpool_t *pool = createThreadPool(threads, threads, 1024, mode);
+
+	if (!pool) {
+		perror("createThreadPool");
+		return -1;
+	}
+
+	atomic_store(&schedDone, 0);
+	atomic_store(&schedWork, work);
+	*rejected = 0;
+	double start = now();
+
+	for (int i = 0; i < tasks; i++) {
+		int r;
+
+		while ((r = addToThreadPool(pool, schedTask, NULL)) == 1) {
+			(*rejected)++;
+			sched_yield();
+		}
+
+		if (r == -1) {
+			perror("addToThreadPool");
+			destroyThreadPool(pool, 1);
+			return -1;
+		}
+	}
+
+	// destroyThreadPool attende che i task pendenti siano stati eseguiti
+	if (destroyThreadPool(pool, 0) == -1) {
+		perror("destroyThreadPool");
+		return -1;
+	}
+
+	double elapsed = now() - start;
+
+	if (atomic_load(&schedDone) != (size_t) tasks) {
+		fprintf(stderr, "Eseguiti %zu task su %d\n", atomic_load(&schedDone), tasks);
+		return -1;
+	}
+
+	return elapsed;
+}
+
+/**
+ * Misura la latenza media (in secondi) tra l'aggiunta di un task e l'inizio della sua esecuzione, con un solo task alla
+ * volta e i worker inattivi, come per le lockFile e closeFile isolate. Restituisce -1 se errore.
+ */
+static double schedLatency(int threads, poolModeT mode, int samples) {
+	threadpool_t *pool = createThreadPool(threads, threads, 1024, mode);
+	double total = 0;
+
+	if (!pool) {
+		perror("createThreadPool");
+		return -1;
+	}
+
+	for (int i = 0; i < samples; i++) {
+		atomic_store(&schedRan, 0);
+		double start = now();
+
+		if (addToThreadPool(pool, latencyTask, NULL) != 0) {
+			perror("addToThreadPool");
+			destroyThreadPool(pool, 1);
+			return -1;
+		}
+
+		while (!atomic_load_explicit(&schedRan, memory_order_acquire)) {
+			sched_yield();
+		}
+
+		total += schedStarted - start;
+	}
+
+	destroyThreadPool(pool, 0);
+
+	return total / samples;
+}
+
+/**
+ * Confronta le modalita' della threadpool con 8, 16, 32, ... fino a maxThreads worker: task al secondo smistati per task
+ * vuoti (conta solo il costo dello scheduling) e per task di circa un microsecondo, e latenza di un task isolato. 
+ * I messaggi di uscita dei worker vengono stampati su stderr.
+ */
+static int benchSched(int maxThreads, int tasks) {
+	printf("%-8s %-10s %-16s %-10s %-16s %-10s %-14s\n", "worker", "modalita'", "vuoti (task/s)", "rifiuti", "1 us (task/s)", 
+		"rifiuti", "latenza (us)");
+
+	for (int threads = (maxThreads < 8) ? maxThreads : 8; threads <= maxThreads; threads *= 2) {
+		for (int mode = 0; mode < POOL_MODES; mode++) {
+			size_t emptyRejected, workRejected;
+			double empty = schedRun(threads, (poolModeT) mode, tasks, 0, &emptyRejected);
+			double work = (empty == -1) ? -1 : schedRun(threads, (poolModeT) mode, tasks, BENCH_TASKWORK, &workRejected);
+			double latency = (work == -1) ? -1 : schedLatency(threads, (poolModeT) mode, BENCH_LATENCY);
+
+			if (empty == -1 || work == -1 || latency == -1) {
+				return -1;
+			}
+
+			printf("%-8d %-10s %-16.0f %-10zu %-16.0f %-10zu %-14.2f\n", threads, poolModeName((poolModeT) mode), tasks / empty, 
+				emptyRejected, tasks / work, workRejected, latency * 1e6);
+			fflush(stdout);
+		}
+	}
+
+	return 0;
+}
+
+// path dell'i-esimo file del benchmark sulle priorita' (i = -1: file delle operazioni sui metadati)
+static void lanesPath(char *path, int i) {
+	if (i == -1) {
+		snprintf(path, PROTO_MAXPATH, "/bench/lanes/meta");
+	}
+
+	else {
+		snprintf(path, PROTO_MAXPATH, "/bench/lanes/bulk%d", i);
+	}
+}
+
+// confronta due latenze, per qsort
+static int cmpLatency(const void *a, const void *b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+
+	return (x > y) - (x < y);
+}
+
+// percentile p (tra 0 e 1) delle n latenze ordinate in lat
+static double percentile(double *lat, int n, double p) {
+	int i = (int) ceil(p * n) - 1;
+
+	return lat[(i < 0) ? 0 : i];
+}
+
+/**
+ * Processo del carico di fondo: attende il via del benchmark sulla pipe go (un byte), poi legge di continuo tutti i file 
+ * del server con readNFiles(0), scartandoli, finche' non viene terminato.
+ */
+static void bulkClient(char *sockName, int go) {
+	char c;
+	struct timespec abstime = {5, 0};	// openConnection riprova per al piu' abstime dall'inizio
+
+	if (readn(go, &c, 1) <= 0) {
+		_exit(1);
+	}
+
+	if (openConnection(sockName, 100, abstime) == -1) {
+		perror("openConnection");
+		_exit(1);
+	}
+
+	for (;;) {
+		if (readNFiles(0, NULL) == -1) {
+			perror("readNFiles");
+			_exit(1);
+		}
+	}
+}
+
+/**
+ * Misura la latenza di requests operazioni sui metadati (lockFile e unlockFile alternate, sincrone) prima senza carico 
+ * e poi mentre bulkClients processi leggono di continuo tutti i file del server (readNFiles(0) su BENCH_BULKFILES file di
+ * BENCH_BULKFILE bytes): se le richieste urgenti non attendono dietro ai trasferimenti, il p99 resta vicino a quello 
+ * senza carico. I processi del carico di fondo vengono creati prima di aprire la connessione, cosi' non la ereditano.
+ */
+static int benchLanes(char *sockName, int bulkClients, int requests) {
+	char path[PROTO_MAXPATH + 1];
+	char meta[PROTO_MAXPATH + 1];
+	char content[BENCH_BULKFILE];
+	struct timespec abstime = {5, 0};	// openConnection riprova per al piu' abstime dall'inizio
+	double *lat = malloc(requests * sizeof(double));
+	pid_t *pids = calloc(bulkClients + 1, sizeof(pid_t));
+	int go[2];
+	int started = 0;
+	int ret = 0;
+
+	if (!lat || !pids || pipe(go) == -1) {
+		perror("benchLanes");
+		free(lat);
+		free(pids);
+		return -1;
+	}
+
+	for (started = 0; started < bulkClients; started++) {
+		if ((pids[started] = fork()) == -1) {
+			perror("fork");
+			ret = -1;
+			break;
+		}
+
+		if (pids[started] == 0) {
+			close(go[1]);
+			bulkClient(sockName, go[0]);
+		}
+	}
+
+	close(go[0]);
+	memset(content, 'b', sizeof(content));
+	lanesPath(meta, -1);
+
+	if (ret == 0 && openConnection(sockName, 100, abstime) == -1) {
+		perror("openConnection");
+		ret = -1;
+	}
+
+	// creo i file letti dal carico di fondo e quello delle operazioni sui metadati (lasciato senza lock)
+	for (int i = 0; i < BENCH_BULKFILES && ret == 0; i++) {
+		lanesPath(path, i);
+
+		if (pipelineRequest(OP_OPEN, path, O_CREATE | O_LOCK, NULL, 0) == -1 || 
+			pipelineRequest(OP_WRITE, path, 0, content, sizeof(content)) == -1 ||
+			pipelineWait(NULL, NULL, NULL) == -1 || pipelineWait(NULL, NULL, NULL) == -1) {
+			perror("creazione dei file");
+			ret = -1;
+		}
+	}
+
+	if (ret == 0 && (openFile(meta, O_CREATE | O_LOCK) == -1 || unlockFile(meta) == -1)) {
+		perror("creazione dei file");
+		ret = -1;
+	}
+
+	if (ret == 0) {
+		printf("%-26s %-12s %-12s %-12s\n", "carico di fondo", "p50 (us)", "p99 (us)", "max (us)");
+	}
+
+	for (int loaded = 0; loaded <= 1 && ret == 0; loaded++) {
+		// avvio il carico di fondo e gli lascio il tempo di saturare il server
+		if (loaded) {
+			if (bulkClients == 0) {
+				break;
+			}
+
+			for (int i = 0; i < bulkClients; i++) {
+				if (writen(go[1], "g", 1) == -1) {
+					perror("writen");
+					ret = -1;
+				}
+			}
+
+			usleep(200000);
+		}
+
+		for (int i = 0; i < requests && ret == 0; i++) {
+			double start = now();
+			int r = (i % 2 == 0) ? lockFile(meta) : unlockFile(meta);
+
+			lat[i] = now() - start;
+
+			if (r == -1) {
+				perror((i % 2 == 0) ? "lockFile" : "unlockFile");
+				ret = -1;
+			}
+		}
+
+		if (ret == 0) {
+			char label[32];
+			snprintf(label, sizeof(label), loaded ? "%d client readNFiles" : "nessuno", bulkClients);
+			qsort(lat, requests, sizeof(double), cmpLatency);
+			printf("%-26s %-12.2f %-12.2f %-12.2f\n", label, percentile(lat, requests, 0.5) * 1e6, 
+				percentile(lat, requests, 0.99) * 1e6, lat[requests - 1] * 1e6);
+			fflush(stdout);
+		}
+	}
+
+	// termino il carico di fondo (chiudendo la pipe terminano anche i processi che non sono ancora partiti)
+	close(go[1]);
+
+	for (int i = 0; i < started; i++) {
+		kill(pids[i], SIGTERM);
+		waitpid(pids[i], NULL, 0);
+	}
+
+	// rimuovo i file del benchmark
+	for (int i = -1; i < BENCH_BULKFILES; i++) {
+		lanesPath(path, i);
+
+		if (pipelineRequest(OP_LOCK, path, 0, NULL, 0) == -1 || pipelineRequest(OP_REMOVE, path, 0, NULL, 0) == -1) {
+			break;
+		}
+
+		pipelineWait(NULL, NULL, NULL);
+		pipelineWait(NULL, NULL, NULL);
+	}
+
+	closeConnection(sockName);
+	free(lat);
+	free(pids);
+
+	return ret;
+}
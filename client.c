@@ -16,6 +16,7 @@
 // librerie in /includes
 #include <api.h>
 #include <partialIO.h>
+#include <protocol.h>
 
 #define UNIX_PATH_MAX 108 
 
@@ -32,6 +33,8 @@ typedef struct struct_cmd_w {
 	int print;
 	int maxN;
 	int currN;
+	char **files;		// file trovati nella cartella, scritti sul server tutti insieme al termine della visita
+	int numFiles;
 }	cmd_w_T;
 
 static cmd_w_T *wT;								// variabile globale di appoggio per il comando -w
@@ -53,6 +56,11 @@ int cmd_l(const char *filelist, int print);
 int cmd_u(const char *filelist, int print);
 int cmd_c(const char *filelist, int print);
 
+// funzioni ausiliarie che scrivono e leggono una lista di file con le operazioni batch
+int splitList(const char *filelist, char **copy, char ***files);
+int writeList(char **files, int n, char *Directory, int print);
+int readList(char **files, int n, int print);
+
 // chiude la connessione con il server al termine dell'esecuzione del client
 void cleanup();
 
@@ -692,7 +700,18 @@ int cmd_w(char *dirname, char *Directory, int print) {
 	// invoca la funzione che visita ricorsivamente la cartella specificata e chiama la funzione ausiliaria su ogni file trovato
 	ftw(Dir, cmd_w_aux, FOPEN_MAX);
 
-	return 0;
+	// scrivo tutti i file trovati con le operazioni batch
+	int r = writeList(wT->files, wT->numFiles, Directory, wT->print);
+
+	for (int i = 0; i < wT->numFiles; i++) {
+		free(wT->files[i]);
+	}
+
+	free(wT->files);
+	wT->files = NULL;
+	wT->numFiles = 0;
+
+	return r;
 }
 
 // funzione ausiliaria del comando -w. Viene passata come argomento della funzione ftw
@@ -713,7 +732,20 @@ int cmd_w_aux(const char *ftw_filePath, const struct stat *ptr, int flag) {
 		return -1;
 	}
 
-	cmd_W(ftw_filePath, wT->Directory, wT->print);
+	// aggiungo il file alla lista di quelli da scrivere
+	char **files = realloc(wT->files, (wT->numFiles + 1) * sizeof(char*));
+
+	if (!files) {
+		return -1;
+	}
+
+	wT->files = files;
+
+	if ((wT->files[wT->numFiles] = strdup(ftw_filePath)) == NULL) {
+		return -1;
+	}
+
+	wT->numFiles++;
 
 	return 0;
 }
@@ -727,84 +759,25 @@ int cmd_W(const char *filelist, char *Directory, int print) {
 	}
 
 	// parso la lista di file da scrivere
-	char *token = NULL, *save = NULL;
-	char tokenList[256] = "";
-	strncpy(tokenList, filelist, strlen(filelist)+1);
-	token = strtok_r(tokenList, ",", &save);
-	int ok = 1;
+	char *tokenList = NULL;
+	char **files = NULL;
+	int n = splitList(filelist, &tokenList, &files);
+
+	if (n == -1) {
+		return -1;
+	}
 
 	if (print == 1) {
 		printf("\nW - Scrivo i seguenti file sul server:\n");
 		fflush(stdout);
 	}
 
-	// per ogni file nella lista...
-	while (token != NULL) {
-		ok = 1;
-		int opened = 0;
-		if (print != 0) {
-			printf("\n%-20s", token); 
-			fflush(stdout);
-		}
-
-		// creo il file in modalita' locked
-		if (openFile(token, O_CREATE | O_LOCK) == -1) {
-			ok = 0;
-		}
-
-		// se il file e' stato creato con successo...
-		else {
-			opened = 1;
-		}
-		
-		// scrivo il contenuto del file sul server
-		if (opened && writeFile(token, Directory) == -1) {
-			ok = 0;
-		}
-
-		// se il file e' stato creato ma la scrittura non e' riuscita, elimina il file vuoto appena creato
-		if (opened && !ok) {
-			removeFile(token);
-		}
-
-		// chiudo il file
-		else if (opened && closeFile(token) == -1) {
-			ok = 0;
-		}
-
-		if (print != 0) {
-			printf("Esito: "); 
-
-			if (ok) {
-				printf("ok");
-			}
-			
-			else {
-				printf("errore");
+	int r = writeList(files, n, Directory, print);
 
-				if (print == 1) {
-					perror("-W");
-				}
-
-				else {
-					perror("-w");
-				}
-			}
+	free(files);
+	free(tokenList);
 
-			printf("\n");
-			fflush(stdout);
-		}
-
-		token = strtok_r(NULL, ",", &save);
-	}
-
-	if (ok) {
-		return 0;
-	}
-
-	else {
-		return -1;
-	}
+	return r;
 }
 
 // legge dal server una lista di file, separati da virgole
@@ -815,82 +788,23 @@ int cmd_r(const char *filelist, char *directory, int print) {
 	}
 
 	// parso la lista di file da leggere
-	char *token = NULL, *save = NULL;
-	char tokenList[256] = "";
-	strncpy(tokenList, filelist, strlen(filelist)+1);
-	token = strtok_r(tokenList, ",", &save);
-	int ok = 1;
+	char *tokenList = NULL;
+	char **files = NULL;
+	int n = splitList(filelist, &tokenList, &files);
+
+	if (n == -1) {
+		return -1;
+	}
 
 	if (print) {
 		printf("\nr - Leggo i seguenti file dal server:\n");
 		fflush(stdout);
 	}
 
-	// per ogni file nella lista...
-	while (token != NULL) {
-		ok = 1;
-		int opened = 0;
-		if (print != 0) {
-			printf("\n%-20s", token); 
-			fflush(stdout);
-		}
-
-		// apro il file
-		if (openFile(token, 0) == -1) {
-			ok = 0;
-		}
-
-		// se il file e' stato aperto con successo...
-		else {
-			opened = 1;
-		}
-		
-		void *buf = NULL;
-		size_t size = -1;
-
-		// leggo il contenuto del file
-		printInfo(0);
-		if (ok && readFile(token, &buf, &size) == -1) {
-			ok = 0;
-		}
-		if (print) {
-			printInfo(1);
-		}
-
-		if (ok && print) {
-			printf("Dimensione: %zu B\t", size);
-			fflush(stdout);
-		}
-
-		if (buf) {
-			free(buf);
-		}
-
-		// chiudo il file
-		if (opened && closeFile(token) == -1) {
-			ok = 0;
-		}
-
-		if (print) {
-			printf("Esito: "); 
-
-			if (ok) {
-				printf("ok");
-			}
-			
-			else {
-				printf("errore");
-				perror("-r");
-			}
-		}
-
-		if (print) {
-			printf("\n");
-			fflush(stdout);
-		}
+	int r = readList(files, n, print);
 
-		token = strtok_r(NULL, ",", &save);
-	}
+	free(files);
+	free(tokenList);
 
 	if (print && directory) {
 		printf("\nI file letti sono stati scritti nella cartella %s.\n.", directory);
@@ -902,13 +816,7 @@ int cmd_r(const char *filelist, char *directory, int print) {
 		fflush(stdout);
 	}
 
-	if (ok) {
-		return 0;
-	}
-
-	else {
-		return -1;
-	}
+	return r;
 }
 
 // leggi 'n' file qualsiasi attualmente memorizzati nel server
@@ -1125,6 +1033,188 @@ int cmd_c(const char *filelist, int print) {
 	return 0;
 }
 
+// divide una lista di file separati da virgole: i nomi puntano all'interno di una copia della lista (da liberare)
+int splitList(const char *filelist, char **copy, char ***files) {
+	// controllo la validita' degli argomenti
+	if (!filelist || !copy || !files) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int max = 1;
+
+	for (const char *c = filelist; *c; c++) {
+		if (*c == ',') {
+			max++;
+		}
+	}
+
+	if ((*copy = strdup(filelist)) == NULL || (*files = malloc(max * sizeof(char*))) == NULL) {
+		free(*copy);
+		return -1;
+	}
+
+	char *token = NULL, *save = NULL;
+	int n = 0;
+	token = strtok_r(*copy, ",", &save);
+
+	while (token != NULL) {
+		(*files)[n++] = token;
+		token = strtok_r(NULL, ",", &save);
+	}
+
+	return n;
+}
+
+/**
+ * Scrive una lista di file sul server: per ogni file, creazione in modalita' locked, scrittura e chiusura, inviate con 
+ * le operazioni batch (la scrittura e la chiusura vengono eseguite solo se l'operazione precedente ha avuto successo).
+ * Se il file e' stato creato ma la scrittura non e' riuscita, elimina il file vuoto appena creato.
+ */
+int writeList(char **files, int n, char *Directory, int print) {
+	batchItemT *items = NULL;
+	int ok = 1;
+
+	if (n > 0 && (items = calloc(3 * n, sizeof(batchItemT))) == NULL) {
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		items[3*i].op = OP_OPEN;
+		items[3*i].flags = O_CREATE | O_LOCK;
+		items[3*i + 1].op = OP_WRITE;
+		items[3*i + 1].flags = BATCH_CHAIN;
+		items[3*i + 2].op = OP_CLOSE;
+		items[3*i + 2].flags = BATCH_CHAIN;
+
+		for (int j = 0; j < 3; j++) {
+			items[3*i + j].pathname = files[i];
+		}
+	}
+
+	// se la connessione si interrompe, le operazioni non eseguite hanno l'errore EREMOTEIO
+	executeBatch(items, 3 * n, Directory);
+
+	// per ogni file nella lista...
+	for (int i = 0; i < n; i++) {
+		batchItemT *openOp = &items[3*i], *writeOp = &items[3*i + 1], *closeOp = &items[3*i + 2];
+		int err = openOp->err ? openOp->err : (writeOp->err ? writeOp->err : closeOp->err);
+
+		// se il file e' stato creato ma la scrittura non e' riuscita, elimina il file vuoto appena creato
+		if (openOp->err == 0 && writeOp->err != 0) {
+			removeFile(files[i]);
+		}
+
+		if (err) {
+			ok = 0;
+		}
+
+		if (print != 0) {
+			printf("\n%-20s", files[i]); 
+			printf("Esito: "); 
+
+			if (!err) {
+				printf("ok");
+			}
+			
+			else {
+				printf("errore");
+				errno = err;
+
+				if (print == 1) {
+					perror("-W");
+				}
+
+				else {
+					perror("-w");
+				}
+			}
+
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+
+	free(items);
+
+	return ok ? 0 : -1;
+}
+
+/**
+ * Legge una lista di file dal server: per ogni file, apertura, lettura e chiusura, inviate con le operazioni batch
+ * (la lettura e la chiusura vengono eseguite solo se l'operazione precedente ha avuto successo). I file letti vengono 
+ * scritti nella cartella impostata con setDirectory; se la lettura non e' riuscita, il file aperto viene chiuso.
+ */
+int readList(char **files, int n, int print) {
+	batchItemT *items = NULL;
+	int ok = 1;
+
+	if (n > 0 && (items = calloc(3 * n, sizeof(batchItemT))) == NULL) {
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		items[3*i].op = OP_OPEN;
+		items[3*i + 1].op = OP_READ;
+		items[3*i + 1].flags = BATCH_CHAIN;
+		items[3*i + 2].op = OP_CLOSE;
+		items[3*i + 2].flags = BATCH_CHAIN;
+
+		for (int j = 0; j < 3; j++) {
+			items[3*i + j].pathname = files[i];
+		}
+	}
+
+	// la dimensione dei file letti viene stampata insieme all'esito
+	printInfo(0);
+	executeBatch(items, 3 * n, NULL);
+	if (print) {
+		printInfo(1);
+	}
+
+	// per ogni file nella lista...
+	for (int i = 0; i < n; i++) {
+		batchItemT *openOp = &items[3*i], *readOp = &items[3*i + 1], *closeOp = &items[3*i + 2];
+		int err = openOp->err ? openOp->err : (readOp->err ? readOp->err : closeOp->err);
+
+		// se il file e' stato aperto ma la lettura non e' riuscita, lo chiudo
+		if (openOp->err == 0 && readOp->err != 0 && closeFile(files[i]) == -1 && !err) {
+			err = errno;
+		}
+
+		if (err) {
+			ok = 0;
+		}
+
+		if (print) {
+			printf("\n%-20s", files[i]); 
+
+			if (openOp->err == 0 && readOp->err == 0) {
+				printf("Dimensione: %zu B\t", readOp->size);
+			}
+
+			printf("Esito: "); 
+
+			if (!err) {
+				printf("ok");
+			}
+			
+			else {
+				printf("errore");
+				errno = err;
+				perror("-r");
+			}
+
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+
+	free(items);
+
+	return ok ? 0 : -1;
+}
+
 // chiudi la connessione con il server
 void cleanup() {
 	if (strcmp(globalSocket, "") != 0) {
@@ -10,12 +10,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #include <api.h>
 #include <partialIO.h>
+#include <protocol.h>
 
 #define UNIX_PATH_MAX 108 
 #define SOCKNAME_MAX 100
+#define STREAMSIZE (64 * 1024)	// dimensione dei blocchi con cui il contenuto dei file viene inviato e ricevuto
+#define PIPE_MAXBYTES (64 * 1024)	// bytes delle richieste in volo oltre i quali il client riceve prima le risposte
 //#define DEBUG
 
 // struttura dati per la lista dei file aperti
@@ -24,6 +28,19 @@ typedef struct struct_of {
 	struct struct_of *next;		// puntatore al prossimo elemento nella lista
 } ofT;
 
+// richiesta inviata con pipelineRequest, in attesa di essere restituita da pipelineWait
+typedef struct {
+	uint32_t id;				// identificatore della richiesta
+	int op;						// codice dell'operazione
+	char path[PROTO_MAXPATH + 1];	// path del file
+	size_t bytes;				// bytes inviati con la richiesta (header, path e contenuto)
+	int received;				// 1 se la risposta e' gia' stata ricevuta
+	int ret;					// esito della richiesta (0 o -1)
+	int err;					// errno della richiesta, se ret = -1
+	void *buf;					// readFile: contenuto del file letto
+	size_t size;				// readFile: dimensione del contenuto
+} inflightT;
+
 static char socketName[SOCKNAME_MAX] = "";	// nome del socket al quale il client e' connesso
 static int fd_skt;							// file descriptor per le operazioni di lettura e scrittura sul server
 static int print = 0;						// se = 1, stampa su stdout informazioni sui comandi eseguiti
@@ -31,6 +48,15 @@ static ofT *openFiles = NULL;				// lista dei file attualmente aperti
 static int numOfFiles = 0;					// numero di file attualmente aperti
 static char *writingDirectory = NULL; 		// cartella dove scrivere i file espulsi dal server in seguito a una openFile
 static char *readingDirectory= NULL;		// cartella dove scrivere i file letti dal server
+static int protocol = PROTO_TEXT;			// versione del protocollo negoziata con il server
+static uint32_t requestId = 0;				// identificatore dell'ultima richiesta inviata
+static uint32_t answeredId = 0;				// identificatore dell'ultima richiesta della quale e' arrivata la risposta
+static inflightT inflight[MAX_INFLIGHT];	// richieste inviate con pipelineRequest (coda circolare, nell'ordine di invio)
+static int inflightHead = 0;				// posizione della richiesta piu' vecchia
+static int inflightCount = 0;				// richieste non ancora restituite da pipelineWait
+static int inflightReceived = 0;			// richieste delle quali e' gia' arrivata la risposta (le piu' vecchie)
+static size_t inflightBytes = 0;			// bytes delle richieste delle quali non e' ancora arrivata la risposta
+static char *ioBuf = NULL;					// buffer di STREAMSIZE bytes per il contenuto dei file, riusato da tutte le operazioni
 
 /**
  * se l'ultima operazione e' stata una openFile(O_CREATE | O_LOCK), 
@@ -39,6 +65,186 @@ static char *readingDirectory= NULL;		// cartella dove scrivere i file letti dal
  */
 static char createdAndLocked[256] = "";	
 
+static int receiveReply(inflightT *r);
+
+// invia una richiesta al server nel formato negoziato da openConnection
+static int writeRequest(int op, const char *pathname, long arg) {
+	if (protocol >= PROTO_V2) {
+		protoHeaderT hdr;
+		int flags = (op == OP_OPEN) ? (int) arg : 0;
+		uint64_t payloadLen = (op == OP_OPEN || arg < 0) ? 0 : (uint64_t) arg;
+		ssize_t len = encodeRequest(&hdr, protocol, op, flags, ++requestId, pathname, payloadLen);
+
+		if (len == -1) {
+			return -1;
+		}
+
+		// invio header e path con una sola scrittura
+		struct iovec iov[2];
+		iov[0].iov_base = &hdr;
+		iov[0].iov_len = sizeof(protoHeaderT);
+		iov[1].iov_base = (void*) pathname;
+		iov[1].iov_len = len - sizeof(protoHeaderT);
+
+		if (writevn(fd_skt, iov, (iov[1].iov_len > 0) ? 2 : 1) == -1) {
+			errno = EREMOTEIO;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	char cmd[PROTO_CMDSIZE];
+
+	if (formatTextRequest(cmd, op, pathname, arg) == -1) {
+		return -1;
+	}
+
+	#ifdef DEBUG
+	printf("Invio %s\n", cmd);
+	fflush(stdout);
+	#endif
+
+	if (writen(fd_skt, cmd, PROTO_CMDSIZE) == -1) {
+		errno = EREMOTEIO;
+		return -1;
+	}
+
+	requestId++;
+
+	return 0;
+}
+
+/**
+ * Invia la richiesta di un'operazione sincrona: se ci sono richieste in volo inviate con pipelineRequest, prima ne 
+ * riceve le risposte (conservandole per pipelineWait), in modo che la prossima risposta sia quella di questa richiesta.
+ */
+static int sendRequest(int op, const char *pathname, long arg) {
+	while (inflightReceived < inflightCount) {
+		if (receiveReply(&inflight[(inflightHead + inflightReceived) % MAX_INFLIGHT]) == -1) {
+			return -1;
+		}
+	}
+
+	return writeRequest(op, pathname, arg);
+}
+
+// negozia con il server la versione del protocollo da usare sulla connessione appena aperta
+static int negotiate() {
+	protoHeaderT hdr;
+	char res[3];
+	int version;
+
+	// la hello usa l'header v2 e propone la versione piu' alta supportata dal client
+	protocol = PROTO_TEXT;
+	encodeRequest(&hdr, PROTO_V2, OP_HELLO, 0, ++requestId, NULL, PROTO_V4);
+	answeredId = requestId;
+
+	if (writen(fd_skt, &hdr, sizeof(protoHeaderT)) == -1 || readn(fd_skt, res, 3) != 3 || 
+		readn(fd_skt, &version, sizeof(int)) != sizeof(int)) {
+		errno = EREMOTEIO;
+		return -1;
+	}
+
+	// se il server ha risposto con un errore, continuo ad usare il protocollo testuale
+	if (strcmp(res, "ok") == 0 && version >= PROTO_V2 && version <= PROTO_V4) {
+		protocol = version;
+	}
+
+	#ifdef DEBUG
+	printf("Versione del protocollo: %d\n", protocol);
+	fflush(stdout);
+	#endif
+
+	return 0;
+}
+
+/**
+ * Riceve la risposta del server ("ok", "es" o "er"): se e' un errore, riceve anche l'errno del server e lo imposta.
+ * Dal protocollo v3 la risposta e' preceduta dall'id della richiesta, che deve essere la piu' vecchia senza risposta.
+ */
+static int receiveResponse(char *res) {
+	char head[sizeof(uint32_t) + 3];
+	size_t headLen = (protocol >= PROTO_V3) ? sizeof(head) : 3;
+	int err;
+
+	if (readn(fd_skt, head, headLen) != headLen) {
+		errno = EREMOTEIO;
+		return -1;
+	}
+
+	answeredId++;
+
+	if (protocol >= PROTO_V3) {
+		uint32_t id;
+		memcpy(&id, head, sizeof(uint32_t));
+
+		if (id != answeredId) {
+			errno = EBADMSG;
+			return -1;
+		}
+	}
+
+	memcpy(res, head + headLen - 3, 3);
+	res[2] = '\0';
+
+	#ifdef DEBUG
+	printf("Ho ricevuto: %s\n", res);
+	fflush(stdout);
+	#endif
+
+	if (strcmp(res, "er") == 0) {
+		if (readn(fd_skt, &err, sizeof(int)) != sizeof(int)) {
+			errno = EREMOTEIO;
+			return -1;
+		}
+
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Invia al server size bytes letti dal file fdi, un blocco di STREAMSIZE bytes alla volta (nel buffer della connessione).
+ * Se il file si accorcia (o non e' piu' leggibile) durante l'invio, il contenuto annunciato viene completato con degli zeri,
+ * in modo da restare allineati con il server, e viene restituito un errore.
+ */
+static int sendContent(int fdi, size_t size) {
+	char *content = ioBuf;
+	size_t sent = 0;
+	int err = 0;
+
+	while (sent < size) {
+		size_t len = (size - sent < STREAMSIZE) ? size - sent : STREAMSIZE;
+		ssize_t r = (err == 0) ? readn(fdi, content, len) : 0;
+
+		if (r < (ssize_t) len) {
+			if (err == 0) {
+				err = (r == -1) ? errno : EIO;
+			}
+
+			r = (r < 0) ? 0 : r;
+			memset(content + r, 0, len - r);
+		}
+
+		if (writen(fd_skt, content, len) == -1) {
+			errno = EREMOTEIO;
+			return -1;
+		}
+
+		sent += len;
+	}
+
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
 // apre la connessione con il server
 int openConnection(const char* sockname, int msec, const struct timespec abstime) {
 	strncpy(createdAndLocked, "", 2);
@@ -84,6 +290,18 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
 		nanosleep(&ts, &ts);
 	}
 
+	// negozio la versione del protocollo
+	if (negotiate() == -1) {
+		close(fd_skt);
+		return -1;
+	}
+
+	// alloco il buffer per il contenuto dei file una sola volta per connessione
+	if (!ioBuf && (ioBuf = malloc(STREAMSIZE)) == NULL) {
+		close(fd_skt);
+		return -1;
+	}
+
 	// copio il nome del socket nella variabile globale
 	strncpy(socketName, sockname, SOCKNAME_MAX);
 
@@ -129,6 +347,17 @@ int closeConnection(const char* sockname) {
 		free(readingDirectory);
 	}
 
+	free(ioBuf);
+	ioBuf = NULL;
+
+	// scarto gli esiti delle richieste in volo non restituiti da pipelineWait (e le risposte non ancora arrivate)
+	for (int i = 0; i < inflightCount; i++) {
+		free(inflight[(inflightHead + i) % MAX_INFLIGHT].buf);
+	}
+
+	inflightHead = inflightCount = inflightReceived = 0;
+	inflightBytes = 0;
+
 	return 0;
 }
 
@@ -159,64 +388,20 @@ int openFile(const char* pathname, int flags) {
 		return -1;
 	}
 
-	char cmd[256] = "";
-
-	// preparo il comando da inviare al server in formato openFile:pathname:flags
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "openFile:", 10);
-	strncat(cmd, pathname, strlen(pathname) + 1);
-	strncat(cmd, ":", 2);
-	char flagStr[2];
-	snprintf(flagStr, sizeof(flags)+1, "%d", flags);
-	strncat(cmd, flagStr, strlen(flagStr) + 1);
-
-	// invio il comando al server
-	#ifdef DEBUG
-	printf("openFile: invio %s\n", cmd);
-	fflush(stdout);
-	#endif 
-
-	if (writen(fd_skt, cmd, 256) == -1) {
-		errno = EREMOTEIO;
-		return -1;
-	}
-
-	// ricevo la risposta dal server
-	void *buf = malloc(BUFSIZE);
-	int r = readn(fd_skt, buf, 3);
-	if (r == -1 || r == 0) {
-		free(buf);
-		errno = EREMOTEIO;
+	// invio la richiesta al server
+	if (sendRequest(OP_OPEN, pathname, flags) == -1) {
 		return -1;
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, buf, 3);
-
-	#ifdef DEBUG
-	printf("openFile: ho ricevuto: %s\n", res);
-	fflush(stdout);
-	#endif
-
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(buf, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, buf, sizeof(int))) == -1) {
-			free(buf);
-			errno = EREMOTEIO;
-			return -1;
-		}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, buf, sizeof(int));
-		free(buf);
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
 	// se il server ha dovuto espellere un file per fare spazio, lo ricevo
-	else if (strcmp(res, "es") == 0) {
+	if (strcmp(res, "es") == 0) {
 		if (print) {
 			printf("\n\tIl server ha espulso il seguente file:\n");
 			fflush(stdout);
@@ -224,7 +409,6 @@ int openFile(const char* pathname, int flags) {
 
 		if (receiveFile(writingDirectory, NULL, NULL) == -1) {
 			perror("receiveFile");
-			free(buf);
 			return -1;
 		}
 
@@ -237,8 +421,6 @@ int openFile(const char* pathname, int flags) {
 		}
 	}
 
-	free(buf);
-	
 	// aggiorno la lista dei file aperti
 	if (addOpenFile(pathname) == -1) {
 		perror("addOpenFile");
@@ -274,57 +456,20 @@ int readFile(const char* pathname, void** buf, size_t* size) {
 		return -1;
 	}
 
-	void *bufRes = malloc(BUFSIZE);
-	char cmd[256] = "";
-
-	// preparo il comando da inviare al server in formato readFile:pathname
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "readFile:", 11);
-	strncat(cmd, pathname, strlen(pathname) + 1);
-
-	if (writen(fd_skt, cmd, 256) == -1) {
-		free(bufRes);
-		errno = EREMOTEIO;
-		return -1;
-	}
-
-	// ricevo la risposta dal server
-	int r = readn(fd_skt, bufRes, 3);
-	if (r == -1 || r == 0) {
-		free(bufRes);
-		errno = EREMOTEIO;
+	// invio la richiesta al server
+	if (sendRequest(OP_READ, pathname, 0) == -1) {
 		return -1;
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, bufRes, 3);
-
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(bufRes, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, bufRes, sizeof(int))) == -1) {
-			free(bufRes);
-			errno = EREMOTEIO;
-			return -1;
-		}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, bufRes, sizeof(int));
-		free(bufRes);
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
-	else {
-		if (receiveFile(readingDirectory, buf, size) == -1) {
-			free(bufRes);
-			return -1;
-		}
-	}
-
-	free(bufRes);
-	return 0;
+	// ricevo il file
+	return receiveFile(readingDirectory, buf, size);
 }
 
 // legge 'N' file dal server
@@ -337,61 +482,25 @@ int readNFiles(int N, const char* dirname) {
 		return -1;
 	}
 
-	void *bufRes = malloc(BUFSIZE);
-	char cmd[256] = "";
 	int actualN = N;
 
-	// preparo il comando da inviare al server in formato readNFiles:N
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "readNFiles:", 13);
-	char NStr[2];
-	snprintf(NStr, sizeof(N)+1, "%d", N);
-	strncat(cmd, NStr, strlen(NStr) + 1);
-
-	if (writen(fd_skt, cmd, 256) == -1) {
-		free(bufRes);
-		errno = EREMOTEIO;
-		return -1;
-	}
-
-	// ricevo la risposta dal server
-	int r = readn(fd_skt, bufRes, 3);
-	if (r == -1 || r == 0) {
-		free(bufRes);
-		errno = EREMOTEIO;
+	// invio la richiesta al server
+	if (sendRequest(OP_READN, NULL, N) == -1) {
 		return -1;
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, bufRes, 3);
-
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(bufRes, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, bufRes, sizeof(int))) == -1) {
-			free(bufRes);
-			errno = EREMOTEIO;
-			return -1;
-		}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, bufRes, sizeof(int));
-		free(bufRes);
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
-	else {
-		// ricevi i file dal server
-		if ((actualN = receiveNFiles(dirname)) == -1) {
-			free(bufRes);
-			return -1;
-		}
+	// ricevi i file dal server
+	if ((actualN = receiveNFiles(dirname)) == -1) {
+		return -1;
 	}
 
-	free(bufRes);
-
 	// restituisci il numero di file letti
 	return actualN;
 }
@@ -418,115 +527,59 @@ int writeFile(const char* pathname, const char* dirname) {
 		return -1;
 	}
 
-	void *buf = malloc(BUFSIZE);
-	void *content = malloc(BUFSIZE);
-	size_t size = 0;
-	char cmd[256] = "";
+	struct stat info;
 
-	int fdi = -1, lung = 0;
-	// leggo il file da scrivere sul server
+	int fdi = -1;
+	// apro il file da scrivere sul server e ne leggo la dimensione: il contenuto verra' inviato a blocchi
 	if ((fdi = open(pathname, O_RDONLY)) == -1) {
-		free(buf);
-		free(content);
 		return -1;
 	}
 
-	while ((lung = read(fdi, content, BUFSIZE)) > 0) {
-		size += lung;
-	}
-
-	if (lung == -1) {
-		free(buf);
-		free(content);
+	if (fstat(fdi, &info) == -1) {
+		close(fdi);
 		return -1;
 	}
 
+	size_t size = info.st_size;
+
 	if (print) {
 		printf("Dimensione: %ld B\t", size);
 		fflush(stdout);
 	}
-	
-	if (size >= BUFSIZE) {
-		if (print) {
-			printf("\nLa dimensione del file supera il limite (%d B). Solo i primi %d B saranno inviati.\n", BUFSIZE, BUFSIZE);
-			fflush(stdout);
-		}
-	}
 
-	if (close(fdi) == -1) {
-		free(buf);
-		free(content);
+	// invio la richiesta al server
+	if (sendRequest(OP_WRITE, pathname, size) == -1) {
+		close(fdi);
 		return -1;
 	}
 
-	// preparo il comando da inviare al server in formato writeFile:pathname:size
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "writeFile:", 11);
-	strncat(cmd, pathname, strlen(pathname) + 1);
-	strncat(cmd, ":", 2);
-	char sizeStr[BUFSIZE];
-	snprintf(sizeStr, BUFSIZE, "%ld", size);
-	strncat(cmd, sizeStr, strlen(sizeStr) + 1);
+	// dal protocollo v3 il contenuto segue subito la richiesta: un errore locale viene restituito dopo la risposta
+	int sent = 0, sendErr = 0;
 
-	// invio il comando al server
-	#ifdef DEBUG
-	printf("writeFile: invio %s\n", cmd);
-	fflush(stdout);
-	#endif
-
-	if (writen(fd_skt, cmd, 256) == -1) {
-		free(buf);
-		free(content);
-		errno = EREMOTEIO;
-		return -1;
-	}
-
-	// ricevo la risposta dal server
-	int r = readn(fd_skt, buf, 3);
-	if (r == -1 || r == 0) {
-		free(buf);
-		free(content);
-		errno = EREMOTEIO;
-		return -1;
+	if (protocol >= PROTO_V3 && (sent = sendContent(fdi, size)) == -1) {
+		if ((sendErr = errno) == EREMOTEIO) {
+			close(fdi);
+			return -1;
+		}
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, buf, 3);
-
-	#ifdef DEBUG
-	printf("writeFile: ho ricevuto: %s\n", res);
-	fflush(stdout);
-	#endif
 
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(buf, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, buf, sizeof(int))) == -1) {
-			free(buf);
-			free(content);
-			errno = EREMOTEIO;
-			return -1;
-		}
-
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, buf, sizeof(int));
-		free(buf);
-		free(content);
+	if (receiveResponse(res) == -1) {
+		close(fdi);
 		return -1;
 	}
 
 	// se il server ha dovuto espellere dei file per fare spazio, li ricevo tutti
-	else if (strcmp(res, "es") == 0) {
+	if (strcmp(res, "es") == 0) {
 		if (print) {
 			printf("\n\tIl server ha espulso i seguenti file:\n");
 			fflush(stdout);
 		}
 
 		if (receiveNFiles(dirname) == -1) {
-			free(buf);
-			free(content);
+			close(fdi);
 			return -1;
 		}
 
@@ -540,16 +593,20 @@ int writeFile(const char* pathname, const char* dirname) {
 	}
 
 	// invio il contenuto del file al server
-	if (writen(fd_skt, content, size) == -1) {
-		free(buf);
-		free(content);
-		errno = EREMOTEIO;
+	if (protocol < PROTO_V3 && sendContent(fdi, size) == -1) {
+		close(fdi);
+		return -1;
+	}
+
+	if (close(fdi) == -1) {
+		return -1;
+	}
+
+	if (sent == -1) {
+		errno = sendErr;
 		return -1;
 	}
 
-	// libero la memoria
-	free(buf);
-	free(content);
 	return 0;
 }
 
@@ -575,100 +632,41 @@ int appendToFile(const char* pathname, void* buf, size_t size, const char* dirna
 		return -1;
 	}
 
-	size_t size2 = 0;
-
-	// controllo che la dimensione del buffer non sia piu' grande di BUFSIZE
-	if (size >= BUFSIZE) {
-		if (print) {
-			printf("\nLa dimensione del bufffer supera il limite (%d B). Solo i primi %d B saranno scritti.\n", BUFSIZE, BUFSIZE);
-		}
-
-		size2 = BUFSIZE;
-	}
-
-	else {
-		size2 = size;
-	}
-
-	void *readBuf = malloc(BUFSIZE);
-	char cmd[256] = "";
-	
-	// preparo il comando da inviare al server in formato appendToFile:pathname:size
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "appendToFile:", 15);
-	strncat(cmd, pathname, strlen(pathname) + 1);
-	strncat(cmd, ":", 2);
-	char sizeStr[BUFSIZE];
-	snprintf(sizeStr, BUFSIZE, "%ld", size2);
-	strncat(cmd, sizeStr, strlen(sizeStr) + 1);
-
-	// invio il comando al server
-	#ifdef DEBUG
-	printf("appendToFile: invio %s\n", cmd);
-	fflush(stdout);
-	#endif
-
-	if (writen(fd_skt, cmd, 256) == -1) {
-		free(readBuf);
-		errno = EREMOTEIO;
+	// invio la richiesta al server (dal protocollo v3 seguita subito dal contenuto)
+	if (sendRequest(OP_APPEND, pathname, size) == -1) {
 		return -1;
 	}
 
-	// ricevo la risposta dal server
-	int r = readn(fd_skt, readBuf, 3);
-	if (r == -1 || r == 0) {
-		free(readBuf);
+	if (protocol >= PROTO_V3 && writen(fd_skt, buf, size) == -1) {
 		errno = EREMOTEIO;
 		return -1;
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, readBuf, 3);
-
-	#ifdef DEBUG
-	printf("appendToFile: ho ricevuto: %s\n", res);
-	fflush(stdout);
-	#endif
 
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(readBuf, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, readBuf, sizeof(int))) == -1) {
-			free(readBuf);
-			errno = EREMOTEIO;
-			return -1;
-		}
-
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, readBuf, sizeof(int));
-		free(readBuf);
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
 	// se il server ha dovuto espellere dei file per fare spazio, li ricevo tutti
-	else if (strcmp(res, "es") == 0) {
+	if (strcmp(res, "es") == 0) {
 		if (print) {
 			printf("\nIl server ha espulso i seguenti file:\n");
 			fflush(stdout);
 		}
 
 		if (receiveNFiles(dirname) == -1) {
-			free(readBuf);
 			return -1;
 		}
 	}
 
 	// invio il contenuto del file al server
-	if (writen(fd_skt, buf, size2) == -1) {
-		free(readBuf);
+	if (protocol < PROTO_V3 && writen(fd_skt, buf, size) == -1) {
 		errno = EREMOTEIO;
 		return -1;
 	}
 
-	// libero la memoria
-	free(readBuf);
 	return 0;
 }
 
@@ -750,52 +748,20 @@ int unlockFile(const char* pathname) {
 		return -1;
 	}
 
-	// preparo il comando da inviare al server in formato unlockFile:pathname
-	char cmd[256] = "";
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "unlockFile:", 13);
-	strncat(cmd, pathname, strlen(pathname) + 1);
-
-	// invio il comando al server
-	if (writen(fd_skt, cmd, 256) == -1) {
-		errno = EREMOTEIO;
-		return -1;
-	}
-
-	// ricevo la risposta dal server
-	void *bufRes = malloc(BUFSIZE);
-	int r = readn(fd_skt, bufRes, 3);
-	if (r == -1 || r == 0) {
-		free(bufRes);
-		errno = EREMOTEIO;
+	// invio la richiesta al server
+	if (sendRequest(OP_UNLOCK, pathname, 0) == -1) {
 		return -1;
 	}
 
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
 	char res[3];
-	memcpy(res, bufRes, 3);
-
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(bufRes, 0, BUFSIZE);
-
-		// ...ricevo l'errno
-		if ((readn(fd_skt, bufRes, sizeof(int))) == -1) {
-			free(bufRes);
-			errno = EREMOTEIO;
-			return -1;
-		}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, bufRes, sizeof(int));
-		free(bufRes);
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
 	// unlockFile eseguita con successo
-	else {
-		free(bufRes);
-		return 0;
-	}
+	return 0;
 }
 
 // chiude un file nel server
@@ -814,44 +780,55 @@ int closeFile(const char* pathname) {
 		return -1;
 	}
 
-	char cmd[256] = "";
+	// invio la richiesta al server
+	if (sendRequest(OP_CLOSE, pathname, 0) == -1) {
+		return -1;
+	}
 
-	// preparo il comando da inviare al server in formato closeFile:pathname
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "closeFile:", 11);
-	strncat(cmd, pathname, strlen(pathname) + 1);
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
+	char res[3];
 
-	if (writen(fd_skt, cmd, 256) == -1) {
-		errno = EREMOTEIO;
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
-	// ricevo la risposta dal server
-	void *buf = malloc(BUFSIZE);
-	int r = readn(fd_skt, buf, 3);
-	if (r == -1 || r == 0) {
-		free(buf);
-		errno = EREMOTEIO;
-		return -1;
+	// aggiorno la lista dei file aperti
+	if (removeOpenFile(pathname) == -1) {
+		perror("removeOpenFile");
 	}
 
-	char res[3];
-	memcpy(res, buf, 3);
+	else {
+		numOfFiles--;
+	}
 
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(buf, 0, BUFSIZE);
+	return 0;
+}
 
-		// ...ricevo l'errno
-		if ((readn(fd_skt, buf, sizeof(int))) == -1) {
-			free(buf);
-			errno = EREMOTEIO;
-			return -1;
-		}
+// rimuove un file dal server
+int removeFile(const char* pathname) {
+	strncpy(createdAndLocked, "", 2);
+
+	// controllo la validita' dell'argomento
+	if (!pathname) {
+		errno = EINVAL;
+		return -1;
+	}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, buf, sizeof(int));
-		free(buf);
+	// se il file che si vuole cancellare non e' stato precedentemente aperto, errore
+	if (isOpen(pathname) != 1) {
+		errno = EPERM;
+		return -1;
+	}
+
+	// invio la richiesta al server
+	if (sendRequest(OP_REMOVE, pathname, 0) == -1) {
+		return -1;
+	}
+
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
+	char res[3];
+
+	if (receiveResponse(res) == -1) {
 		return -1;
 	}
 
@@ -864,425 +841,799 @@ int closeFile(const char* pathname) {
 		numOfFiles--;
 	}
 
-	// libero la memoria
-	free(buf);
 	return 0;
 }
 
-// rimuove un file dal server
-int removeFile(const char* pathname) {
-	strncpy(createdAndLocked, "", 2);
+// la connessione non e' piu' allineata con il server: tutte le richieste in volo senza risposta falliscono con errore
+static void failInflight(int err) {
+	while (inflightReceived < inflightCount) {
+		inflightT *r = &inflight[(inflightHead + inflightReceived) % MAX_INFLIGHT];
 
-	// controllo la validita' dell'argomento
-	if (!pathname) {
-		errno = EINVAL;
+		r->received = 1;
+		r->ret = -1;
+		r->err = err;
+		inflightBytes -= r->bytes;
+		inflightReceived++;
+	}
+}
+
+/**
+ * Riceve la risposta a una richiesta op sul file path inviata senza attenderne l'esito (pipelining o batch) e gli 
+ * eventuali file che la seguono, aggiornando la lista dei file aperti. In err restituisce 0 se la richiesta ha avuto 
+ * successo, altrimenti il suo errno. I file espulsi vengono scritti in evictDir, quelli letti nella cartella impostata 
+ * con setDirectory(dir, 0) (e restituiti in buf, se non e' NULL). Restituisce -1 solo se la connessione non e' piu' 
+ * utilizzabile.
+ */
+static int receiveOutcome(int op, const char *path, const char *evictDir, int *err, void **buf, size_t *size) {
+	char res[3];
+
+	*err = 0;
+
+	if (receiveResponse(res) == -1) {
+		*err = errno;
+
+		return (errno == EREMOTEIO || errno == EBADMSG) ? -1 : 0;
+	}
+
+	int status = 0;		// esito della ricezione dei file che seguono la risposta
+
+	switch (op) {
+		// eventuale file espulso per fare spazio al file creato
+		case OP_OPEN:
+			if (strcmp(res, "es") == 0) {
+				status = receiveFile(evictDir, NULL, NULL);
+			}
+
+			if (status == 0 && !isOpen(path) && addOpenFile(path) == -1) {
+				*err = errno;
+			}
+			break;
+
+		case OP_READ:
+			status = receiveFile(readingDirectory, buf, size);
+			break;
+
+		// eventuali file espulsi per fare spazio al contenuto scritto
+		case OP_WRITE:
+		case OP_APPEND:
+			if (strcmp(res, "es") == 0) {
+				status = (receiveNFiles(evictDir) == -1) ? -1 : 0;
+			}
+			break;
+
+		case OP_CLOSE:
+		case OP_REMOVE:
+			if (removeOpenFile(path) == 0) {
+				numOfFiles--;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	if (status == -1) {
+		*err = EREMOTEIO;
 		return -1;
 	}
 
-	// se il file che si vuole cancellare non e' stato precedentemente aperto, errore
-	if (isOpen(pathname) != 1) {
-		errno = EPERM;
+	return 0;
+}
+
+/**
+ * Riceve la risposta della piu' vecchia richiesta inviata con pipelineRequest della quale non e' ancora arrivata e ne 
+ * conserva l'esito per pipelineWait. Restituisce -1 solo se la connessione non e' piu' utilizzabile.
+ */
+static int receiveReply(inflightT *r) {
+	r->received = 1;
+	r->buf = NULL;
+	r->size = 0;
+	inflightBytes -= r->bytes;
+	inflightReceived++;
+
+	int status = receiveOutcome(r->op, r->path, writingDirectory, &r->err, &r->buf, &r->size);
+	r->ret = (r->err == 0) ? 0 : -1;
+
+	if (status == -1) {
+		failInflight(r->err);
 		return -1;
 	}
 
-	char cmd[256] = "";
+	return 0;
+}
+
+// invia una richiesta senza attenderne la risposta
+long pipelineRequest(int op, const char *pathname, int flags, const void *buf, size_t size) {
+	strncpy(createdAndLocked, "", 2);
 
-	// preparo il comando da inviare al server in formato removeFile:pathname
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "removeFile:", 13);
-	strncat(cmd, pathname, strlen(pathname) + 1);
+	int content = (op == OP_WRITE || op == OP_APPEND);
 
-	if (writen(fd_skt, cmd, 256) == -1) {
-		errno = EREMOTEIO;
+	// controllo la validita' degli argomenti
+	if (!pathname || strlen(pathname) > PROTO_MAXPATH || (content && !buf && size > 0) || 
+		(op != OP_OPEN && op != OP_READ && !content && op != OP_LOCK && op != OP_UNLOCK && op != OP_CLOSE && op != OP_REMOVE)) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	// ricevo la risposta dal server
-	void *buf = malloc(BUFSIZE);
-	int r = readn(fd_skt, buf, 3);
-	if (r == -1 || r == 0) {
-		free(buf);
-		errno = EREMOTEIO;
+	// controllo che il client sia connesso al server
+	if (strcmp(socketName, "") == 0) {
+		errno = ENOTCONN;
 		return -1;
 	}
 
-	char res[3];
-	memcpy(res, buf, 3);
+	// il pipelining richiede almeno il protocollo v3
+	if (protocol < PROTO_V3) {
+		errno = EPROTONOSUPPORT;
+		return -1;
+	}
 
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(buf, 0, BUFSIZE);
+	// gli esiti delle richieste gia' inviate devono prima essere restituiti da pipelineWait
+	if (inflightCount == MAX_INFLIGHT) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* il server risponde a una richiesta solo dopo averne ricevuto il contenuto, e non legge altre richieste mentre invia
+	una risposta: limitando i bytes in volo (se ce ne sono gia', ricevo prima le risposte delle richieste piu' vecchie) 
+	le scritture del client non si bloccano mai, quindi client e server non possono attendersi a vicenda */
+	size_t bytes = sizeof(protoHeaderT) + strlen(pathname) + (content ? size : 0);
 
-		// ...ricevo l'errno
-		if ((readn(fd_skt, buf, sizeof(int))) == -1) {
-			free(buf);
+	while (inflightReceived < inflightCount && inflightBytes + bytes > PIPE_MAXBYTES) {
+		if (receiveReply(&inflight[(inflightHead + inflightReceived) % MAX_INFLIGHT]) == -1) {
 			errno = EREMOTEIO;
 			return -1;
 		}
+	}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, buf, sizeof(int));
-		free(buf);
+	if (writeRequest(op, pathname, (op == OP_OPEN) ? flags : (content ? (long) size : 0)) == -1) {
 		return -1;
 	}
 
-	// aggiorno la lista dei file aperti
-	if (removeOpenFile(pathname) == -1) {
-		perror("removeOpenFile");
+	if (content && size > 0 && writen(fd_skt, (void*) buf, size) == -1) {
+		errno = EREMOTEIO;
+		return -1;
+	}
+
+	// aggiungo la richiesta in coda a quelle in volo
+	inflightT *r = &inflight[(inflightHead + inflightCount) % MAX_INFLIGHT];
+	r->id = requestId;
+	r->op = op;
+	strncpy(r->path, pathname, PROTO_MAXPATH + 1);
+	r->bytes = bytes;
+	r->received = 0;
+	r->buf = NULL;
+	inflightCount++;
+	inflightBytes += bytes;
+
+	return (long) r->id;
+}
+
+// restituisce l'esito della piu' vecchia richiesta inviata con pipelineRequest
+int pipelineWait(long *id, void **buf, size_t *size) {
+	if (inflightCount == 0) {
+		errno = ENODATA;
+		return -1;
+	}
+
+	inflightT *r = &inflight[inflightHead];
+
+	// se la risposta non e' ancora arrivata, la ricevo (un errore di connessione resta nell'esito della richiesta)
+	if (!r->received) {
+		receiveReply(r);
+	}
+
+	inflightHead = (inflightHead + 1) % MAX_INFLIGHT;
+	inflightCount--;
+	inflightReceived--;
+
+	if (id) {
+		*id = (long) r->id;
+	}
+
+	if (buf) {
+		*buf = r->buf;
+	}
+
+	else {
+		free(r->buf);
+	}
+
+	if (size) {
+		*size = r->size;
+	}
+
+	if (r->ret == -1) {
+		errno = r->err;
+		return -1;
 	}
 
-	// libero la memoria
-	free(buf);
 	return 0;
 }
 
-// funzione ausiliaria che riceve un file dal server
-int receiveFile(const char *dirname, void** bufA, size_t *sizeA) {
-	void *buf = malloc(BUFSIZE);
-	memset(buf, 0, BUFSIZE);
-	char filepath[BUFSIZE];
-	size_t size = 0;
-	char dir[256] = "";
-	void *content = NULL;
-	char *filename = malloc(256);
+// restituisce il numero di richieste inviate con pipelineRequest e non ancora restituite da pipelineWait
+int pipelinePending() {
+	return inflightCount;
+}
 
-	// se e' stata passata una directory, usala per scriverci dentro i file ricevuti dal serevr
-	if (dirname && strcmp(dirname, "") != 0) {
-		// se la directory non esiste, creala
-		if (mkdir(dirname, 0777) == -1) {
-			if (strcmp(strerror(errno), "File exists") != 0) {
-				free(buf);
-				return -1;
+// controlla un'operazione di un batch prima di inviarla: restituisce 0 se puo' essere eseguita, altrimenti l'errno
+static int checkBatchItem(batchItemT *items, int i) {
+	batchItemT *it = &items[i];
+	int op = it->op;
+
+	if (!it->pathname || strlen(it->pathname) > PROTO_MAXPATH || (op == OP_APPEND && !it->buf && it->size > 0) ||
+		(op == OP_OPEN && (it->flags & ~BATCH_CHAIN) > (O_CREATE | O_LOCK)) || (op != OP_OPEN && op != OP_READ && 
+		op != OP_WRITE && op != OP_APPEND && op != OP_UNLOCK && op != OP_CLOSE && op != OP_REMOVE)) {
+		return EINVAL;
+	}
+
+	// come per la writeFile, l'operazione precedente deve essere una openFile(O_CREATE | O_LOCK) dello stesso file
+	if (op == OP_WRITE && (i == 0 || items[i-1].op != OP_OPEN || (items[i-1].flags & O_CREATE) == 0 || 
+		(items[i-1].flags & O_LOCK) == 0 || strcmp(items[i-1].pathname, it->pathname) != 0)) {
+		return EPERM;
+	}
+
+	// un'operazione concatenata a una gia' fallita non viene eseguita
+	if ((it->flags & BATCH_CHAIN) && i > 0 && items[i-1].err != 0 && items[i-1].err != EINPROGRESS) {
+		return ECANCELED;
+	}
+
+	return 0;
+}
+
+/**
+ * Invia in un batch le operazioni di items a partire da first, finche' entrano nel buffer della connessione (al piu' 
+ * PROTO_MAXBATCH), e ne riceve le risposte. Il batch viene inviato con una sola writen, che non si blocca perche' il 
+ * server non ha altre richieste da leggere: il client non puo' quindi restare bloccato in scrittura mentre il server 
+ * gli risponde. Una scrittura piu' grande del buffer viene inviata da sola, con il contenuto inviato un blocco alla volta.
+ * Le operazioni inviate hanno err = EINPROGRESS fino alla risposta. Restituisce l'indice della prima operazione non 
+ * ancora eseguita, -1 se la connessione non e' piu' utilizzabile (setta errno).
+ */
+static int runBatch(batchItemT *items, int first, int n, const char *dirname) {
+	size_t len = sizeof(protoHeaderT);	// bytes del batch nel buffer, dopo l'header che viene composto alla fine
+	uint32_t batchId = ++requestId;
+	int count = 0;						// operazioni inviate
+	batchItemT *big = NULL;				// operazione il cui contenuto viene inviato dopo il buffer
+	size_t bigSize = 0;
+	int bigFd = -1;
+	int bigErr = 0;
+	int i;
+
+	for (i = first; i < n && count < PROTO_MAXBATCH; i++) {
+		batchItemT *it = &items[i];
+		int fdi = -1;
+		size_t size = (it->op == OP_APPEND) ? it->size : 0;
+
+		if ((it->err = checkBatchItem(items, i)) != 0) {
+			continue;
+		}
+
+		size_t reqLen = sizeof(protoHeaderT) + strlen(it->pathname);
+
+		// la writeFile invia il contenuto del file locale
+		if (it->op == OP_WRITE) {
+			struct stat st;
+
+			if ((fdi = open(it->pathname, O_RDONLY)) == -1 || fstat(fdi, &st) == -1) {
+				it->err = errno;
+
+				if (fdi != -1) {
+					close(fdi);
+				}
+
+				continue;
+			}
+
+			size = st.st_size;
+		}
+
+		// l'operazione non entra nel buffer: se non e' la prima la invio nel prossimo batch, altrimenti da sola
+		if (len + reqLen + size > STREAMSIZE) {
+			if (count > 0) {
+				it->err = EINPROGRESS;
+
+				if (fdi != -1) {
+					close(fdi);
+				}
+
+				break;
 			}
+
+			big = it;
+			bigSize = size;
+			bigFd = fdi;
 		}
 
-		strncpy(dir, dirname, strlen(dirname)+1);
+		// se entra, copio nel buffer il contenuto, che segue header e path
+		else if (it->op == OP_APPEND && size > 0) {
+			memcpy(ioBuf + len + reqLen, it->buf, size);
+		}
 
-		if (dir[strlen(dir)] != '/') {
-			dir[strlen(dir)] = '/';
+		else if (it->op == OP_WRITE) {
+			ssize_t r = readn(fdi, ioBuf + len + reqLen, size);
+			close(fdi);
+
+			if (r != (ssize_t) size) {
+				it->err = (r == -1) ? errno : EIO;
+				continue;
+			}
+		}
+
+		protoHeaderT hdr;
+		int flags = (it->op == OP_OPEN) ? it->flags : (it->flags & BATCH_CHAIN);
+
+		encodeRequest(&hdr, protocol, it->op, flags, ++requestId, it->pathname, size);
+		memcpy(ioBuf + len, &hdr, sizeof(protoHeaderT));
+		memcpy(ioBuf + len + sizeof(protoHeaderT), it->pathname, reqLen - sizeof(protoHeaderT));
+		len += reqLen + (big ? 0 : size);
+		it->err = EINPROGRESS;
+		count++;
+
+		if (big) {
+			i++;
+			break;
 		}
 	}
 
-	// ricevo prima il filepath...
-	if ((readn(fd_skt, buf, BUFSIZE)) == -1) {
-		free(buf);
-		errno = EREMOTEIO;
-		return -1;
+	// nessuna operazione da inviare
+	if (count == 0) {
+		requestId = batchId - 1;
+		return i;
 	}
 
-	strncpy(filepath, buf, BUFSIZE);
+	protoHeaderT hdr;
+	encodeRequest(&hdr, protocol, OP_BATCH, 0, batchId, NULL, count);
+	memcpy(ioBuf, &hdr, sizeof(protoHeaderT));
 
-	#ifdef DEBUG
-	printf("Ho ricevuto filepath = %s\n", filepath);
-	fflush(stdout);
-	#endif
+	int broken = (writen(fd_skt, ioBuf, len) == -1);
 
-	// ...poi la dimensione del file...
-	memset(buf, 0, BUFSIZE);
-	if ((readn(fd_skt, buf, sizeof(size_t))) == -1) {
-		free(buf);
-		errno = EREMOTEIO;
-		return -1;
+	// contenuto dell'operazione inviata da sola: un errore nella lettura del file locale viene restituito dopo la risposta
+	if (!broken && big) {
+		if (big->op == OP_WRITE && sendContent(bigFd, bigSize) == -1) {
+			broken = (errno == EREMOTEIO);
+			bigErr = errno;
+		}
+
+		else if (big->op == OP_APPEND && writen(fd_skt, (void*) big->buf, bigSize) == -1) {
+			broken = 1;
+		}
 	}
 
-	memcpy(&size, buf, sizeof(size_t));
+	if (bigFd != -1) {
+		close(bigFd);
+	}
 
-	#ifdef DEBUG
-	printf("Ho ricevuto size = %ld\n", size);
-	fflush(stdout);
-	#endif
+	// ricevo la risposta al batch e poi quelle delle sue operazioni, nell'ordine di invio
+	char res[3];
 
-	if (sizeA) {
-		*sizeA = size;
+	if (!broken && receiveResponse(res) == -1) {
+		broken = 1;
 	}
 
-	content = malloc(size);
+	for (int k = first; k < i; k++) {
+		batchItemT *it = &items[k];
+		size_t size = 0;
 
-	// ...e infine il contenuto
-	if ((readn(fd_skt, content, size)) == -1) {
-		free(buf);
-		free(content);
+		if (it->err != EINPROGRESS) {
+			continue;
+		}
+
+		if (broken) {
+			it->err = EREMOTEIO;
+			continue;
+		}
+
+		if (receiveOutcome(it->op, it->pathname, dirname, &it->err, NULL, &size) == -1) {
+			broken = 1;
+		}
+
+		if (it->op == OP_READ && it->err == 0) {
+			it->size = size;
+		}
+
+		if (it == big && it->err == 0 && bigErr != 0) {
+			it->err = bigErr;
+		}
+	}
+
+	if (broken) {
 		errno = EREMOTEIO;
 		return -1;
 	}
 
-	// se è stato passato un buffer come argomento, ci copio dentro il contenuto del file ricevuto
-	if (bufA) {
-		*bufA = calloc(1, size);
-		memcpy(*bufA, content, size);
+	return i;
+}
+
+// esegue una lista di operazioni con il minor numero possibile di batch
+int executeBatch(batchItemT *items, int n, const char *dirname) {
+	strncpy(createdAndLocked, "", 2);
+
+	// controllo la validita' degli argomenti
+	if (!items || n < 0) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	if (print) {
-		printf("\t%-20s", filepath);
-		printf("\tDimensione: %ld B\n", size);
-		fflush(stdout);
+	// controllo che il client sia connesso al server
+	if (strcmp(socketName, "") == 0) {
+		errno = ENOTCONN;
+		return -1;
 	}
 
-	if (dirname) {
-		memset(filename, '\0', 256);
-		strncpy(filename, filepath, strlen(filepath)+1);
-		char fullpath[512] = "";
-		strncpy(fullpath, dir, 256);
-
-		/**
-		 * se il nome del file ricevuto contiene dei caratteri "/", li sostituisco con "-".
-		 * Questo puo' accadere poiche' il server memorizza i file utilizzando il loro path assoluto come identificatore.
-		*/
-		int i = 0;
-		while (filename[i]) {
-			if (filename[i] == '/') {
-				filename[i] = '-';
+	// le operazioni restano in corso finche' non vengono eseguite (se la connessione si interrompe falliscono con EREMOTEIO)
+	for (int i = 0; i < n; i++) {
+		items[i].err = EINPROGRESS;
+	}
+
+	// se il server non supporta i batch, eseguo le operazioni una alla volta con le funzioni corrispondenti
+	if (protocol < PROTO_V4) {
+		for (int i = 0; i < n; i++) {
+			batchItemT *it = &items[i];
+			int r = -1;
+
+			if ((it->err = checkBatchItem(items, i)) != 0) {
+				continue;
 			}
 
-			i++;
+			switch (it->op) {
+				case OP_OPEN:
+					r = openFile(it->pathname, it->flags & ~BATCH_CHAIN);
+					break;
+
+				case OP_READ:
+					r = readFile(it->pathname, NULL, &it->size);
+					break;
+
+				case OP_WRITE:
+					r = writeFile(it->pathname, dirname);
+					break;
+
+				case OP_APPEND:
+					r = appendToFile(it->pathname, (void*) it->buf, it->size, dirname);
+					break;
+
+				case OP_UNLOCK:
+					r = unlockFile(it->pathname);
+					break;
+
+				case OP_CLOSE:
+					r = closeFile(it->pathname);
+					break;
+
+				case OP_REMOVE:
+					r = removeFile(it->pathname);
+					break;
+			}
+
+			it->err = (r == -1) ? errno : 0;
 		}
+	}
 
-		#ifdef DEBUG
-		printf("Dir: %s Filename: %s Fullpath: %s.\n", dir, filename, fullpath);
-		printf("Scrivo %ld bytes nella cartella %s.\n", size, fullpath);
-		#endif
+	else {
+		int broken = 0;
 
-		strncat(fullpath, filename, 256);
-		
-		// apro file di output
-		int fdo;
-		if ((fdo = open(fullpath, O_WRONLY | O_CREAT, 0666)) == -1) {
-			free(content);
-	    	free(filename);
-	    	free(buf);
-	    	return -1;
+		// le risposte delle richieste in volo arrivano prima di quelle del batch
+		while (!broken && inflightReceived < inflightCount) {
+			broken = (receiveReply(&inflight[(inflightHead + inflightReceived) % MAX_INFLIGHT]) == -1);
 		}
 
-		// scrivo sul file di output
-		if (write(fdo, content, size) == -1) {
-			free(content);
-	    	free(filename);
-	    	free(buf);
-	    	return -1;
+		for (int i = 0; !broken && i < n; ) {
+			broken = ((i = runBatch(items, i, n, dirname)) == -1);
 		}
 
-		// chiudo il file di output
-		if (close(fdo) == -1) {
-			free(content);
-	    	free(filename);
-	    	free(buf);
-	    	return -1;
+		if (broken) {
+			for (int i = 0; i < n; i++) {
+				if (items[i].err == EINPROGRESS) {
+					items[i].err = EREMOTEIO;
+				}
+			}
+
+			errno = EREMOTEIO;
+			return -1;
 		}
 	}
 
-	// libero la memoria
-	free(filename);
-	free(content);
-	free(buf);
+	int done = 0;
 
-	return 0;
+	for (int i = 0; i < n; i++) {
+		if (items[i].err == 0) {
+			done++;
+		}
+	}
+
+	return done;
 }
 
-// funzione ausiliaria che riceve N files  dal server
-int receiveNFiles(const char *dirname) {
-	void *buf = NULL;
-	buf = malloc(BUFSIZE);
-	char filepath[BUFSIZE];
-	size_t size = 0;
-	int fine = 0;
-	char dir[256] = "";
-	char *filename = malloc(256);
-	int filesCount = 0;
+// prepara la cartella nella quale scrivere i file ricevuti dal server, creandola se non esiste
+static int prepareDir(const char *dirname, char *dir) {
+	strncpy(dir, "", 2);
 
-	// se e' stata passata una directory, usala per scriverci dentro i file ricevuti dal serevr
 	if (dirname && strcmp(dirname, "") != 0) {
 		// se la directory non esiste, creala
-		if (mkdir(dirname, 0777) == -1) {
-			if (strcmp(strerror(errno), "File exists") != 0) {
-				free(buf);
-				return -1;
-			}
+		if (mkdir(dirname, 0777) == -1 && errno != EEXIST) {
+			return -1;
 		}
 
-		strncpy(dir, dirname, strlen(dirname)+1);
+		strncpy(dir, dirname, 254);
+		dir[254] = '\0';
 
-		if (dir[strlen(dir)] != '/') {
-			dir[strlen(dir)] = '/';
+		if (dir[strlen(dir) - 1] != '/') {
+			strncat(dir, "/", 2);
 		}
 	}
-	
-	while (!fine) {
-		memset(buf, 0, BUFSIZE);
-		memset(filepath, '\0', BUFSIZE);
-		size = 0;
-		void *content = NULL;
 
-		// ricevo prima il filepath
-		if ((readn(fd_skt, buf, BUFSIZE)) == -1) {
-			free(buf);
+	return 0;
+}
+
+/**
+ * Riceve dal server il path e la dimensione del prossimo file. Nel protocollo v2 il file e' preceduto da un frame
+ * con la lunghezza del path, in quello testuale il path occupa BUFSIZE bytes.
+ * Restituisce 1 se e' stato ricevuto un file, 0 se la sequenza di file e' terminata, -1 se errore.
+ */
+static int receiveFileHeader(char *filepath, size_t *size) {
+	if (protocol >= PROTO_V2) {
+		fileFrameT frame;
+
+		if (readn(fd_skt, &frame, sizeof(fileFrameT)) != sizeof(fileFrameT)) {
 			errno = EREMOTEIO;
 			return -1;
 		}
 
-		strncpy(filepath, buf, BUFSIZE);
-
-		#ifdef DEBUG
-		printf("Ho ricevuto filepath = %s.\n", filepath);
-		fflush(stdout);
-		#endif
-
-		// se ho finito di ricevere file, esci
-		if (strcmp(filepath, ".FINE") == 0) {
-			fine = 1;
-			break;
+		if (frame.flags & FRAME_END) {
+			return 0;
 		}
 
-		else {
-			filesCount++;
+		if (frame.pathLen > PROTO_MAXPATH || readn(fd_skt, filepath, frame.pathLen) != frame.pathLen) {
+			errno = EREMOTEIO;
+			return -1;
 		}
 
-		if (print) {
-			printf("\t%-20s", filepath);
-		}
+		filepath[frame.pathLen] = '\0';
+		*size = frame.size;
+		return 1;
+	}
 
-		// poi ricevo la dimensione del file...
-		memset(buf, 0, BUFSIZE);
-		if ((readn(fd_skt, buf, sizeof(size_t))) == -1) {
-			free(buf);
+	// ricevo prima il filepath, che occupa al piu' PROTO_MAXPATH + 1 bytes dei BUFSIZE inviati...
+	if (readn(fd_skt, filepath, PROTO_MAXPATH + 1) != PROTO_MAXPATH + 1) {
+		errno = EREMOTEIO;
+		return -1;
+	}
+
+	filepath[PROTO_MAXPATH] = '\0';
+
+	// ...e scarto i bytes di riempimento
+	for (size_t left = BUFSIZE - (PROTO_MAXPATH + 1); left > 0; ) {
+		size_t len = (left < STREAMSIZE) ? left : STREAMSIZE;
+
+		if (readn(fd_skt, ioBuf, len) != len) {
 			errno = EREMOTEIO;
 			return -1;
 		}
 
-		memcpy(&size, buf, sizeof(size_t));
+		left -= len;
+	}
 
-		if (print) {
-			printf("\tDimensione: %ld B\n", size);
-			fflush(stdout);
-		}
+	// ...che vale ".FINE" alla fine di una sequenza di file
+	if (strcmp(filepath, ".FINE") == 0) {
+		return 0;
+	}
 
-		#ifdef DEBUG
-		printf("Ho ricevuto size = %ld.\n", size);
-		#endif
+	// ...poi la dimensione del file
+	if (readn(fd_skt, size, sizeof(size_t)) != sizeof(size_t)) {
+		errno = EREMOTEIO;
+		return -1;
+	}
 
-		content = malloc(size);
+	return 1;
+}
 
-		// ...e infine il contenuto
-		if ((readn(fd_skt, content, size)) == -1) {
-			free(buf);
-			free(content);
-			errno = EREMOTEIO;
-			return -1;
+// apre (creandolo) il file della cartella dir nel quale scrivere un file ricevuto dal server
+static int openStoreFile(const char *dir, const char *filepath) {
+	char filename[PROTO_MAXPATH + 1];
+	char fullpath[512] = "";
+
+	strncpy(filename, filepath, PROTO_MAXPATH + 1);
+	strncpy(fullpath, dir, 256);
+
+	/**
+	 * se il nome del file ricevuto contiene dei caratteri "/", li sostituisco con "-".
+	 * Questo puo' accadere poiche' il server memorizza i file utilizzando il loro path assoluto come identificatore.
+	*/
+	int i = 0;
+	while (filename[i]) {
+		if (filename[i] == '/') {
+			filename[i] = '-';
 		}
 
-		// se il client ha specificato una cartella, vi scrivo dentro il file appena ricevuto
-		if (dirname) {
-			memset(filename, '\0', 256);
-			strncpy(filename, filepath, strlen(filepath)+1);
-			char fullpath[512] = "";
-			memset(fullpath, '\0', 256);
-			strncpy(fullpath, dir, 256);
-
-			/**
-			 * se il nome del file ricevuto contiene dei caratteri "/", li sostituisco con "-".
-			 * Questo puo' accadere poiché il server memorizza i file utilizzando il loro path assoluto come identificatore.
-			*/
-			int i = 0;
-			while (filename[i]) {
-				if (filename[i] == '/') {
-					filename[i] = '-';
-				}
+		i++;
+	}
 
-				i++;
-			}
+	strncat(fullpath, filename, 256);
 
-			strncat(fullpath, filename, 256);
+	#ifdef DEBUG
+	printf("Scrivo il file %s.\n", fullpath);
+	#endif
 
-			// apro file di output
-			int fdo;
-			if ((fdo = open(fullpath, O_WRONLY | O_CREAT, 0666)) == -1) {
-				free(content);
-		    	free(filename);
-		    	free(buf);
-		    	return -1;
-			}
+	// apro file di output
+	return open(fullpath, O_WRONLY | O_CREAT, 0666);
+}
 
-			// scrivo sul file di output
-			if (write(fdo, content, size) == -1) {
-				free(content);
-		    	free(filename);
-		    	free(buf);
-		    	return -1;
-			}
+/**
+ * Riceve dal server size bytes di contenuto e, se fdo != -1, li scrive sul file fdo. Se bufA non e' NULL il contenuto
+ * viene restituito in un buffer allocato (da liberare con free), altrimenti viene ricevuto nel buffer della connessione,
+ * un blocco di STREAMSIZE bytes alla volta. Se la scrittura su fdo fallisce il contenuto viene comunque ricevuto, in modo da restare allineati con il
+ * server, e viene restituito un errore.
+ */
+static int receiveContent(int fdo, size_t size, void **bufA) {
+	size_t bufSize = bufA ? size : STREAMSIZE;
+	void *content = bufA ? malloc(size > 0 ? size : 1) : ioBuf;
+	size_t received = 0;
+	int err = 0;
+
+	if (!content) {
+		return -1;
+	}
+
+	while (received < size) {
+		size_t len = (size - received < bufSize) ? size - received : bufSize;
 
-			// chiudo il file di output
-			if (close(fdo) == -1) {
+		if (readn(fd_skt, content, len) != len) {
+			if (bufA) {
 				free(content);
-		    	free(filename);
-		    	free(buf);
-		    	return -1;
 			}
+
+			errno = EREMOTEIO;
+			return -1;
 		}
-		
-	    free(content);
+
+		if (fdo != -1 && err == 0 && writen(fdo, content, len) == -1) {
+			err = errno;
+		}
+
+		received += len;
 	}
 
-	// libero la memoria
-	free(filename);
-	free(buf);
+	if (err != 0) {
+		if (bufA) {
+			free(content);
+		}
 
-	// ritorno il numero di file ricevuti dal server
-	return filesCount;
+		errno = err;
+		return -1;
+	}
+
+	if (bufA) {
+		*bufA = content;
+	}
+
+	return 0;
 }
 
-// funzione ausiliaria chiamata dalla lockFile
-int lockFile_aux(const char *pathname) {
-	// controllo la validita' dell'argomento
-	if (!pathname) {
-		errno = EINVAL;
+// riceve il contenuto di un file e, se e' stata passata una cartella, lo scrive al suo interno
+static int receiveAndStore(const char *dirname, const char *dir, const char *filepath, size_t size, void **bufA) {
+	int fdo = -1;
+
+	if (dirname && (fdo = openStoreFile(dir, filepath)) == -1) {
+		// ricevo comunque il contenuto, per restare allineato con il server
+		int err = errno;
+
+		if (receiveContent(-1, size, NULL) == 0) {
+			errno = err;
+		}
+
 		return -1;
 	}
 
-	// preparo il comando da inviare al server in formato lockFile:pathname
-	char cmd[256] = "";
-	memset(cmd, '\0', 256);
-	strncpy(cmd, "lockFile:", 11);
-	strncat(cmd, pathname, strlen(pathname) + 1);
+	int r = receiveContent(fdo, size, bufA);
 
-	// invio il comando al server
-	if (writen(fd_skt, cmd, 256) == -1) {
-		errno = EREMOTEIO;
+	if (fdo != -1 && close(fdo) == -1) {
+		r = -1;
+	}
+
+	return r;
+}
+
+
+// funzione ausiliaria che riceve un file dal server
+int receiveFile(const char *dirname, void** bufA, size_t *sizeA) {
+	char filepath[PROTO_MAXPATH + 1];
+	char dir[256] = "";
+	size_t size = 0;
+
+	// se e' stata passata una directory, usala per scriverci dentro i file ricevuti dal server
+	if (prepareDir(dirname, dir) == -1) {
 		return -1;
 	}
 
-	void *bufRes = malloc(BUFSIZE);
-	// ricevo la risposta dal server
-	int r = readn(fd_skt, bufRes, 3);
-	if (r == -1 || r == 0) {
-		free(bufRes);
+	// ricevo il path e la dimensione del file...
+	if (receiveFileHeader(filepath, &size) != 1) {
 		errno = EREMOTEIO;
 		return -1;
 	}
 
-	char res[3];
-	memcpy(res, bufRes, 3);
+	#ifdef DEBUG
+	printf("Ho ricevuto filepath = %s, size = %ld\n", filepath, size);
+	fflush(stdout);
+	#endif
 
-	// se il server mi ha risposto con un errore...
-	if (strcmp(res, "er") == 0) {
-		memset(bufRes, 0, BUFSIZE);
+	if (sizeA) {
+		*sizeA = size;
+	}
 
-		// ...ricevo l'errno
-		if ((readn(fd_skt, bufRes, sizeof(int))) == -1) {
-			free(bufRes);
-			errno = EREMOTEIO;
+	if (print) {
+		printf("\t%-20s", filepath);
+		printf("\tDimensione: %ld B\n", size);
+		fflush(stdout);
+	}
+
+	// ...e infine il contenuto, restituito nel buffer passato come argomento e/o scritto nella cartella
+	return receiveAndStore(dirname, dir, filepath, size, bufA);
+}
+
+// funzione ausiliaria che riceve N files  dal server
+int receiveNFiles(const char *dirname) {
+	char filepath[PROTO_MAXPATH + 1];
+	char dir[256] = "";
+	size_t size = 0;
+	int filesCount = 0;
+	int r;
+
+	// se e' stata passata una directory, usala per scriverci dentro i file ricevuti dal server
+	if (prepareDir(dirname, dir) == -1) {
+		return -1;
+	}
+
+	// ricevo i file finche' il server non segnala la fine della sequenza
+	while ((r = receiveFileHeader(filepath, &size)) == 1) {
+		filesCount++;
+
+		#ifdef DEBUG
+		printf("Ho ricevuto filepath = %s, size = %ld.\n", filepath, size);
+		fflush(stdout);
+		#endif
+
+		if (print) {
+			printf("\t%-20s", filepath);
+			printf("\tDimensione: %ld B\n", size);
+			fflush(stdout);
+		}
+
+		// ricevo il contenuto e, se il client ha specificato una cartella, lo scrivo al suo interno
+		if (receiveAndStore(dirname, dir, filepath, size, NULL) == -1) {
 			return -1;
 		}
+	}
 
-		// setto il mio errno uguale a quello che ho ricevuto dal server
-		memcpy(&errno, bufRes, sizeof(int));
-		free(bufRes);
+	if (r == -1) {
+		errno = EREMOTEIO;
 		return -1;
 	}
 
-	// lockFile eseguita con successo
-	else {
-		free(bufRes);
-		return 0;
+	// ritorno il numero di file ricevuti dal server
+	return filesCount;
+}
+
+// funzione ausiliaria chiamata dalla lockFile
+int lockFile_aux(const char *pathname) {
+	// controllo la validita' dell'argomento
+	if (!pathname) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// invio la richiesta al server
+	if (sendRequest(OP_LOCK, pathname, 0) == -1) {
+		return -1;
+	}
+
+	// ricevo la risposta dal server (se e' un errore, errno e' quello impostato dal server)
+	char res[3];
+
+	if (receiveResponse(res) == -1) {
+		return -1;
 	}
+
+	// lockFile eseguita con successo
+	return 0;
 }
 
 /* imposta la cartella sulla quale scrivere i file letti dal server con delle readFile,
@@ -3,6 +3,7 @@
 #define MAX_OPEN_FILES 50
 #define O_CREATE 1
 #define O_LOCK 2
+#define MAX_INFLIGHT 64 // numero massimo di richieste inviate con pipelineRequest e non ancora restituite da pipelineWait
 
 /**
  * Apre una connessione AF_UNIX al socket file "sockname". Se il server non accetta immediatamente la richiesta di connessione, 
@@ -116,6 +117,60 @@ int closeFile(const char *pathname);
  */
 int removeFile(const char* pathname);
 
+/**
+ * Invia una richiesta al server senza attenderne la risposta (pipelining), se con il server e' stato negoziato almeno il
+ * protocollo v3. Il server serve le richieste di una connessione nell'ordine di invio, quindi le operazioni su ogni file
+ * avvengono nell'ordine delle chiamate, e pipelineWait ne restituisce gli esiti nello stesso ordine. I file espulsi dal
+ * server vengono scritti nella cartella impostata con setDirectory(dir, 1), quelli letti in quella impostata con 
+ * setDirectory(dir, 0). Le altre funzioni della libreria possono essere chiamate anche con richieste in volo.
+ * \param op -> codice dell'operazione (protocol.h): OP_OPEN, OP_READ, OP_WRITE, OP_APPEND, OP_LOCK, OP_UNLOCK, OP_CLOSE o OP_REMOVE
+ * \param pathname -> nome del file
+ * \param flags -> openFile: O_CREATE e/o O_LOCK; ignorato dalle altre operazioni
+ * \param buf -> writeFile e appendToFile: contenuto da scrivere
+ * \param size -> writeFile e appendToFile: dimensione del contenuto
+ * \retval -> identificatore della richiesta se successo, -1 se errore (setta errno: EAGAIN se ci sono gia' MAX_INFLIGHT
+ *            richieste in attesa di pipelineWait, EPROTONOSUPPORT se il server non supporta il pipelining)
+ */
+long pipelineRequest(int op, const char *pathname, int flags, const void *buf, size_t size);
+
+/**
+ * Restituisce l'esito della piu' vecchia richiesta inviata con pipelineRequest, attendendone la risposta se necessario.
+ * \param id -> se non NULL, identificatore della richiesta
+ * \param buf -> se non NULL, contenuto letto da una OP_READ (da liberare con free), altrimenti NULL
+ * \param size -> se non NULL, dimensione del contenuto letto
+ * \retval -> 0 se la richiesta e' terminata con successo, -1 se errore (setta errno: quello della richiesta, oppure 
+ *            ENODATA se non ci sono richieste in volo)
+ */
+int pipelineWait(long *id, void **buf, size_t *size);
+
+/**
+ * Restituisce il numero di richieste inviate con pipelineRequest e non ancora restituite da pipelineWait.
+ */
+int pipelinePending();
+
+// operazione di un batch (vedi executeBatch)
+typedef struct {
+	int op;					// codice dell'operazione (protocol.h)
+	const char *pathname;	// nome del file
+	int flags;				// openFile: O_CREATE e/o O_LOCK; BATCH_CHAIN: eseguita solo se la precedente ha avuto successo
+	const void *buf;		// appendToFile: contenuto da scrivere
+	size_t size;			// appendToFile: dimensione del contenuto; readFile: dimensione del file letto
+	int err;				// esito dell'operazione: 0 se successo, altrimenti il codice d'errore (errno)
+} batchItemT;
+
+/**
+ * Esegue una lista di operazioni inviandole al server in batch, ognuno con una sola scrittura e un solo round trip: 
+ * le operazioni vengono eseguite nell'ordine della lista e l'esito di ciascuna viene restituito nel suo campo err. 
+ * Come per le funzioni corrispondenti, OP_WRITE scrive il file locale pathname (e deve seguire nella lista una 
+ * OP_OPEN dello stesso file con O_CREATE | O_LOCK), mentre OP_READ scrive il file letto nella cartella impostata con 
+ * setDirectory(dir, 0). Se il server non supporta i batch (protocollo v4), le operazioni vengono eseguite una alla volta.
+ * \param items -> operazioni da eseguire: OP_OPEN, OP_READ, OP_WRITE, OP_APPEND, OP_UNLOCK, OP_CLOSE o OP_REMOVE
+ * \param n -> numero di operazioni
+ * \param dirname -> se != NULL, cartella dove scrivere i file espulsi dal server in seguito a capacity misses
+ * \retval -> numero di operazioni terminate con successo, -1 se la connessione non e' piu' utilizzabile (setta errno)
+ */
+int executeBatch(batchItemT *items, int n, const char *dirname);
+
 /**
  * A seconda del flag 'rw', imposta la cartella per le scritture dei file eventualmente espulsi dal server in seguito a capacity misses 
  * provocati dalle openFile(O_CREATE), oppure imposta la cartella dove scrivere i file letti con le readFile.
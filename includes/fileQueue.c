@@ -1,14 +1,192 @@
+#define _GNU_SOURCE     // pthread_rwlockattr_setkind_np
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <fileQueue.h>
 
+// allocatori dei metadati dello storage (fileT, nodi, elementi fantasma, bucket LFU e path), condivisi da tutte le code
+static slabPoolT filePool;
+static slabPoolT nodePool;
+static slabPoolT ghostPool;
+static slabPoolT freqPool;
+static slabPoolT chunkPool;
+static slabPoolT pathPools[PATH_CLASSES];  // pathPools[i] contiene i path lunghi (terminatore compreso) fino a PATH_CLASS * (i+1) bytes
+static char pathNames[PATH_CLASSES][16];
+static pthread_once_t poolsOnce = PTHREAD_ONCE_INIT;
+static int poolsReady = 0;
+
+// inizializza gli allocatori (una sola volta)
+static void initPools(void) {
+    if (slabInit(&filePool, "fileT", sizeof(fileT)) == -1 || slabInit(&nodePool, "nodeT", sizeof(nodeT)) == -1 ||
+        slabInit(&ghostPool, "ghostT", sizeof(ghostT)) == -1 || slabInit(&freqPool, "freqT", sizeof(freqT)) == -1 ||
+        slabInit(&chunkPool, "chunk", sizeof(chunkT)) == -1) {
+        return;
+    }
+
+    for (int i = 0; i < PATH_CLASSES; i++) {
+        snprintf(pathNames[i], sizeof(pathNames[i]), "path%d", PATH_CLASS * (i+1));
+
+        if (slabInit(&pathPools[i], pathNames[i], PATH_CLASS * (i+1)) == -1) {
+            return;
+        }
+    }
+
+    poolsReady = 1;
+}
+
+// si assicura che gli allocatori siano stati inizializzati
+static int usePools() {
+    pthread_once(&poolsOnce, initPools);
+
+    if (!poolsReady) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+// copia un path (troncato a 255 caratteri) nella classe di dimensione piu' piccola che lo contiene
+static char* pathDup(const char *filepath) {
+    size_t len = strnlen(filepath, PATH_CLASSES * PATH_CLASS - 1);
+    char *path = slabAlloc(&pathPools[len / PATH_CLASS]);
+
+    if (path) {
+        memcpy(path, filepath, len);
+        path[len] = '\0';
+    }
+
+    return path;
+}
+
+// libera un path allocato con pathDup
+static void pathFree(char *path) {
+    slabFree(&pathPools[strlen(path) / PATH_CLASS], path);
+}
+
+// rilascia un riferimento a una lista di chunk e, se era l'ultimo, la libera
+static void freeChunks(chunkT *c) {
+    if (c && atomic_fetch_sub(&c->refs, 1) > 1) {
+        return;
+    }
+
+    while (c) {
+        chunkT *next = c->next;
+        slabFree(&chunkPool, c);
+        c = next;
+    }
+}
+
+/**
+ * Aggiunge size bytes in fondo alla lista di chunk (*head, *tail): riempie l'ultimo chunk e alloca solo i chunk necessari 
+ * per il resto. I chunk vengono allocati prima di modificare la lista, quindi se la memoria non basta la lista resta invariata.
+ */
+static int appendChunks(chunkT **head, chunkT **tail, const void *content, size_t size) {
+    size_t room = *tail ? CHUNK_SIZE - (*tail)->len : 0;
+    chunkT *first = NULL, *last = NULL;
+
+    // alloco i nuovi chunk
+    for (size_t left = (size > room) ? size - room : 0; left > 0; left -= (left < CHUNK_SIZE) ? left : CHUNK_SIZE) {
+        chunkT *c = slabAlloc(&chunkPool);
+
+        if (!c) {
+            freeChunks(first);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        c->next = NULL;
+        c->len = 0;
+        atomic_init(&c->refs, 1);
+
+        if (last) {
+            last->next = c;
+        }
+
+        else {
+            first = c;
+        }
+
+        last = c;
+    }
+
+    // riempio l'ultimo chunk gia' presente...
+    size_t n = (size < room) ? size : room;
+
+    if (n > 0) {
+        memcpy((*tail)->data + (*tail)->len, content, n);
+        (*tail)->len += n;
+    }
+
+    // ...e poi quelli nuovi
+    for (chunkT *c = first; c; c = c->next) {
+        size_t len = (size - n < CHUNK_SIZE) ? size - n : CHUNK_SIZE;
+        memcpy(c->data, (const char*) content + n, len);
+        c->len = len;
+        n += len;
+    }
+
+    if (first) {
+        if (*tail) {
+            (*tail)->next = first;
+        }
+
+        else {
+            *head = first;
+        }
+
+        *tail = last;
+    }
+
+    return 0;
+}
+
+/**
+ * Scrive size bytes nel contenuto di f, dopo i primi used bytes del contenuto attuale (0 per sovrascriverlo, la vecchia 
+ * dimensione per un append). Il contenuto resta in f->inlineData finche' non supera INLINE_DATA bytes, altrimenti viene 
+ * spostato in una lista di chunk. Se la memoria non basta il contenuto resta invariato. Non aggiorna f->size.
+ */
+static int storeContent(fileT *f, size_t used, const void *content, size_t size) {
+    // il contenuto e' (e resta) abbastanza piccolo da stare nel fileT
+    if (used + size <= INLINE_DATA && (used == 0 || !f->head)) {
+        if (size > 0) {
+            memcpy(f->inlineData + used, content, size);
+        }
+
+        freeChunks(f->head);
+        f->head = NULL;
+        f->tail = NULL;
+
+        return 0;
+    }
+
+    // append su un contenuto gia' diviso in chunk: aggiungo solo quelli necessari
+    if (used > 0 && f->head) {
+        return appendChunks(&f->head, &f->tail, content, size);
+    }
+
+    // costruisco una nuova lista di chunk (con il contenuto inline da mantenere, se e' un append) e sostituisco la precedente
+    chunkT *head = NULL, *tail = NULL;
+
+    if ((used > 0 && appendChunks(&head, &tail, f->inlineData, used) == -1) || appendChunks(&head, &tail, content, size) == -1) {
+        freeChunks(head);
+        return -1;
+    }
+
+    freeChunks(f->head);
+    f->head = head;
+    f->tail = tail;
+
+    return 0;
+}
+
 // crea un nuovo fileT
 fileT* createFileT(char *filepath, int O_LOCK, int owner, int open) {
     // controllo la validità degli argomenti
@@ -17,156 +195,1403 @@ fileT* createFileT(char *filepath, int O_LOCK, int owner, int open) {
         return (fileT*) NULL;
     }
 
-    fileT *f;
+    fileT *f;
+
+    // alloco la memoria
+    if (usePools() == -1 || (f = (fileT*) slabAlloc(&filePool)) == NULL) {
+        perror("Calloc createFileT");
+        return (fileT*) NULL;
+    }
+
+    memset(f, 0, sizeof(fileT));
+
+    /**
+     * inizializzo la lock lettori/scrittori del contenuto dando la precedenza agli scrittori: con quella predefinita un 
+     * flusso continuo di letture di un file molto richiesto bloccherebbe le scritture su quel file senza limiti di tempo
+     */
+    pthread_rwlockattr_t attr;
+    int err = pthread_rwlockattr_init(&attr);
+
+    if (err == 0) {
+        err = pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        err = err ? err : pthread_rwlock_init(&f->rw, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+
+    if (err != 0) {
+        errno = err;
+        perror("pthread_rwlock_init f->rw");
+        slabFree(&filePool, f);
+        return (fileT*) NULL;
+    }
+
+    f->O_LOCK = O_LOCK;
+    f->owner = owner;
+    f->open = open;  
+    f->size = 0;
+    atomic_init(&f->refs, 1);
+    
+    // il contenuto e' vuoto, quindi inline
+    f->head = NULL;
+    f->tail = NULL;
+
+    // i path corti stanno nel fileT, gli altri occupano solo lo spazio necessario
+    if (strnlen(filepath, INLINE_PATH) < INLINE_PATH) {
+        strcpy(f->inlinePath, filepath);
+        f->filepath = f->inlinePath;
+    }
+
+    else if ((f->filepath = pathDup(filepath)) == NULL) {
+        perror("Malloc filepath");
+        destroyFile(f);
+        return (fileT*) NULL;
+    }
+
+    return f;
+}
+
+// scrive del contenuto (in append) su un fileT
+int writeFileT(fileT *f, void *content, size_t size) {
+    // controllo la validità degli argomenti
+    if (!f || (!content && size != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // scrittura in append
+    if (storeContent(f, f->size, content, size) == -1) {
+        perror("Malloc content");
+        return -1;
+    }
+
+    f->size += (size);
+
+    return 0;
+}
+
+// descrive una parte del contenuto di un fileT come array di buffer
+size_t contentIov(fileT *f, size_t offset, struct iovec *iov, int *iovcnt) {
+    int max = *iovcnt;
+    size_t bytes = 0;
+    *iovcnt = 0;
+
+    if (!f || !iov || offset >= f->size || max <= 0) {
+        return 0;
+    }
+
+    // contenuto inline
+    if (!f->head) {
+        iov[0].iov_base = f->inlineData + offset;
+        iov[0].iov_len = f->size - offset;
+        *iovcnt = 1;
+
+        return f->size - offset;
+    }
+
+    for (chunkT *c = f->head; c && *iovcnt < max; c = c->next) {
+        // salto i chunk che precedono offset
+        if (offset >= c->len) {
+            offset -= c->len;
+            continue;
+        }
+
+        iov[*iovcnt].iov_base = c->data + offset;
+        iov[*iovcnt].iov_len = c->len - offset;
+        bytes += c->len - offset;
+        (*iovcnt)++;
+        offset = 0;
+    }
+
+    return bytes;
+}
+
+// prende una copia del contenuto di un fileT, utilizzabile senza la lock del file
+void acquireContent(fileT *f, contentT *c) {
+    pthread_rwlock_rdlock(&f->rw);
+
+    c->head = f->head;
+    c->size = f->size;
+
+    // della lista di chunk prendo solo un riferimento, il contenuto inline (al piu' INLINE_DATA bytes) lo copio
+    if (c->head) {
+        atomic_fetch_add(&(c->head)->refs, 1);
+    }
+
+    else if (c->size > 0) {
+        memcpy(c->inlineData, f->inlineData, c->size);
+    }
+
+    pthread_rwlock_unlock(&f->rw);
+}
+
+/**
+ * descrive una parte di una copia del contenuto. Non legge la lunghezza dei chunk, che un append potrebbe modificare: 
+ * tutti i chunk tranne l'ultimo sono pieni, quindi la lunghezza di ognuno si ricava da size. Per lo stesso motivo non 
+ * segue il puntatore next dell'ultimo chunk della copia
+ */
+size_t contentCopyIov(contentT *c, size_t offset, struct iovec *iov, int *iovcnt) {
+    int max = *iovcnt;
+    size_t bytes = 0;
+    *iovcnt = 0;
+
+    if (!c || !iov || offset >= c->size || max <= 0) {
+        return 0;
+    }
+
+    // contenuto inline
+    if (!c->head) {
+        iov[0].iov_base = c->inlineData + offset;
+        iov[0].iov_len = c->size - offset;
+        *iovcnt = 1;
+
+        return c->size - offset;
+    }
+
+    chunkT *ch = c->head;
+    size_t pos = 0;
+
+    while (*iovcnt < max) {
+        size_t len = (c->size - pos < CHUNK_SIZE) ? c->size - pos : CHUNK_SIZE;
+
+        // salto i chunk che precedono offset
+        if (offset < pos + len) {
+            size_t skip = (offset > pos) ? offset - pos : 0;
+            iov[*iovcnt].iov_base = ch->data + skip;
+            iov[*iovcnt].iov_len = len - skip;
+            bytes += len - skip;
+            (*iovcnt)++;
+        }
+
+        pos += len;
+
+        if (pos >= c->size) {
+            break;
+        }
+
+        ch = ch->next;
+    }
+
+    return bytes;
+}
+
+// rilascia una copia del contenuto
+void releaseContent(contentT *c) {
+    if (c) {
+        freeChunks(c->head);
+        c->head = NULL;
+    }
+}
+
+// copia una parte del contenuto di un fileT in un buffer
+ssize_t readFileT(fileT *f, void *buf, size_t offset, size_t size) {
+    // controllo la validità degli argomenti
+    if (!f || (!buf && size != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t copied = 0;
+    struct iovec iov[16];
+
+    while (copied < size) {
+        int iovcnt = 16;
+
+        if (contentIov(f, offset + copied, iov, &iovcnt) == 0) {
+            break;
+        }
+
+        for (int i = 0; i < iovcnt && copied < size; i++) {
+            size_t n = (iov[i].iov_len < size - copied) ? iov[i].iov_len : size - copied;
+            memcpy((char*) buf + copied, iov[i].iov_base, n);
+            copied += n;
+        }
+    }
+
+    return copied;
+}
+
+// rilascia un riferimento a un fileT e, se era l'ultimo, ne libera la memoria
+void destroyFile(fileT *f) {
+    if (f) {
+        // se il file e' ancora in uso (ad esempio in prestito a un altro thread), mi limito a rilasciare il mio riferimento
+        if (atomic_fetch_sub(&f->refs, 1) > 1) {
+            return;
+        }
+
+        if (f->filepath && f->filepath != f->inlinePath) {
+            pathFree(f->filepath);
+        }
+
+        freeChunks(f->head);
+
+        pthread_rwlock_destroy(&f->rw);
+        slabFree(&filePool, f);
+    }
+}
+
+// funzione hash (FNV-1a) sul filepath
+static size_t hashPath(const char *filepath) {
+    size_t h = 14695981039346656037UL;
+
+    while (*filepath) {
+        h ^= (unsigned char) *filepath++;
+        h *= 1099511628211UL;
+    }
+
+    return h;
+}
+
+// restituisce lo shard che contiene (o conterra') il fileT identificato da filepath, e ne salva l'hash in *h
+static shardT* shardOf(queueT *queue, const char *filepath, size_t *h) {
+    *h = hashPath(filepath);
+
+    return &queue->shards[*h % queue->numShards];
+}
+
+// restituisce il bucket della tabella hash dello shard corrispondente all'hash h
+static nodeT** bucketOf(queueT *queue, shardT *shard, size_t h) {
+    return &shard->table[(h / queue->numShards) & (shard->tableSize - 1)];
+}
+
+// cerca nella tabella hash dello shard il nodo che contiene il fileT identificato da filepath. Va chiamata con la lock dello shard acquisita
+static nodeT* lookup(queueT *queue, shardT *shard, size_t h, const char *filepath) {
+    nodeT *temp = *bucketOf(queue, shard, h);
+
+    while (temp) {
+        if (strcmp(filepath, (temp->data)->filepath) == 0) {
+            return temp;
+        }
+
+        temp = temp->hnext;
+    }
+
+    return NULL;
+}
+
+// rimuove un nodo dalla tabella hash dello shard. Va chiamata con la lock dello shard acquisita
+static void indexRemove(queueT *queue, shardT *shard, nodeT *node) {
+    nodeT **temp = bucketOf(queue, shard, hashPath((node->data)->filepath));
+
+    while (*temp) {
+        if (*temp == node) {
+            *temp = node->hnext;
+            break;
+        }
+
+        temp = &(*temp)->hnext;
+    }
+
+    node->hnext = NULL;
+}
+
+// inserisce un nodo in fondo a una lista (posizione piu' recente)
+static void listAppend(listT *list, nodeT *node) {
+    node->next = NULL;
+    node->prev = list->tail;
+
+    if (list->tail) {
+        (list->tail)->next = node;
+    }
+
+    else {
+        list->head = node;
+    }
+
+    list->tail = node;
+    list->len++;
+}
+
+// inserisce un nodo in una lista subito prima di next (in fondo se next = NULL)
+static void listInsertBefore(listT *list, nodeT *next, nodeT *node) {
+    if (!next) {
+        listAppend(list, node);
+        return;
+    }
+
+    node->next = next;
+    node->prev = next->prev;
+
+    if (next->prev) {
+        (next->prev)->next = node;
+    }
+
+    else {
+        list->head = node;
+    }
+
+    next->prev = node;
+    list->len++;
+}
+
+// scollega un nodo da una lista
+static void listRemove(listT *list, nodeT *node) {
+    if (node->prev) {
+        (node->prev)->next = node->next;
+    }
+
+    else {
+        list->head = node->next;
+    }
+
+    if (node->next) {
+        (node->next)->prev = node->prev;
+    }
+
+    else {
+        list->tail = node->prev;
+    }
+
+    node->next = NULL;
+    node->prev = NULL;
+    list->len--;
+}
+
+// restituisce il bucket della tabella hash dei fantasmi dello shard corrispondente all'hash h
+static ghostT** ghostBucketOf(queueT *queue, shardT *shard, size_t h) {
+    return &shard->ghostTable[(h / queue->numShards) & (shard->tableSize - 1)];
+}
+
+// cerca un elemento fantasma a partire dall'hash del filepath, nelle liste della politica (history = 0) o nello storico (history = 1)
+static ghostT* ghostFind(queueT *queue, shardT *shard, size_t h, int history) {
+    ghostT *temp = *ghostBucketOf(queue, shard, h);
+
+    while (temp && (temp->h != h || (temp->list == 2) != history)) {
+        temp = temp->hnext;
+    }
+
+    return temp;
+}
+
+// rimuove un elemento fantasma dalla sua lista e dalla tabella hash, e ne libera la memoria
+static void ghostRemove(queueT *queue, shardT *shard, ghostT *g) {
+    ghostListT *list = &shard->ghosts[g->list];
+
+    if (g->prev) {
+        (g->prev)->next = g->next;
+    }
+
+    else {
+        list->head = g->next;
+    }
+
+    if (g->next) {
+        (g->next)->prev = g->prev;
+    }
+
+    else {
+        list->tail = g->prev;
+    }
+
+    list->len--;
+
+    ghostT **temp = ghostBucketOf(queue, shard, g->h);
+
+    while (*temp) {
+        if (*temp == g) {
+            *temp = g->hnext;
+            break;
+        }
+
+        temp = &(*temp)->hnext;
+    }
+
+    slabFree(&ghostPool, g);
+}
+
+// aggiunge un elemento fantasma in fondo alla lista indicata. Se la memoria non basta, il fantasma viene semplicemente perso
+static void ghostAdd(queueT *queue, shardT *shard, size_t h, size_t size, int list) {
+    ghostT *g = slabAlloc(&ghostPool);
+
+    if (!g) {
+        return;
+    }
+
+    g->h = h;
+    g->size = size;
+    g->list = list;
+    g->next = NULL;
+    g->prev = shard->ghosts[list].tail;
+
+    if (g->prev) {
+        (g->prev)->next = g;
+    }
+
+    else {
+        shard->ghosts[list].head = g;
+    }
+
+    shard->ghosts[list].tail = g;
+    shard->ghosts[list].len++;
+
+    ghostT **bucket = ghostBucketOf(queue, shard, h);
+    g->hnext = *bucket;
+    *bucket = g;
+}
+
+/**
+ * Interfaccia delle politiche di rimpiazzamento. Tutte le funzioni vengono chiamate con la lock dello shard acquisita e sono O(1)
+ * (ammortizzato per CLOCK, logaritmico per GDSF). Una scrittura (write = 1) conta solo come uso recente, non come riutilizzo:
+ * non incrementa le frequenze e non promuove i file appena inseriti (che vengono sempre scritti subito dopo la creazione).
+ * victim non estrae il nodo e non modifica lo shard, ma propone il candidato dello shard (diverso da skip, se non NULL) e ne salva
+ * in key la chiave di confronto: fra gli shard viene espulso il candidato con la chiave (lessicograficamente) minore.
+ * Le politiche senza una chiave confrontabile fra shard (CLOCK) forniscono invece sweep, che aggiorna lo stato dello shard per
+ * trovare il proprio candidato: gli shard vengono visitati a turno e sweep viene chiamata solo su quello dal quale si espelle.
+ */
+typedef struct {
+    const char *name;
+    int (*insert)(queueT *queue, shardT *shard, nodeT *node, size_t h);
+    void (*access)(queueT *queue, shardT *shard, nodeT *node, int write);
+    void (*remove)(queueT *queue, shardT *shard, nodeT *node, int evicted);
+    nodeT* (*victim)(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip);
+    nodeT* (*sweep)(queueT *queue, shardT *shard, nodeT *skip);
+} policyOpsT;
+
+// restituisce il primo nodo di una lista diverso da skip
+static nodeT* firstNot(nodeT *head, nodeT *skip) {
+    return (head && head == skip) ? head->next : head;
+}
+
+// FIFO: una sola lista in ordine di inserimento, gli accessi non la modificano
+static int fifoInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    listAppend(&shard->lists[0], node);
+    return 0;
+}
+
+static void fifoAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+}
+
+static void fifoRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    listRemove(&shard->lists[0], node);
+}
+
+static nodeT* fifoVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    nodeT *node = firstNot(shard->lists[0].head, skip);
+
+    if (node) {
+        key[0] = node->seq;
+        key[1] = 0;
+    }
+
+    return node;
+}
+
+// LRU: ogni accesso sposta il nodo in fondo alla lista
+static void lruAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    listRemove(&shard->lists[0], node);
+    listAppend(&shard->lists[0], node);
+}
+
+static nodeT* lruVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    nodeT *node = firstNot(shard->lists[0].head, skip);
+
+    if (node) {
+        key[0] = node->stamp;
+        key[1] = 0;
+    }
+
+    return node;
+}
+
+// CLOCK: lista circolare con lancetta, gli accessi impostano solo il bit di riferimento
+static int clockInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    // il nuovo nodo viene inserito subito prima della lancetta, quindi sara' l'ultimo a essere esaminato
+    node->ref = 0;
+    listInsertBefore(&shard->lists[0], shard->hand, node);
+    return 0;
+}
+
+static void clockAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    node->ref = 1;
+}
+
+static void clockRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    if (shard->hand == node) {
+        shard->hand = node->next;
+    }
+
+    listRemove(&shard->lists[0], node);
+}
+
+static nodeT* clockSweep(queueT *queue, shardT *shard, nodeT *skip) {
+    // se lo shard non ha candidati non lo modifico
+    if (!firstNot(shard->lists[0].head, skip) || (shard->lists[0].len == 1 && shard->lists[0].head == skip)) {
+        return NULL;
+    }
+
+    // avanzo la lancetta azzerando i bit di riferimento, finche' non trovo un nodo non referenziato (al piu' un giro completo)
+    for (;;) {
+        if (!shard->hand) {
+            shard->hand = shard->lists[0].head;
+        }
+
+        if (shard->hand != skip && !(shard->hand)->ref) {
+            break;
+        }
+
+        if (shard->hand != skip) {
+            (shard->hand)->ref = 0;
+        }
+
+        shard->hand = (shard->hand)->next;
+    }
+
+    return shard->hand;
+}
+
+// LFU: bucket di frequenza in ordine crescente, ognuno con i propri nodi in ordine LRU
+static freqT* freqCreate(shardT *shard, freqT *prev, unsigned long count) {
+    freqT *b = slabAlloc(&freqPool);
+
+    if (!b) {
+        return NULL;
+    }
+
+    b->count = count;
+    b->head = NULL;
+    b->tail = NULL;
+    b->prev = prev;
+    b->next = prev ? prev->next : shard->freqs;
+
+    if (b->next) {
+        (b->next)->prev = b;
+    }
+
+    if (prev) {
+        prev->next = b;
+    }
+
+    else {
+        shard->freqs = b;
+    }
+
+    return b;
+}
+
+// scollega un nodo dal suo bucket di frequenza, liberando il bucket se resta vuoto
+static void freqUnlink(shardT *shard, nodeT *node) {
+    freqT *b = node->bucket;
+
+    if (node->prev) {
+        (node->prev)->next = node->next;
+    }
+
+    else {
+        b->head = node->next;
+    }
+
+    if (node->next) {
+        (node->next)->prev = node->prev;
+    }
+
+    else {
+        b->tail = node->prev;
+    }
+
+    node->next = NULL;
+    node->prev = NULL;
+    node->bucket = NULL;
+
+    if (!b->head) {
+        if (b->prev) {
+            (b->prev)->next = b->next;
+        }
+
+        else {
+            shard->freqs = b->next;
+        }
+
+        if (b->next) {
+            (b->next)->prev = b->prev;
+        }
+
+        slabFree(&freqPool, b);
+    }
+}
+
+// inserisce un nodo in fondo a un bucket di frequenza
+static void freqAppend(freqT *b, nodeT *node) {
+    node->bucket = b;
+    node->next = NULL;
+    node->prev = b->tail;
+
+    if (b->tail) {
+        (b->tail)->next = node;
+    }
+
+    else {
+        b->head = node;
+    }
+
+    b->tail = node;
+}
+
+static int lfuInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    freqT *b = shard->freqs;
+
+    if (!b || b->count != 1) {
+        if ((b = freqCreate(shard, NULL, 1)) == NULL) {
+            return -1;
+        }
+    }
+
+    freqAppend(b, node);
+    return 0;
+}
+
+static void lfuAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    freqT *b = node->bucket;
+    freqT *next = b->next;
+
+    // una scrittura sposta il nodo in fondo al suo bucket, senza cambiarne la frequenza
+    if (write) {
+        next = b;
+    }
+
+    else if (!next || next->count != b->count + 1) {
+        // se non c'e' memoria per il nuovo bucket, l'accesso non viene contato
+        if ((next = freqCreate(shard, b, b->count + 1)) == NULL) {
+            return;
+        }
+    }
+
+    // se il nodo e' l'unico del bucket, il bucket verrebbe liberato da freqUnlink
+    if (next == b && b->head == node && b->tail == node) {
+        return;
+    }
+
+    freqUnlink(shard, node);
+    freqAppend(next, node);
+}
+
+static void lfuRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    freqUnlink(shard, node);
+}
+
+static nodeT* lfuVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    freqT *b = shard->freqs;
+
+    if (!b) {
+        return NULL;
+    }
+
+    nodeT *node = firstNot(b->head, skip);
+
+    // se skip era l'unico nodo del primo bucket, passo al successivo
+    if (!node) {
+        if ((b = b->next) == NULL) {
+            return NULL;
+        }
+
+        node = b->head;
+    }
+
+    key[0] = b->count;
+    key[1] = node->stamp;
+
+    return node;
+}
+
+/**
+ * Numero di file presenti nello shard, usato da 2Q e ARC come capacita' di riferimento: in questo modo le proporzioni
+ * delle liste restano corrette anche quando il limite effettivo della coda e' maxSize e non maxLen.
+ */
+static size_t residents(shardT *shard) {
+    size_t n = shard->lists[0].len + shard->lists[1].len;
+
+    return n ? n : 1;
+}
+
+// 2Q: A1in (lists[0]) e' una FIFO per i file nuovi, Am (lists[1]) una LRU per i file gia' visti, A1out (ghosts[0]) ricorda gli espulsi da A1in
+static int twoQInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    ghostT *g = ghostFind(queue, shard, h, 0);
+
+    // un file espulso di recente da A1in che viene reinserito e' considerato "caldo"
+    if (g) {
+        ghostRemove(queue, shard, g);
+        node->list = 1;
+    }
+
+    else {
+        node->list = 0;
+    }
+
+    listAppend(&shard->lists[node->list], node);
+    return 0;
+}
+
+static void twoQAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    if (node->list == 1) {
+        listRemove(&shard->lists[1], node);
+        listAppend(&shard->lists[1], node);
+    }
+}
+
+static void twoQRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    listRemove(&shard->lists[node->list], node);
+
+    if (evicted && node->list == 0) {
+        ghostAdd(queue, shard, hashPath((node->data)->filepath), (node->data)->size, 0);
+
+        // A1out ricorda al piu' la meta' dei file presenti nello shard
+        while (shard->ghosts[0].len > residents(shard) / 2 + 1) {
+            ghostRemove(queue, shard, shard->ghosts[0].head);
+        }
+    }
+}
+
+static nodeT* twoQVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    // A1in occupa al piu' un quarto dei file presenti nello shard
+    size_t kin = residents(shard) / 4 + 1;
+    nodeT *in = firstNot(shard->lists[0].head, skip);
+    nodeT *am = firstNot(shard->lists[1].head, skip);
+
+    if (in && (shard->lists[0].len > kin || !am)) {
+        key[0] = 0;
+        key[1] = in->stamp;
+        return in;
+    }
+
+    if (am) {
+        key[0] = 1;
+        key[1] = am->stamp;
+        return am;
+    }
+
+    return NULL;
+}
+
+// ARC: T1 (lists[0]) contiene i file visti una volta, T2 (lists[1]) quelli visti piu' volte, B1 e B2 (ghosts) i rispettivi espulsi
+static void arcTrimGhosts(queueT *queue, shardT *shard) {
+    size_t c = residents(shard);
+
+    while (shard->ghosts[0].len && shard->lists[0].len + shard->ghosts[0].len > c) {
+        ghostRemove(queue, shard, shard->ghosts[0].head);
+    }
+
+    // il totale di file e fantasmi non supera il doppio della capacita'
+    while (shard->lists[0].len + shard->lists[1].len + shard->ghosts[0].len + shard->ghosts[1].len > 2 * c) {
+        if (shard->ghosts[1].len) {
+            ghostRemove(queue, shard, shard->ghosts[1].head);
+        }
+
+        else if (shard->ghosts[0].len) {
+            ghostRemove(queue, shard, shard->ghosts[0].head);
+        }
+
+        else {
+            break;
+        }
+    }
+}
+
+static int arcInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    ghostT *g = ghostFind(queue, shard, h, 0);
+
+    if (g) {
+        size_t b1 = shard->ghosts[0].len;
+        size_t b2 = shard->ghosts[1].len;
+
+        // un fantasma in B1 indica che T1 e' troppo piccola, uno in B2 che lo e' T2: adatto l'obiettivo p
+        if (g->list == 0) {
+            size_t delta = (b2 > b1) ? b2 / b1 : 1;
+            shard->p = (shard->p + delta < residents(shard)) ? shard->p + delta : residents(shard);
+        }
+
+        else {
+            size_t delta = (b1 > b2) ? b1 / b2 : 1;
+            shard->p = (shard->p > delta) ? shard->p - delta : 0;
+        }
+
+        ghostRemove(queue, shard, g);
+        node->list = 1;
+    }
+
+    else {
+        node->list = 0;
+    }
+
+    listAppend(&shard->lists[node->list], node);
+    arcTrimGhosts(queue, shard);
+
+    return 0;
+}
+
+static void arcAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    listRemove(&shard->lists[node->list], node);
+
+    // solo le letture promuovono il nodo in T2, le scritture lo spostano in fondo alla sua lista
+    if (!write) {
+        node->list = 1;
+    }
+
+    listAppend(&shard->lists[node->list], node);
+}
+
+static void arcRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    listRemove(&shard->lists[node->list], node);
+
+    if (evicted) {
+        ghostAdd(queue, shard, hashPath((node->data)->filepath), (node->data)->size, node->list);
+        arcTrimGhosts(queue, shard);
+    }
+}
+
+static nodeT* arcVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    nodeT *t1 = firstNot(shard->lists[0].head, skip);
+    nodeT *t2 = firstNot(shard->lists[1].head, skip);
+    nodeT *node = (t1 && (shard->lists[0].len > shard->p || !t2)) ? t1 : t2;
+
+    if (node) {
+        key[0] = node->stamp;
+        key[1] = 0;
+    }
+
+    return node;
+}
+
+// GDSF: min-heap per shard ordinato per priorita' H = L + freq / size, dove L e' la priorita' dell'ultimo file espulso
+static double gdsfPriority(shardT *shard, nodeT *node) {
+    size_t size = (node->data)->size;
+
+    return shard->inflation + node->freq / (double) (size ? size : 1);
+}
+
+// scambia due nodi dello heap aggiornandone le posizioni
+static void heapSwap(shardT *shard, size_t i, size_t j) {
+    nodeT *temp = shard->heap[i];
+
+    shard->heap[i] = shard->heap[j];
+    shard->heap[j] = temp;
+    (shard->heap[i])->heapIdx = i;
+    (shard->heap[j])->heapIdx = j;
+}
+
+// riporta nella posizione corretta dello heap il nodo in posizione i
+static void heapFix(shardT *shard, size_t i) {
+    // verso l'alto...
+    while (i > 0 && (shard->heap[(i - 1) / 2])->priority > (shard->heap[i])->priority) {
+        heapSwap(shard, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    // ...e verso il basso
+    for (;;) {
+        size_t min = i;
+        size_t l = 2 * i + 1;
+        size_t r = 2 * i + 2;
 
-    // alloco la memoria
-    if ((f = (fileT*) calloc(1, sizeof(fileT))) == NULL) {
-        perror("Calloc createFileT");
-        return (fileT*) NULL;
+        if (l < shard->heapLen && (shard->heap[l])->priority < (shard->heap[min])->priority) {
+            min = l;
+        }
+
+        if (r < shard->heapLen && (shard->heap[r])->priority < (shard->heap[min])->priority) {
+            min = r;
+        }
+
+        if (min == i) {
+            break;
+        }
+
+        heapSwap(shard, i, min);
+        i = min;
     }
+}
 
-    f->O_LOCK = O_LOCK;
-    f->owner = owner;
-    f->open = open;  
-    f->size = 0;
-    
-    if ((f->filepath = malloc(sizeof(char)*256)) == NULL) {
-        perror("Malloc filepath");
-        destroyFile(f);
-        return (fileT*) NULL;
+static int gdsfInsert(queueT *queue, shardT *shard, nodeT *node, size_t h) {
+    if (shard->heapLen == shard->heapCap) {
+        size_t cap = shard->heapCap ? shard->heapCap * 2 : 16;
+        nodeT **heap = realloc(shard->heap, cap * sizeof(nodeT*));
+
+        if (!heap) {
+            return -1;
+        }
+
+        shard->heap = heap;
+        shard->heapCap = cap;
     }
 
-    strncpy(f->filepath, filepath, 256);
+    node->freq = 1;
+    node->priority = gdsfPriority(shard, node);
+    node->heapIdx = shard->heapLen;
+    shard->heap[shard->heapLen++] = node;
+    heapFix(shard, node->heapIdx);
 
-    if ((f->content = malloc(f->size+1)) == NULL) {
-        perror("Malloc content");
-        return (fileT*) NULL;
+    return 0;
+}
+
+static void gdsfAccess(queueT *queue, shardT *shard, nodeT *node, int write) {
+    // la priorita' viene ricalcolata anche dopo le scritture, che possono cambiare la dimensione del file
+    if (!write) {
+        node->freq++;
     }
 
-    return f;
+    node->priority = gdsfPriority(shard, node);
+    heapFix(shard, node->heapIdx);
 }
 
-// scrive del contenuto (in append) su un fileT
-int writeFileT(fileT *f, void *content, size_t size) {
-    // controllo la validità degli argomenti
-    if (!f || !content || size < 0) {
+static void gdsfRemove(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    size_t i = node->heapIdx;
+
+    if (evicted) {
+        shard->inflation = node->priority;
+    }
+
+    shard->heapLen--;
+
+    if (i != shard->heapLen) {
+        heapSwap(shard, i, shard->heapLen);
+        heapFix(shard, i);
+    }
+}
+
+static nodeT* gdsfVictim(queueT *queue, shardT *shard, unsigned long key[2], nodeT *skip) {
+    if (shard->heapLen == 0) {
+        return NULL;
+    }
+
+    nodeT *node = shard->heap[0];
+
+    // se la radice e' skip, il minimo fra gli altri nodi e' uno dei suoi figli
+    if (node == skip) {
+        node = NULL;
+
+        for (size_t i = 1; i <= 2 && i < shard->heapLen; i++) {
+            if (!node || (shard->heap[i])->priority < node->priority) {
+                node = shard->heap[i];
+            }
+        }
+
+        if (!node) {
+            return NULL;
+        }
+    }
+
+    // le priorita' sono double non negativi, quindi la loro rappresentazione binaria e' ordinata come i valori
+    memcpy(&key[0], &node->priority, sizeof(double));
+    key[1] = node->stamp;
+
+    return node;
+}
+
+// tabella delle politiche, indicizzata da policyT
+static const policyOpsT policies[] = {
+    [POLICY_FIFO] = {"FIFO", fifoInsert, fifoAccess, fifoRemove, fifoVictim, NULL},
+    [POLICY_LRU] = {"LRU", fifoInsert, lruAccess, fifoRemove, lruVictim, NULL},
+    [POLICY_CLOCK] = {"CLOCK", clockInsert, clockAccess, clockRemove, NULL, clockSweep},
+    [POLICY_LFU] = {"LFU", lfuInsert, lfuAccess, lfuRemove, lfuVictim, NULL},
+    [POLICY_2Q] = {"2Q", twoQInsert, twoQAccess, twoQRemove, twoQVictim, NULL},
+    [POLICY_ARC] = {"ARC", arcInsert, arcAccess, arcRemove, arcVictim, NULL},
+    [POLICY_GDSF] = {"GDSF", gdsfInsert, gdsfAccess, gdsfRemove, gdsfVictim, NULL}
+};
+
+#define NUM_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+// converte il nome di una politica nel valore corrispondente
+int parsePolicy(const char *name) {
+    if (!name) {
         errno = EINVAL;
         return -1;
     }
 
-    if (size != 0) {
-        if ((f->content = realloc(f->content, f->size + size)) == NULL) {
-            perror("Malloc content");
-            return -1;
-        } 
+    for (size_t i = 0; i < NUM_POLICIES; i++) {
+        if (strcasecmp(name, policies[i].name) == 0) {
+            return (int) i;
+        }
     }
 
-    // scrittura in append
-    memcpy((char*)f->content+f->size, content, size);
-    f->size += (size);
+    errno = EINVAL;
+    return -1;
+}
 
-    return 0;
+// restituisce il nome di una politica
+const char* policyName(policyT policy) {
+    if (policy < 0 || policy >= NUM_POLICIES) {
+        return NULL;
+    }
+
+    return policies[policy].name;
 }
 
-// distrugge un fileT e ne libera la memoria
-void destroyFile(fileT *f) {
-    if (f) {
-        if (f->filepath) {
-            free(f->filepath);
-        }
+// registra un accesso (in lettura o in scrittura) a un nodo. Va chiamata con la lock dello shard acquisita
+static void touch(queueT *queue, shardT *shard, nodeT *node, int write) {
+    node->stamp = atomic_fetch_add(&queue->seq, 1);
+    policies[queue->policy].access(queue, shard, node, write);
+}
+
+/**
+ * Scollega un nodo dallo shard (politica di rimpiazzamento e tabella hash), senza aggiornare lunghezza e dimensione della coda.
+ * evicted indica se il nodo viene espulso dalla politica (e quindi puo' essere ricordato nelle liste fantasma).
+ * Va chiamata con la lock dello shard acquisita.
+ */
+static void detachNode(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    policies[queue->policy].remove(queue, shard, node, evicted);
+
+    // ricordo le espulsioni recenti, per riconoscere i capacity miss nelle letture successive
+    if (evicted) {
+        ghostAdd(queue, shard, hashPath((node->data)->filepath), (node->data)->size, 2);
 
-        if (f->content) {
-            free(f->content);
+        while (shard->ghosts[2].len > shard->capacity) {
+            ghostRemove(queue, shard, shard->ghosts[2].head);
         }
+    }
+
+    indexRemove(queue, shard, node);
+}
+
+// scollega un nodo dallo shard e aggiorna lunghezza e dimensione della coda. Va chiamata con la lock dello shard acquisita
+static void unlinkNode(queueT *queue, shardT *shard, nodeT *node, int evicted) {
+    detachNode(queue, shard, node, evicted);
 
-        free(f);
+    pthread_mutex_lock(&queue->m);
+    queue->len--;
+    queue->size -= (node->data)->size;
+    assert(queue->len >= 0);
+    pthread_mutex_unlock(&queue->m);
+}
+
+// se il file con hash h e' stato espulso di recente, conta un capacity miss. Va chiamata con la lock dello shard acquisita
+static int countMiss(queueT *queue, shardT *shard, size_t h) {
+    ghostT *g = ghostFind(queue, shard, h, 1);
+
+    if (!g) {
+        return 0;
     }
+
+    atomic_fetch_add(&queue->misses, 1);
+    atomic_fetch_add(&queue->missBytes, g->size);
+
+    return 1;
 }
 
 // crea una coda di fileT
-queueT* createQueue(size_t maxLen, size_t maxSize) {
-    queueT *queue; 
+queueT* createQueue(size_t maxLen, size_t maxSize, size_t numShards, policyT policy) {
+    // controllo la validità degli argomenti
+    if (numShards < 1 || policy < 0 || policy >= NUM_POLICIES) {
+        errno = EINVAL;
+        return (queueT*) NULL;
+    }
+
+    queueT *queue;
 
     // alloco la memoria
-    if ((queue = (queueT*) calloc(1, sizeof(queueT))) == NULL) {
+    if (usePools() == -1 || (queue = (queueT*) calloc(1, sizeof(queueT))) == NULL) {
         perror("Calloc createQueue");
         return (queueT*) NULL;
     }
 
+    if ((queue->shards = (shardT*) calloc(numShards, sizeof(shardT))) == NULL) {
+        perror("Calloc shards");
+        free(queue);
+        return (queueT*) NULL;
+    }
+
     // inizializzo la lock
     if (pthread_mutex_init(&queue->m, NULL) != 0) {
         perror("pthread_mutex_init m");
-        destroyQueue(queue);
+        free(queue->shards);
+        free(queue);
         return (queueT*) NULL;
     }
 
-    queue->head = NULL;
-    queue->tail = NULL;
+    queue->numShards = numShards;
+    queue->policy = policy;
     queue->maxLen = maxLen;
     queue->len = 0;
     queue->maxSize = maxSize;
     queue->size = 0;
+    queue->reservedLen = 0;
+    queue->reservedSize = 0;
+    atomic_init(&queue->seq, 0);
+    atomic_init(&queue->nextShard, 0);
+    atomic_init(&queue->hits, 0);
+    atomic_init(&queue->misses, 0);
+    atomic_init(&queue->hitBytes, 0);
+    atomic_init(&queue->missBytes, 0);
+
+    // dimensiono la tabella hash di ogni shard in base al numero massimo di file (potenza di 2, limitata a 2^20 bucket)
+    size_t tableSize = 16;
+    while (tableSize < maxLen / numShards && tableSize < (1 << 20)) {
+        tableSize <<= 1;
+    }
+
+    // inizializzo gli shard
+    for (size_t i = 0; i < numShards; i++) {
+        shardT *shard = &queue->shards[i];
+
+        shard->tableSize = tableSize;
+        shard->capacity = (maxLen + numShards - 1) / numShards;
+
+        if ((shard->table = (nodeT**) calloc(tableSize, sizeof(nodeT*))) == NULL) {
+            perror("Calloc table");
+            destroyQueue(queue);
+            return (queueT*) NULL;
+        }
+
+        if ((shard->ghostTable = (ghostT**) calloc(tableSize, sizeof(ghostT*))) == NULL) {
+            perror("Calloc ghostTable");
+            free(shard->table);
+            shard->table = NULL;
+            destroyQueue(queue);
+            return (queueT*) NULL;
+        }
+
+        if (pthread_mutex_init(&shard->m, NULL) != 0) {
+            perror("pthread_mutex_init shard");
+            free(shard->table);
+            free(shard->ghostTable);
+            shard->table = NULL;
+            destroyQueue(queue);
+            return (queueT*) NULL;
+        }
+    }
 
     return queue;
 }
 
+// rilascia (al piu') len file e size bytes riservati da una prenotazione. Va chiamata con la lock della coda acquisita
+static void consumeReservation(queueT *queue, reservationT *res, size_t len, size_t size) {
+    if (res) {
+        len = (len < res->len) ? len : res->len;
+        size = (size < res->size) ? size : res->size;
+
+        queue->reservedLen -= len;
+        queue->reservedSize -= size;
+        res->len -= len;
+        res->size -= size;
+    }
+}
+
 // inserisce un fileT nella coda
-int enqueue(queueT *queue, fileT* data) {
+int enqueue(queueT *queue, fileT* data, reservationT *res) {
     // controllo la validità degli argomenti
     if (!queue || !data) {
         errno = EINVAL;
         return -1;
     }
 
+    nodeT *newNode = NULL;
+    if (usePools() == -1 || (newNode = slabAlloc(&nodePool)) == NULL) {
+        perror("malloc newNode");
+        return -1;
+    }
+
+    memset(newNode, 0, sizeof(nodeT));
+
+    size_t h;
+    shardT *shard = shardOf(queue, data->filepath, &h);
+
+    pthread_mutex_lock(&shard->m);
     pthread_mutex_lock(&queue->m);
 
+    // lo spazio riservato da altri non e' disponibile, quello riservato dal chiamante si'
+    size_t resLen = (res && res->len) ? 1 : 0;
+    size_t resSize = res ? res->size : 0;
+
     // se la coda è piena, errore
-    if (queue->len == queue->maxLen) {
+    if (queue->len + queue->reservedLen - resLen >= queue->maxLen) {
         errno = ENFILE;
         pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
+        slabFree(&nodePool, newNode);
         return -1;
     }
 
     // se non c'è abbastanza spazio, errore
-    if (queue->size + data->size > queue->maxSize) {
+    if (queue->size + queue->reservedSize - resSize + data->size > queue->maxSize) {
         errno = EFBIG;
         pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
+        slabFree(&nodePool, newNode);
         return -1;
     }
 
-    // altrimenti inserisco l'elemento alla fine della coda
-    nodeT *newNode = NULL;
-    if ((newNode = malloc(sizeof(nodeT))) == NULL) {
-        perror("malloc newNode");
+    queue->len++;
+    queue->size += data->size;
+
+    // l'inserimento consuma un file della prenotazione (e i bytes eventualmente gia' contenuti nel file)
+    consumeReservation(queue, res, 1, data->size);
+
+    pthread_mutex_unlock(&queue->m);
+
+    newNode->data = data;
+    newNode->seq = atomic_fetch_add(&queue->seq, 1);
+    newNode->stamp = newNode->seq;
+
+    // il file torna nella coda: non e' piu' un'espulsione recente
+    ghostT *old = ghostFind(queue, shard, h, 1);
+    if (old) {
+        ghostRemove(queue, shard, old);
+    }
+
+    // inserisco l'elemento secondo la politica di rimpiazzamento
+    if (policies[queue->policy].insert(queue, shard, newNode, h) == -1) {
+        perror("policy insert");
+
+        // la prenotazione e' gia' stata consumata: lo spazio torna semplicemente libero
+        pthread_mutex_lock(&queue->m);
+        queue->len--;
+        queue->size -= data->size;
         pthread_mutex_unlock(&queue->m);
+
+        pthread_mutex_unlock(&shard->m);
+        slabFree(&nodePool, newNode);
         return -1;
     }
 
-    newNode->data = data;
-    newNode->next = NULL;
-    nodeT *temp = queue->head;
+    nodeT **bucket = bucketOf(queue, shard, h);
+    newNode->hnext = *bucket;
+    *bucket = newNode;
 
-    // se è il primo elemento della coda
-    if (queue->head == NULL) {
-        queue->head = newNode;
+    pthread_mutex_unlock(&shard->m);
+    return 0;
+}
+
+// espelle i file necessari a liberare lo spazio richiesto e lo riserva
+int reserveSpace(queueT *queue, size_t size, size_t len, char *exclude, reservationT *res, fileT ***victims) {
+    // controllo la validità degli argomenti
+    if (!queue || !res || !victims) {
+        errno = EINVAL;
+        return -1;
     }
 
-    // se non è il primo elemento della coda
-    else {
-        while (temp->next) {
-            temp = temp->next;
+    const policyOpsT *ops = &policies[queue->policy];
+    fileT **list = NULL;
+    size_t n = 0, cap = 0;
+    nodeT *skip = NULL;
+
+    res->len = 0;
+    res->size = 0;
+    *victims = NULL;
+
+    // acquisisco le lock di tutti gli shard (sempre nello stesso ordine) e quella della coda: l'intero insieme di file da espellere
+    // viene scelto ed espulso senza che altri thread possano modificare la coda nel frattempo
+    for (size_t i = 0; i < queue->numShards; i++) {
+        pthread_mutex_lock(&queue->shards[i].m);
+    }
+
+    // il file che si sta per scrivere non deve essere espulso
+    if (exclude) {
+        size_t h;
+        shardT *shard = shardOf(queue, exclude, &h);
+        skip = lookup(queue, shard, h, exclude);
+    }
+
+    pthread_mutex_lock(&queue->m);
+
+    // controllo che la richiesta possa essere soddisfatta anche espellendo tutti gli altri file
+    if (size + queue->reservedSize + (skip ? (skip->data)->size : 0) > queue->maxSize) {
+        errno = EFBIG;
+        goto error;
+    }
+
+    if (len + queue->reservedLen + (skip ? 1 : 0) > queue->maxLen) {
+        errno = ENFILE;
+        goto error;
+    }
+
+    /**
+     * senza bytes da riservare si espelle solo per i posti: poiche' len + reservedLen non supera mai maxLen, per riservare
+     * un solo file (openFile) basta al piu' un'espulsione
+     */
+    while ((size > 0 && queue->size + queue->reservedSize + size > queue->maxSize) || queue->len + queue->reservedLen + len > queue->maxLen) {
+        shardT *victim = NULL;
+        nodeT *node = NULL;
+        unsigned long minKey[2] = {0, 0};
+        unsigned long key[2];
+
+        if (ops->sweep) {
+            // visito gli shard a turno a partire dal successivo a quello dell'ultima espulsione
+            size_t start = atomic_load(&queue->nextShard);
+
+            for (size_t i = 0; i < queue->numShards && !victim; i++) {
+                size_t j = (start + i) % queue->numShards;
+
+                if ((node = ops->sweep(queue, &queue->shards[j], skip)) != NULL) {
+                    victim = &queue->shards[j];
+                    atomic_store(&queue->nextShard, (j + 1) % queue->numShards);
+                }
+            }
+        }
+        else {
+            // scelgo il prossimo file da espellere fra i candidati di tutti gli shard
+            for (size_t i = 0; i < queue->numShards; i++) {
+                nodeT *temp = ops->victim(queue, &queue->shards[i], key, skip);
+
+                if (temp && (!victim || key[0] < minKey[0] || (key[0] == minKey[0] && key[1] < minKey[1]))) {
+                    victim = &queue->shards[i];
+                    node = temp;
+                    minKey[0] = key[0];
+                    minKey[1] = key[1];
+                }
+            }
+        }
+
+        // non dovrebbe mai accadere, poiche' si controlla prima che la richiesta possa essere soddisfatta
+        if (!victim) {
+            errno = ENOENT;
+            goto error;
+        }
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4;
+            fileT **temp = realloc(list, cap * sizeof(fileT*));
+
+            if (!temp) {
+                perror("realloc victims");
+                goto error;
+            }
+
+            list = temp;
         }
 
-        temp->next = newNode;
+        detachNode(queue, victim, node, 1);
+        queue->len--;
+        queue->size -= (node->data)->size;
+
+        list[n++] = node->data;
+        slabFree(&nodePool, node);
     }
 
-    queue->tail = newNode;
+    // riservo lo spazio liberato
+    queue->reservedLen += len;
+    queue->reservedSize += size;
+    res->len = len;
+    res->size = size;
 
-    queue->len++;
-    queue->size += data->size;
+    pthread_mutex_unlock(&queue->m);
+
+    for (size_t i = queue->numShards; i > 0; i--) {
+        pthread_mutex_unlock(&queue->shards[i-1].m);
+    }
+
+    *victims = list;
+    return (int) n;
 
+    error:
+        pthread_mutex_unlock(&queue->m);
+
+        for (size_t i = queue->numShards; i > 0; i--) {
+            pthread_mutex_unlock(&queue->shards[i-1].m);
+        }
+
+        // i file gia' espulsi non possono essere reinseriti, quindi vengono distrutti
+        for (size_t i = 0; i < n; i++) {
+            destroyFile(list[i]);
+        }
+
+        free(list);
+        return -1;
+}
+
+// annulla una prenotazione non ancora consumata
+void cancelReservation(queueT *queue, reservationT *res) {
+    if (!queue || !res) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue->m);
+    consumeReservation(queue, res, (size_t) -1, (size_t) -1);
     pthread_mutex_unlock(&queue->m);
-    return 0;
 }
 
 // estrae un fileT dalla coda e lo restituisce
@@ -177,70 +1602,107 @@ fileT* dequeue(queueT *queue) {
         return NULL;
     }
 
-    pthread_mutex_lock(&queue->m);
+    const policyOpsT *ops = &policies[queue->policy];
+
+    if (ops->sweep) {
+        // visito gli shard a turno, la lancetta avanza solo nel primo che ha un file da espellere
+        size_t start = atomic_load(&queue->nextShard);
 
-    // se la coda e' vuota, errore
-    if (queue->head == NULL || queue->len == 0) {
+        for (size_t i = 0; i < queue->numShards; i++) {
+            size_t j = (start + i) % queue->numShards;
+            shardT *shard = &queue->shards[j];
+
+            pthread_mutex_lock(&shard->m);
+
+            nodeT *node = ops->sweep(queue, shard, NULL);
+
+            if (node) {
+                fileT *data = node->data;
+
+                unlinkNode(queue, shard, node, 1);
+                atomic_store(&queue->nextShard, (j + 1) % queue->numShards);
+
+                pthread_mutex_unlock(&shard->m);
+
+                slabFree(&nodePool, node);
+                return data;
+            }
+
+            pthread_mutex_unlock(&shard->m);
+        }
+
+        // se la coda e' vuota, errore
         errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
         return NULL;
     }
 
-    fileT *data = (queue->head)->data;
+    for (;;) {
+        shardT *victim = NULL;
+        unsigned long victimSeq = 0;
+        unsigned long minKey[2] = {0, 0};
+        unsigned long key[2];
 
-    nodeT *temp = NULL;
-    temp = queue->head;
-    queue->head = (queue->head)->next;
+        // chiedo a ogni shard il proprio candidato e scelgo quello con la chiave minore
+        for (size_t i = 0; i < queue->numShards; i++) {
+            shardT *shard = &queue->shards[i];
 
-    if (queue->head == NULL) {
-        queue->tail = NULL;
-    }
-   
-    queue->len--;
-    queue->size -= data->size;
-    assert(queue->len >= 0);
+            pthread_mutex_lock(&shard->m);
 
-    free(temp);
+            nodeT *node = ops->victim(queue, shard, key, NULL);
 
-    pthread_mutex_unlock(&queue->m);
-    return data;
-}
+            if (node && (!victim || key[0] < minKey[0] || (key[0] == minKey[0] && key[1] < minKey[1]))) {
+                victim = shard;
+                victimSeq = node->seq;
+                minKey[0] = key[0];
+                minKey[1] = key[1];
+            }
 
-// estrae un fileT dalla coda, senza restituirlo
-void voiDequeue(queueT *queue) {
-    // controllo la validità dell'argomento
-    if (!queue) {
-        errno = EINVAL;
-        return;
-    }
+            pthread_mutex_unlock(&shard->m);
+        }
 
-    pthread_mutex_lock(&queue->m);
+        // se la coda e' vuota, errore
+        if (!victim) {
+            errno = ENOENT;
+            return NULL;
+        }
 
-    // se la coda e' vuota, errore
-    if (queue->head == NULL || queue->len == 0) {
-        errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
-        return;
-    }
+        pthread_mutex_lock(&victim->m);
 
-    nodeT *temp = NULL;
-    temp = queue->head;
+        // se nel frattempo il candidato dello shard e' cambiato, ripeto la ricerca
+        nodeT *temp = ops->victim(queue, victim, key, NULL);
 
-    queue->head = (queue->head)->next;
+        if (!temp || temp->seq != victimSeq) {
+            pthread_mutex_unlock(&victim->m);
+            continue;
+        }
+
+        fileT *data = temp->data;
+
+        unlinkNode(queue, victim, temp, 1);
+
+        pthread_mutex_unlock(&victim->m);
 
-    if (queue->head == NULL) {
-        queue->tail = NULL;
+        slabFree(&nodePool, temp);
+        return data;
     }
-   
-    queue->len--;
-    queue->size -= (temp->data)->size;
-    assert(queue->len >= 0);
+}
+
+// estrae un fileT dalla coda, senza restituirlo
+void voiDequeue(queueT *queue) {
+    fileT *data = dequeue(queue);
 
     // libero la memoria
-    destroyFile(temp->data);
-    free(temp);
+    if (data) {
+        destroyFile(data);
+    }
+}
 
-    pthread_mutex_unlock(&queue->m);
+// confronta due nodi in base all'ordine di inserimento (per qsort)
+static int compareSeq(const void *a, const void *b) {
+    unsigned long sa = (*(nodeT**) a)->seq;
+    unsigned long sb = (*(nodeT**) b)->seq;
+
+    return (sa > sb) - (sa < sb);
 }
 
 // stampa il contenuto della coda
@@ -251,20 +1713,50 @@ int printQueue(queueT *queue) {
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    // acquisisco le lock di tutti gli shard, sempre nello stesso ordine
+    for (size_t i = 0; i < queue->numShards; i++) {
+        pthread_mutex_lock(&queue->shards[i].m);
+    }
+
+    nodeT **temp = NULL;
+    size_t n = 0;
+
+    if ((temp = (nodeT**) calloc(getLen(queue) + 1, sizeof(nodeT*))) == NULL) {
+        perror("calloc printQueue");
+
+        for (size_t i = 0; i < queue->numShards; i++) {
+            pthread_mutex_unlock(&queue->shards[i].m);
+        }
+
+        return -1;
+    }
+
+    // raccolgo i nodi di tutti gli shard dalle tabelle hash, indipendentemente dalla politica
+    for (size_t i = 0; i < queue->numShards; i++) {
+        shardT *shard = &queue->shards[i];
+
+        for (size_t j = 0; j < shard->tableSize; j++) {
+            for (nodeT *node = shard->table[j]; node; node = node->hnext) {
+                temp[n++] = node;
+            }
+        }
+    }
 
     printf("Lista dei file contenuti nello storage al momento della chiusura del server:\n");
 
-    nodeT *temp = queue->head;
+    // stampo gli elementi in ordine di inserimento
+    qsort(temp, n, sizeof(nodeT*), compareSeq);
+
+    for (size_t i = 0; i < n; i++) {
+        double res = (temp[i]->data)->size/(double) 1000000;
+        printf("File: %s Dimensione %lf MB\n", (temp[i]->data)->filepath, res);
+    }
 
-    // scorro tutta la lista e stampo ogni elemento
-    while (temp) {
-        double res = (temp->data)->size/(double) 1000000;
-        printf("File: %s Dimensione %lf MB\n", (temp->data)->filepath, res);
-        temp = temp->next;
+    for (size_t i = 0; i < queue->numShards; i++) {
+        pthread_mutex_unlock(&queue->shards[i].m);
     }
 
-    pthread_mutex_unlock(&queue->m);
+    free(temp);
 
     return 0;
 }
@@ -277,45 +1769,32 @@ int lockFileInQueue(queueT *queue, char *filepath, int owner) {
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
+    pthread_mutex_lock(&shard->m);
+
+    // cerco l'elemento nella tabella hash dello shard
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
         errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
         return -1;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
-
-    // scorro tutta la coda
-    while (temp && !found) {
-        // se trovo l'elemento cercato...
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            found = 1;
-
-            // se il file e' stato messo in modalita' locked da un client diverso, errore
-            if ((temp->data)->O_LOCK && (temp->data)->owner != owner) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
-
-            // imposta flag e owner
-            (temp->data)->O_LOCK = 1;
-            (temp->data)->owner = owner;
-        }
-
-        temp = temp->next;
+    // se il file e' stato messo in modalita' locked da un client diverso, errore
+    if ((temp->data)->O_LOCK && (temp->data)->owner != owner) {
+        errno = EPERM;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
     }
 
-    pthread_mutex_unlock(&queue->m);
+    // imposta flag e owner
+    (temp->data)->O_LOCK = 1;
+    (temp->data)->owner = owner;
 
-    if (!found) {
-        errno = ENOENT;
-        return -1;
-    }
+    pthread_mutex_unlock(&shard->m);
 
     return 0;
 }
@@ -328,54 +1807,32 @@ int unlockFileInQueue(queueT *queue, char *filepath, int owner) {
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
+    pthread_mutex_lock(&shard->m);
+
+    // cerco l'elemento nella tabella hash dello shard
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
         errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
         return -1;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
-
-    // scorro tutta la coda
-    while (temp && !found) {
-        // se trovo l'elemento cercato...
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            found = 1;
-
-            // se il file non e' in modalita' locked, non serve fare nulla
-            if (!((temp->data)->O_LOCK)) {
-                (temp->data)->owner = owner;
-                pthread_mutex_unlock(&queue->m);
-                return 0;
-            }
-
-            // se il file e' stato messo in modalita' locked da un client diverso, errore
-            else if ((temp->data)->O_LOCK && (temp->data)->owner != owner) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
-
-            // altrimenti, resetta il flag
-            else {
-                (temp->data)->O_LOCK = 0;
-                (temp->data)->owner = owner;
-            }
-        }
-
-        temp = temp->next;
+    // se il file e' stato messo in modalita' locked da un client diverso, errore
+    if ((temp->data)->O_LOCK && (temp->data)->owner != owner) {
+        errno = EPERM;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
     }
 
-    pthread_mutex_unlock(&queue->m);
+    // altrimenti, resetta il flag (se il file non e' in modalita' locked, non cambia nulla)
+    (temp->data)->O_LOCK = 0;
+    (temp->data)->owner = owner;
 
-    if (!found) {
-        errno = ENOENT;
-        return -1;
-    }
+    pthread_mutex_unlock(&shard->m);
 
     return 0;
 }
@@ -388,49 +1845,36 @@ int openFileInQueue(queueT *queue, char *filepath, int O_LOCK, int client) {
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
+
+    pthread_mutex_lock(&shard->m);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
+    // cerco l'elemento nella tabella hash dello shard
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
         errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
         return -1;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
-
-    // scorro tutta la coda
-    while (temp && !found) {
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            // ho trovato il file che cercavo
-            found = 1;
-
-            // se il file e' stato messo in modalita' locked da un client diverso, errore
-            if ((temp->data)->O_LOCK && (temp->data)->owner != client) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
-
-            (temp->data)->open = 1;
-            (temp->data)->O_LOCK = O_LOCK;
-
-            if (O_LOCK) {
-                (temp->data)->owner = client;
-            }
-        }
-
-        temp = temp->next;
+    // se il file e' stato messo in modalita' locked da un client diverso, errore
+    if ((temp->data)->O_LOCK && (temp->data)->owner != client) {
+        errno = EPERM;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
     }
 
-    pthread_mutex_unlock(&queue->m);
+    (temp->data)->open = 1;
+    (temp->data)->O_LOCK = O_LOCK;
 
-    if (!found) {
-        errno = ENOENT;
-        return -1;
+    if (O_LOCK) {
+        (temp->data)->owner = client;
     }
 
+    pthread_mutex_unlock(&shard->m);
+
     return 0;
 }
 
@@ -442,309 +1886,456 @@ int closeFileInQueue(queueT *queue, char *filepath, int client) {
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
+    pthread_mutex_lock(&shard->m);
+
+    // cerco l'elemento nella tabella hash dello shard
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
         errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
+        pthread_mutex_unlock(&shard->m);
         return -1;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
+    // se il file e' stato messo in modalita' locked da un client diverso, errore
+    if ((temp->data)->O_LOCK && (temp->data)->owner != client) {
+        errno = EPERM;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
+    }
 
-    // scorro tutta la coda
-    while (temp && !found) {
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            // ho trovato il file che cercavo
-            found = 1;
-
-            // se il file e' stato messo in modalita' locked da un client diverso, errore
-            if ((temp->data)->O_LOCK && (temp->data)->owner != client) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
+    // chiudi il file e togli la modalita' locked
+    (temp->data)->open = 0;
+    (temp->data)->O_LOCK = 0;
+    (temp->data)->owner = client;
 
-            // chiudi il file e togli la modalita' locked
-            (temp->data)->open = 0;
-            (temp->data)->O_LOCK = 0;
-            (temp->data)->owner = client;
-        }
+    pthread_mutex_unlock(&shard->m);
 
-        temp = temp->next;
+    return 0;
+}
+
+/**
+ * Sovrascrive (append = 0) o scrive in append (append = 1) del contenuto su un fileT della coda. Se access = 1 la scrittura
+ * conta come accesso per la politica di rimpiazzamento.
+ * I controlli e l'aggiornamento della dimensione della coda avvengono con le lock dello shard e della coda, 
+ * mentre la copia del contenuto avviene tenendo solo la lock del file in scrittura, in modo da non bloccare le altre operazioni sulla coda.
+ */
+static int updateContent(queueT *queue, char *filepath, void *content, size_t size, int client, int append, int access, reservationT *res) {
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
+
+    pthread_mutex_lock(&shard->m);
+
+    // cerco l'elemento nella tabella hash dello shard e lo prendo in prestito
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
+        errno = ENOENT;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
+    }
+
+    fileT *f = temp->data;
+    atomic_fetch_add(&f->refs, 1);
+
+    pthread_mutex_unlock(&shard->m);
+
+    pthread_rwlock_wrlock(&f->rw);
+    pthread_mutex_lock(&shard->m);
+
+    // il file potrebbe essere stato espulso o rimosso mentre aspettavo la lock
+    temp = lookup(queue, shard, h, filepath);
+
+    if (!temp || temp->data != f) {
+        errno = ENOENT;
+        goto error;
+    }
+
+    // controllo se il client ha i permessi per scrivere sul file
+    if (f->open == 0 || (f->O_LOCK && f->owner != client)) {
+        errno = EPERM;
+        goto error;
+    }
+
+    size_t oldSize = f->size;
+    size_t newSize = append ? oldSize + size : size;
+
+    pthread_mutex_lock(&queue->m);
+
+    // se non c'e' abbastanza spazio nella coda (contando anche lo spazio riservato dal chiamante), errore
+    if (queue->size + queue->reservedSize - (res ? res->size : 0) - oldSize + newSize > queue->maxSize) {
+        errno = EFBIG;
+        pthread_mutex_unlock(&queue->m);
+        goto error;
     }
 
+    /**
+     * aggiorno la dimensione della coda e del file, consumando dalla prenotazione solo i bytes di cui il file cresce: 
+     * un contenuto ricevuto a blocchi puo' essere scritto con piu' chiamate che usano la stessa prenotazione
+     */
+    queue->size = queue->size - oldSize + newSize;
+    f->size = newSize;
+    consumeReservation(queue, res, 0, (newSize > oldSize) ? newSize - oldSize : 0);
+
     pthread_mutex_unlock(&queue->m);
 
-    if (!found) {
+    // la scrittura conta come accesso per la politica di rimpiazzamento
+    if (access) {
+        touch(queue, shard, temp, 1);
+    }
+
+    pthread_mutex_unlock(&shard->m);
+
+    /**
+     * i contenuti piccoli restano nel fileT; per gli altri, in append riempio l'ultimo chunk e aggiungo solo quelli necessari
+     * (il contenuto precedente non viene copiato), altrimenti costruisco una nuova lista di chunk e libero la precedente 
+     * solo se la scrittura e' andata a buon fine
+     */
+    if (storeContent(f, append ? oldSize : 0, content, size) == -1) {
+        perror("Malloc content");
+
+        // ripristino la dimensione precedente
+        pthread_mutex_lock(&shard->m);
+        temp = lookup(queue, shard, h, filepath);
+        if (temp && temp->data == f) {
+            pthread_mutex_lock(&queue->m);
+            queue->size = queue->size - newSize + oldSize;
+            pthread_mutex_unlock(&queue->m);
+        }
+        f->size = oldSize;
+        pthread_mutex_unlock(&shard->m);
+
+        pthread_rwlock_unlock(&f->rw);
+        releaseFile(f);
         return -1;
     }
 
+    pthread_rwlock_unlock(&f->rw);
+    releaseFile(f);
+
     return 0;
+
+    error:
+        pthread_mutex_unlock(&shard->m);
+        pthread_rwlock_unlock(&f->rw);
+        releaseFile(f);
+        return -1;
 }
 
 // scrive del contenuto su un fileT all'interno della coda
-int writeFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client) {
+int writeFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res) {
     // controllo la validità degli argomenti
     if (!queue || !filepath || !content) {
         errno = EINVAL;
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    return updateContent(queue, filepath, content, size, client, 0, 1, res);
+}
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
-        errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
+// scrive del contenuto in append su un fileT all'interno della coda
+int appendFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res) {
+    // controllo la validità degli argomenti
+    if (!queue || !filepath || !content) {
+        errno = EINVAL;
         return -1;
     }
 
-    // se non c'e' abbastanza spazio nella coda, errore
-    if (queue->size + size > queue->maxSize) {
-        errno = EFBIG;
-        pthread_mutex_unlock(&queue->m);
+    return updateContent(queue, filepath, content, size, client, 1, 1, res);
+}
+
+// scrive in append un ulteriore blocco di un contenuto ricevuto a blocchi
+int appendBlockInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res) {
+    // controllo la validità degli argomenti
+    if (!queue || !filepath || !content) {
+        errno = EINVAL;
         return -1;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
+    return updateContent(queue, filepath, content, size, client, 1, 0, res);
+}
 
-    // scorro tutta la coda
-    while (temp && !found) {
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            // ho trovato il file che cercavo
-            found = 1;
-
-            // controllo se il client ha i permessi per scrivere sul file
-            if ((temp->data)->open == 0 || ((temp->data)->O_LOCK && (temp->data)->owner != client)) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
+// rimuove un fileT dalla coda
+int removeFileFromQueue(queueT *queue, char *filepath, int client) {
+    // controllo la validità degli argomenti
+    if (!queue || !filepath) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            if (size != 0) {
-                // allora la memoria
-                if (((temp->data)->content = realloc((temp->data)->content, (temp->data)->size + size)) == NULL) {
-                    perror("Malloc content");
-                    pthread_mutex_unlock(&queue->m);
-                    return -1;
-                } 
-            }
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-            // sovrascrivo il file
-            memcpy((temp->data)->content, content, size);
+    pthread_mutex_lock(&shard->m);
 
-            // aggiorno la dimensione della coda e del file
-            queue->size = (queue->size) - ((temp->data)->size) + size;
-            (temp->data)->size = size;
-        }
+    // cerco l'elemento nella tabella hash dello shard
+    nodeT *temp = lookup(queue, shard, h, filepath);
 
-        temp = temp->next;
+    if (!temp) {
+        errno = ENOENT;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
     }
 
-    pthread_mutex_unlock(&queue->m);
-
-    if (!found) {
+    // se il file non e' in modalita' locked, oppure e' stato messo in modalita' locked da un client diverso, errore
+    if (!(temp->data)->O_LOCK || ((temp->data)->O_LOCK && (temp->data)->owner != client)) {
+        errno = EPERM;
+        pthread_mutex_unlock(&shard->m);
         return -1;
     }
 
+    // scollego il nodo dallo shard e dalla tabella hash
+    unlinkNode(queue, shard, temp, 0);
+
+    pthread_mutex_unlock(&shard->m);
+
+    // libero la memoria
+    destroyFile(temp->data);
+    slabFree(&nodePool, temp);
+
     return 0;
 }
 
-// scrive del contenuto in append su un fileT all'interno della coda
-int appendFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client) {
+// cerca un fileT all'interno della coda e ne restituisce una copia se trovato
+fileT* find(queueT *queue, char *filepath) {
     // controllo la validità degli argomenti
-    if (!queue || !filepath || !content) {
+    if (!queue || !filepath) {
         errno = EINVAL;
-        return -1;
+        return NULL;
     }
 
-    pthread_mutex_lock(&queue->m);
+    // prendo in prestito il file, in modo da copiarne il contenuto senza tenere la lock dello shard
+    fileT *f = acquireFile(queue, filepath);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
-        errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
-        return -1;
+    if (!f) {
+        return NULL;
     }
 
-    // se non c'e' abbastanza spazio nella coda, errore
-    if (queue->size + size > queue->maxSize) {
-        errno = EFBIG;
-        pthread_mutex_unlock(&queue->m);
-        return -1;
+    fileT *res = NULL;
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
+
+    pthread_mutex_lock(&shard->m);
+    res = createFileT(f->filepath, f->O_LOCK, f->owner, f->open);
+    pthread_mutex_unlock(&shard->m);
+
+    if (!res) {
+        perror("createFileT res");
+        releaseFile(f);
+        return NULL;
     }
 
-    int found = 0;
-    nodeT *temp = queue->head;
+    pthread_rwlock_rdlock(&f->rw);
 
-    // scorro tutta la coda
-    while (temp && !found) {
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            // ho trovato il file che cercavo
-            found = 1;
-
-            // controllo se il client ha i permessi per scrivere sul file
-            if ((temp->data)->open == 0 || ((temp->data)->O_LOCK && (temp->data)->owner != client)) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
+    struct iovec iov[16];
+    size_t copied = 0;
 
-            if (size != 0) {
-                // allora la memoria
-                if (((temp->data)->content = realloc((temp->data)->content, (temp->data)->size + size)) == NULL) {
-                    perror("Malloc content");
-                    pthread_mutex_unlock(&queue->m);
-                    return -1;
-                } 
-            }
+    while (res && copied < f->size) {
+        int iovcnt = 16;
+        copied += contentIov(f, copied, iov, &iovcnt);
 
-            // scrittura in append
-            memcpy(((char*)(temp->data)->content) + (temp->data)->size, content, size);
-            (temp->data)->size += size;
-            queue->size += size;
+        for (int i = 0; i < iovcnt; i++) {
+            if (writeFileT(res, iov[i].iov_base, iov[i].iov_len) == -1) {
+                perror("writeFileT res");
+                destroyFile(res);
+                res = NULL;
+                break;
+            }
         }
+    }
 
-        temp = temp->next;
+    pthread_rwlock_unlock(&f->rw);
+    releaseFile(f);
+
+    return res;
+}
+
+// prende in prestito un fileT contenuto nella coda, senza copiarlo
+fileT* acquireFile(queueT *queue, char *filepath) {
+    // controllo la validità degli argomenti
+    if (!queue || !filepath) {
+        errno = EINVAL;
+        return NULL;
     }
 
-    pthread_mutex_unlock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    if (!found) {
-        return -1;
+    pthread_mutex_lock(&shard->m);
+
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
+        countMiss(queue, shard, h);
+        errno = ENOENT;
+        pthread_mutex_unlock(&shard->m);
+        return NULL;
     }
 
-    return 0;
+    fileT *f = temp->data;
+    atomic_fetch_add(&f->refs, 1);
+
+    atomic_fetch_add(&queue->hits, 1);
+    atomic_fetch_add(&queue->hitBytes, f->size);
+
+    // la lettura conta come accesso per la politica di rimpiazzamento
+    touch(queue, shard, temp, 0);
+
+    pthread_mutex_unlock(&shard->m);
+
+    return f;
 }
 
-// rimuove un fileT dalla coda
-int removeFileFromQueue(queueT *queue, char *filepath, int client) {
+// registra una richiesta per un file non presente nella coda
+int recordMiss(queueT *queue, char *filepath) {
     // controllo la validità degli argomenti
     if (!queue || !filepath) {
         errno = EINVAL;
         return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    // se la coda e' vuota, errore
-    if (queue->len == 0) {
-        errno = ENOENT;
-        pthread_mutex_unlock(&queue->m);
-        return -1;
-    }
+    pthread_mutex_lock(&shard->m);
 
-    int found = 0;
-    nodeT *temp = queue->head;
-    nodeT *prec = queue->head;
+    int res = (lookup(queue, shard, h, filepath) == NULL) ? countMiss(queue, shard, h) : 0;
 
-    // scorro tutta la coda
-    while (temp && !found) {
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            // ho trovato il file che cercavo
-            found = 1;
-
-            // se il file non e' in modalita' locked, oppure e' stato messo in modalita' locked da un client diverso, errore
-            if (!(temp->data)->O_LOCK || ((temp->data)->O_LOCK && (temp->data)->owner != client)) {
-                errno = EPERM;
-                pthread_mutex_unlock(&queue->m);
-                return -1;
-            }
+    pthread_mutex_unlock(&shard->m);
 
-            // se il file da rimuovere e' il primo elemento della coda
-            if (temp == prec) {
-                queue->head = temp->next;
+    return res;
+}
 
-                if (!temp->next) {
-                    queue->tail = temp;
-                }
-            }
+// prende in prestito fino a n fileT della coda
+int acquireFiles(queueT *queue, fileT **files, size_t n) {
+    // controllo la validità degli argomenti
+    if (!queue || (!files && n > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            else {
-                prec->next = temp->next;
+    size_t count = 0;
 
-                if (!prec->next) {
-                    queue->tail = prec;
-                }
-            }
+    // scorro le tabelle hash degli shard, uno alla volta, senza modificare l'ordine di rimpiazzamento
+    for (size_t i = 0; i < queue->numShards && count < n; i++) {
+        shardT *shard = &queue->shards[i];
 
-            queue->len--;
-            queue->size -= (temp->data)->size;
-            assert(queue->len >= 0);
-            
-            // libero la memoria
-            destroyFile(temp->data);
-            free(temp);
+        pthread_mutex_lock(&shard->m);
 
-            break;
+        for (size_t j = 0; j < shard->tableSize && count < n; j++) {
+            for (nodeT *node = shard->table[j]; node && count < n; node = node->hnext) {
+                atomic_fetch_add(&(node->data)->refs, 1);
+                files[count++] = node->data;
+            }
         }
 
-        if (prec != temp) {
-             prec = prec->next;
-        }
-        temp = temp->next;
+        pthread_mutex_unlock(&shard->m);
     }
 
-    pthread_mutex_unlock(&queue->m);
+    return (int) count;
+}
 
-    if (!found) {
+// termina il prestito di un fileT
+void releaseFile(fileT *f) {
+    destroyFile(f);
+}
+
+// controlla se un fileT e' presente nella coda
+int exists(queueT *queue, char *filepath) {
+    // controllo la validità degli argomenti
+    if (!queue || !filepath) {
+        errno = EINVAL;
         return -1;
     }
 
-    return 0;
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
+
+    pthread_mutex_lock(&shard->m);
+
+    int found = (lookup(queue, shard, h, filepath) != NULL);
+
+    pthread_mutex_unlock(&shard->m);
+
+    return found;
 }
 
-// cerca un fileT all'interno della coda e ne restituisce una copia se trovato
-fileT* find(queueT *queue, char *filepath) {
+// copia i metadati di un fileT contenuto nella coda
+int statFile(queueT *queue, char *filepath, fileT *info) {
     // controllo la validità degli argomenti
-    if (!queue || !filepath) {
+    if (!queue || !filepath || !info) {
         errno = EINVAL;
-        return NULL;
+        return -1;
     }
 
-    pthread_mutex_lock(&queue->m);
+    size_t h;
+    shardT *shard = shardOf(queue, filepath, &h);
 
-    if (queue->len == 0) {
-        pthread_mutex_unlock(&queue->m);
-        return NULL;
+    pthread_mutex_lock(&shard->m);
+
+    nodeT *temp = lookup(queue, shard, h, filepath);
+
+    if (!temp) {
+        errno = ENOENT;
+        pthread_mutex_unlock(&shard->m);
+        return -1;
     }
 
-    fileT *res = NULL;
-    int found = 0;
-    nodeT *temp = queue->head;
+    info->filepath = NULL;
+    info->head = NULL;
+    info->tail = NULL;
+    info->O_LOCK = (temp->data)->O_LOCK;
+    info->owner = (temp->data)->owner;
+    info->open = (temp->data)->open;
+    info->size = (temp->data)->size;
 
-    // scorro tutta la coda
-    while (temp && !found) {
-        // se trovo l'elemento cercato...
-        if (strcmp(filepath, (temp->data)->filepath) == 0) {
-            found = 1;
+    pthread_mutex_unlock(&shard->m);
 
-            // ...ne creo una copia e la restituisco
-            res = createFileT((temp->data)->filepath, (temp->data)->O_LOCK, (temp->data)->owner, (temp->data)->open);
+    return 0;
+}
 
-            if (!res) {
-                perror("createFileT res");
-                pthread_mutex_unlock(&queue->m);
-                return NULL;
-            }
+// copia le statistiche sulle letture
+int getStats(queueT *queue, statsT *stats) {
+    // controllo la validità degli argomenti
+    if (!queue || !stats) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            if (writeFileT(res, (temp->data)->content, (temp->data)->size) == -1) {
-                perror("writeFileT res");
-                pthread_mutex_unlock(&queue->m);
-                return NULL;
-            }
-        }
+    stats->hits = atomic_load(&queue->hits);
+    stats->misses = atomic_load(&queue->misses);
+    stats->hitBytes = atomic_load(&queue->hitBytes);
+    stats->missBytes = atomic_load(&queue->missBytes);
+
+    return 0;
+}
 
-        temp = temp->next;
+// copia le statistiche degli allocatori dei metadati
+int getAllocStats(slabStatsT *stats) {
+    // controllo la validità dell'argomento
+    if (!stats) {
+        errno = EINVAL;
+        return -1;
     }
 
-    pthread_mutex_unlock(&queue->m);
+    if (usePools() == -1) {
+        return -1;
+    }
 
-    return res;
+    slabStats(&filePool, &stats[0]);
+    slabStats(&nodePool, &stats[1]);
+    slabStats(&ghostPool, &stats[2]);
+    slabStats(&freqPool, &stats[3]);
+    slabStats(&chunkPool, &stats[4]);
+
+    for (int i = 0; i < PATH_CLASSES; i++) {
+        slabStats(&pathPools[i], &stats[5 + i]);
+    }
+
+    return ALLOC_POOLS;
 }
 
 // restituisce la lunghezza attuale della coda
@@ -793,6 +2384,29 @@ void destroyQueue(queueT *queue) {
             }
         }
 
+        // libero le tabelle hash e le lock degli shard
+        if (queue->shards) {
+            for (size_t i = 0; i < queue->numShards; i++) {
+                shardT *shard = &queue->shards[i];
+
+                if (shard->table) {
+                    // libero gli elementi fantasma rimasti
+                    for (int j = 0; j < 3; j++) {
+                        while (shard->ghosts[j].head) {
+                            ghostRemove(queue, shard, shard->ghosts[j].head);
+                        }
+                    }
+
+                    free(shard->table);
+                    free(shard->ghostTable);
+                    free(shard->heap);
+                    pthread_mutex_destroy(&shard->m);
+                }
+            }
+
+            free(queue->shards);
+        }
+
         if (&queue->m) {
             pthread_mutex_destroy(&queue->m);
         }
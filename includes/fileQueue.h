@@ -1,30 +1,170 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <slab.h>
+
+#define PATH_CLASS 16                       // granularita' (in bytes) delle classi di dimensione dei path
+#define PATH_CLASSES (256 / PATH_CLASS)     // numero di classi di dimensione dei path (lunghi al piu' 255 caratteri)
+#define ALLOC_POOLS (5 + PATH_CLASSES)      // numero di allocatori (fileT, nodeT, ghostT, freqT, chunk del contenuto e path)
+#define CHUNK_SIZE 4096                     // bytes di contenuto in ogni chunk
+#define INLINE_PATH 64                      // i path (terminatore compreso) lunghi fino a INLINE_PATH bytes sono memorizzati nel fileT
+#define INLINE_DATA 256                     // i contenuti lunghi fino a INLINE_DATA bytes sono memorizzati nel fileT, senza chunk
+
+// porzione del contenuto di un file
+typedef struct chunk {
+    struct chunk *next; // chunk successivo
+    size_t len;         // bytes usati (CHUNK_SIZE per tutti i chunk tranne l'ultimo)
+    atomic_int refs;    // nel primo chunk: riferimenti alla lista (il fileT piu' le copie del contenuto in uso, vedi contentT)
+    char data[CHUNK_SIZE];
+} chunkT;
+
 // struttura dati per gestire i file in memoria principale
 typedef struct {
-    char *filepath;     // path assoluto del file
+    char *filepath;     // path assoluto del file (punta a inlinePath se il path e' corto)
     int O_LOCK;         // se = 1, il file e' in modalita' locked
     int owner;          // se O_LOCK = 1, contiene il file descriptor del client che possiede la lock sul file
     int open;           // se = 1, indica che il file e' stato aperto
-    void *content;      // contenuto del file
+    chunkT *head;       // contenuto del file, come lista di chunk (NULL se il contenuto e' in inlineData)
+    chunkT *tail;       // ultimo chunk del contenuto: le scritture in append riempiono questo chunk e ne aggiungono altri
     size_t size;        // dimensione del file in bytes
+    atomic_int refs;    // numero di riferimenti al fileT (la coda, oppure chi l'ha estratto, piu' i prestiti attivi)
+    char inlinePath[INLINE_PATH];   // path corto, vicino ai campi letti durante la ricerca
+    pthread_rwlock_t rw; // lock lettori/scrittori sul contenuto: piu' letture in parallelo, scritture in mutua esclusione (con precedenza)
+    char inlineData[INLINE_DATA];   // contenuto dei file piccoli: viene spostato in una lista di chunk quando supera INLINE_DATA bytes
 } fileT;
 
+/**
+ * Copia del contenuto di un fileT, presa con acquireContent e usabile senza la lock del file: i contenuti piccoli vengono
+ * copiati, mentre della lista di chunk si prende un riferimento. Una scrittura che sostituisce il contenuto crea una nuova
+ * lista (la precedente viene liberata al rilascio dell'ultimo riferimento), un append scrive solo oltre size.
+ */
+typedef struct {
+    chunkT *head;       // lista di chunk del contenuto (NULL se il contenuto e' in inlineData)
+    size_t size;        // dimensione del contenuto al momento della copia
+    char inlineData[INLINE_DATA];   // contenuto, se piccolo
+} contentT;
+
+// politiche di rimpiazzamento supportate dalla coda
+typedef enum {
+    POLICY_FIFO,        // espelle il file inserito per primo
+    POLICY_LRU,         // espelle il file usato meno di recente
+    POLICY_CLOCK,       // approssimazione di LRU con bit di riferimento e lancetta (second chance)
+    POLICY_LFU,         // espelle il file usato meno frequentemente (a parita', quello usato meno di recente)
+    POLICY_2Q,          // 2Q: coda FIFO per i file nuovi, LRU per quelli riutilizzati, lista fantasma per i file espulsi
+    POLICY_ARC,         // Adaptive Replacement Cache: bilancia recency e frequency in base alle liste fantasma
+    POLICY_GDSF         // GreedyDual-Size-Frequency: espelle il file con il minor valore (frequenza / dimensione) per byte liberato
+} policyT;
+
+struct freq;
+
 // nodo di una linked list
 typedef struct node {
     fileT *data;        
-    struct node *next;  // puntatore al prossimo elemento della lista
+    struct node *next;  // puntatore al prossimo elemento della lista della politica di rimpiazzamento
+    struct node *prev;  // puntatore all'elemento precedente della lista della politica di rimpiazzamento
+    struct node *hnext; // puntatore al prossimo elemento nello stesso bucket della tabella hash
+    unsigned long seq;  // numero di sequenza globale assegnato all'inserimento (identifica il nodo)
+    unsigned long stamp;    // numero di sequenza globale dell'ultimo accesso
+    int list;           // lista dello shard che contiene il nodo (2Q: A1in o Am, ARC: T1 o T2)
+    int ref;            // bit di riferimento (CLOCK)
+    struct freq *bucket;    // bucket di frequenza che contiene il nodo (LFU)
+    unsigned long freq; // numero di accessi (GDSF)
+    double priority;    // priorita' H = L + freq / size (GDSF)
+    size_t heapIdx;     // posizione del nodo nello heap dello shard (GDSF)
 } nodeT;
 
-// coda FIFO di fileT, implementata come una linked list
+// bucket di frequenza (LFU): lista dei nodi con lo stesso numero di accessi
+typedef struct freq {
+    unsigned long count;    // numero di accessi dei nodi nel bucket
+    nodeT *head;        // nodo usato meno di recente
+    nodeT *tail;        // nodo usato piu' di recente
+    struct freq *prev;  // bucket con frequenza minore
+    struct freq *next;  // bucket con frequenza maggiore
+} freqT;
+
+// elemento fantasma: ricorda l'hash del filepath (e la dimensione) di un file espulso di recente
+typedef struct ghost {
+    size_t h;           // hash del filepath
+    size_t size;        // dimensione del file al momento dell'espulsione
+    int list;           // lista fantasma che contiene l'elemento (2Q: A1out, ARC: B1 o B2, per tutte: storico delle espulsioni)
+    struct ghost *next;
+    struct ghost *prev;
+    struct ghost *hnext;    // prossimo elemento nello stesso bucket della tabella hash dei fantasmi
+} ghostT;
+
+// lista di nodi, dal meno recente (head) al piu' recente (tail)
+typedef struct {
+    nodeT *head;
+    nodeT *tail;
+    size_t len;
+} listT;
+
+// lista di elementi fantasma, dal meno recente (head) al piu' recente (tail)
 typedef struct {
-    nodeT *head;        // puntatore al primo elemento della coda
-    nodeT *tail;        // puntatore all'ultimo elemento della coda
+    ghostT *head;
+    ghostT *tail;
+    size_t len;
+} ghostListT;
+
+// partizione (shard) della coda, con una propria lock: contiene i file il cui filepath ha hash corrispondente
+typedef struct {
+    listT lists[2];     // liste dei file (FIFO, LRU e CLOCK usano solo lists[0], 2Q: A1in e Am, ARC: T1 e T2)
+    freqT *freqs;       // bucket di frequenza in ordine crescente (LFU)
+    nodeT *hand;        // lancetta (CLOCK)
+    ghostListT ghosts[3];   // liste fantasma (2Q: A1out, ARC: B1 e B2) e storico delle espulsioni (ghosts[2])
+    ghostT **ghostTable;    // tabella hash degli elementi fantasma
+    size_t capacity;    // numero massimo di espulsioni ricordate nello storico dello shard
+    size_t p;           // dimensione obiettivo di T1 (ARC)
+    nodeT **heap;       // min-heap dei nodi ordinati per priorita' (GDSF)
+    size_t heapLen;     // numero di nodi nello heap (GDSF)
+    size_t heapCap;     // capacita' allocata dello heap (GDSF)
+    double inflation;   // valore L, priorita' dell'ultimo file espulso (GDSF)
+    nodeT **table;      // tabella hash (con liste di trabocco) che indicizza i nodi dello shard per filepath
+    size_t tableSize;   // numero di bucket della tabella hash (potenza di 2)
+    pthread_mutex_t m;  // lock per rendere thread-safe le operazioni sullo shard
+} shardT;
+
+/**
+ * Coda di fileT con politica di rimpiazzamento configurabile, suddivisa in shard indipendenti indicizzati da una tabella hash sul filepath.
+ * Ogni shard mantiene i propri metadati di rimpiazzamento; la dequeue confronta i candidati proposti da ogni shard e sceglie quello 
+ * da espellere (con CLOCK invece gli shard vengono visitati a turno e la lancetta avanza solo in quello che espelle). I limiti maxLen e maxSize sono globali.
+ * Ordine di acquisizione delle lock: lock del file, poi lock dello shard, poi lock della coda.
+ */
+typedef struct {
+    shardT *shards;     // array degli shard
+    size_t numShards;   // numero di shard
+    policyT policy;     // politica di rimpiazzamento
     size_t maxLen;      // numero massimo di elementi supportati nella coda
     size_t len;         // numero attuale di elementi nella coda (<= maxLen)
     size_t maxSize;     // dimensione massima degli elementi nella coda
     size_t size;        // somma delle dimensioni degli elementi presenti in coda (<= maxSize)       
-    pthread_mutex_t m;  // lock per rendere thread-safe le operazioni sulla coda
+    size_t reservedLen;     // numero di file riservati con reserveSpace e non ancora inseriti
+    size_t reservedSize;    // bytes riservati con reserveSpace e non ancora scritti
+    atomic_ulong seq;   // prossimo numero di sequenza da assegnare (inserimenti e accessi)
+    atomic_size_t nextShard;    // shard dal quale iniziare la prossima ricerca della vittima (CLOCK)
+    atomic_size_t hits;         // letture di file presenti nella coda
+    atomic_size_t misses;       // letture di file espulsi di recente (capacity miss)
+    atomic_size_t hitBytes;     // bytes letti dai file presenti nella coda
+    atomic_size_t missBytes;    // bytes dei file espulsi di recente che sono stati richiesti in lettura
+    pthread_mutex_t m;  // lock che protegge len, size, reservedLen e reservedSize
 } queueT;
 
+// spazio riservato nella coda con reserveSpace: enqueue ne consuma un file, writeFileInQueue e appendFileInQueue i bytes
+typedef struct {
+    size_t len;         // numero di file riservati
+    size_t size;        // bytes riservati
+} reservationT;
+
+// statistiche sulle letture effettuate con acquireFile
+typedef struct {
+    size_t hits;        // letture di file presenti nella coda
+    size_t misses;      // letture di file espulsi di recente (capacity miss)
+    size_t hitBytes;    // bytes letti dai file presenti nella coda
+    size_t missBytes;   // bytes dei file espulsi di recente che sono stati richiesti in lettura
+} statsT;
+
 /**
  * Alloca ed inizializza un fileT.
  * \param filepath -> stringa che identifica il fileT tramite il suo path assoluto
@@ -36,7 +176,8 @@ typedef struct {
 fileT* createFileT(char *filepath, int O_LOCK, int owner, int open);
 
 /**
- * Scrive del contenuto (in append) su un fileT creato con createFileT.
+ * Scrive del contenuto (in append) su un fileT creato con createFileT. I contenuti piccoli restano nel fileT; per quelli piu' 
+ * grandi il contenuto gia' presente non viene copiato: viene riempito l'ultimo chunk e vengono aggiunti solo i chunk necessari.
  * \param f -> fileT sul quale scrivere
  * \param content -> puntatore al buffer che contiene i dati da scrivere
  * \size -> dimensione in bytes del contenuto da scrivere
@@ -45,7 +186,54 @@ fileT* createFileT(char *filepath, int O_LOCK, int owner, int open);
 int writeFileT(fileT *f, void *content, size_t size) ;
 
 /**
- * Cancella un fileT creato con createFileT e ne libera la memoria.
+ * Copia una parte del contenuto di un fileT in un buffer. Il chiamante deve garantire che il file non venga modificato
+ * durante la copia (ad esempio tenendo la lock del file in lettura).
+ * \param f -> fileT dal quale leggere
+ * \param buf -> buffer nel quale copiare il contenuto
+ * \param offset -> posizione (in bytes) dalla quale iniziare a leggere
+ * \param size -> numero massimo di bytes da copiare
+ * \retval -> numero di bytes copiati, -1 se errore (setta errno)
+ */
+ssize_t readFileT(fileT *f, void *buf, size_t offset, size_t size);
+
+/**
+ * Descrive una parte del contenuto di un fileT come array di buffer da passare a writev, senza copiarlo. I buffer restano
+ * validi finche' il file non viene modificato (ad esempio finche' si tiene la lock del file in lettura).
+ * \param f -> fileT del quale descrivere il contenuto
+ * \param offset -> posizione (in bytes) dalla quale iniziare
+ * \param iov -> array nel quale inserire i buffer
+ * \param iovcnt -> in ingresso, numero massimo di buffer da inserire; in uscita, numero di buffer inseriti
+ * \retval -> numero di bytes descritti dai buffer inseriti (0 se offset e' oltre la fine del contenuto)
+ */
+size_t contentIov(fileT *f, size_t offset, struct iovec *iov, int *iovcnt);
+
+/**
+ * Prende una copia del contenuto di un fileT (tenendo la lock del file in lettura solo durante la copia), da rilasciare 
+ * con releaseContent. Il chiamante deve possedere un riferimento al file.
+ * \param f -> fileT del quale copiare il contenuto
+ * \param c -> copia da inizializzare
+ */
+void acquireContent(fileT *f, contentT *c);
+
+/**
+ * Come contentIov, ma descrive una parte di una copia del contenuto presa con acquireContent.
+ * \param c -> copia del contenuto
+ * \param offset -> posizione (in bytes) dalla quale iniziare
+ * \param iov -> array nel quale inserire i buffer
+ * \param iovcnt -> in ingresso, numero massimo di buffer da inserire; in uscita, numero di buffer inseriti
+ * \retval -> numero di bytes descritti dai buffer inseriti (0 se offset e' oltre la fine del contenuto)
+ */
+size_t contentCopyIov(contentT *c, size_t offset, struct iovec *iov, int *iovcnt);
+
+/**
+ * Rilascia una copia del contenuto presa con acquireContent.
+ * \param c -> copia da rilasciare
+ */
+void releaseContent(contentT *c);
+
+/**
+ * Rilascia un riferimento a un fileT creato con createFileT. La memoria viene liberata quando viene rilasciato l'ultimo riferimento,
+ * quindi un file estratto dalla coda mentre e' in prestito (vedi acquireFile) resta valido finche' il prestito non termina.
  * \param f -> fileT da cancellare
 */
 void destroyFile(fileT *f);
@@ -54,12 +242,52 @@ void destroyFile(fileT *f);
  * Alloca ed inizializza una coda di fileT. Dev'essere chiamata da un solo thread.
  * \param maxLen -> lunghezza massima della coda (numero di file)
  * \param maxSize -> dimensione massima della coda (in bytes)
+ * \param numShards -> numero di shard, ognuno con la propria lock, in cui suddividere la coda (>= 1)
+ * \param policy -> politica di rimpiazzamento usata dalla dequeue
  * \retval -> puntatore alla coda allocata, NULL se errore
  */
-queueT* createQueue(size_t maxLen, size_t maxSize);
+queueT* createQueue(size_t maxLen, size_t maxSize, size_t numShards, policyT policy);
+
+/**
+ * Converte il nome di una politica di rimpiazzamento ("FIFO", "LRU", "CLOCK", "LFU", "2Q", "ARC", "GDSF") nel valore corrispondente.
+ * \param name -> nome della politica (non case sensitive)
+ * \retval -> politica corrispondente, -1 se il nome non e' valido (errno = EINVAL)
+ */
+int parsePolicy(const char *name);
+
+/**
+ * Restituisce il nome di una politica di rimpiazzamento.
+ * \param policy -> politica della quale si vuole il nome
+ * \retval -> nome della politica, NULL se non valida
+ */
+const char* policyName(policyT policy);
+
+/**
+ * Sceglie ed espelle in un solo passo (tenendo le lock di tutti gli shard) i file necessari a liberare size bytes e len file,
+ * secondo la politica di rimpiazzamento, e riserva lo spazio liberato: gli altri thread non possono occuparlo finche' la 
+ * prenotazione non viene consumata (da enqueue, writeFileInQueue, appendFileInQueue o appendBlockInQueue) o annullata con 
+ * cancelReservation. Le scritture consumano solo i bytes di cui il file cresce, quindi la stessa prenotazione puo' coprire 
+ * un contenuto scritto con piu' chiamate. Con size = 0 e len = 1 viene espulso al piu' un file.
+ * \param queue -> puntatore alla coda
+ * \param size -> bytes da riservare
+ * \param len -> numero di file da riservare
+ * \param exclude -> path assoluto di un file da non espellere (quello che si sta per scrivere), puo' essere NULL
+ * \param res -> prenotazione da inizializzare
+ * \param victims -> puntatore nel quale salvare l'array dei file espulsi (NULL se nessuno), da liberare con free dopo aver
+ *                   chiamato destroyFile su ogni file
+ * \retval -> numero di file espulsi, -1 se errore (errno = EFBIG o ENFILE se la richiesta non puo' essere soddisfatta)
+ */
+int reserveSpace(queueT *queue, size_t size, size_t len, char *exclude, reservationT *res, fileT ***victims);
 
 /**
- * Estrae un fileT dalla coda.
+ * Annulla una prenotazione ottenuta con reserveSpace e non ancora consumata, rendendo lo spazio di nuovo disponibile.
+ * \param queue -> puntatore alla coda
+ * \param res -> prenotazione da annullare
+ */
+void cancelReservation(queueT *queue, reservationT *res);
+
+/**
+ * Estrae dalla coda il fileT scelto dalla politica di rimpiazzamento, considerando tutti gli shard.
  * \param queue -> puntatore alla coda dalla quale estrarre il fileT
  * \retval -> puntatore al file estratto, NULL se errore
  */
@@ -75,9 +303,10 @@ void voiDequeue(queueT *queue);
  * Inserisce un fileT nella coda. 
  * \param queue -> puntatore alla coda nella quale inserire il fileT
  * \param data -> puntatore al fileT da inserire
+ * \param res -> prenotazione ottenuta con reserveSpace da consumare, NULL se nessuna
  * \retval -> 0 se successo, -1 se errore (setta errno)  
  */
-int enqueue(queueT *queue, fileT* data);
+int enqueue(queueT *queue, fileT* data, reservationT *res);
 
 /**
  * Stampa su standard output l'intero contenuto della coda.
@@ -132,9 +361,10 @@ int closeFileInQueue(queueT *queue, char *filepath, int client);
  * \param content -> puntatore al buffer che contiene i dati da scrivere
  * \param size -> dimensione in bytes del contenuto da scrivere
  * \param client -> file descriptor del client che ha richiesto l'operazione di scrittura
+ * \param res -> prenotazione ottenuta con reserveSpace da consumare, NULL se nessuna
  * \retval -> 0 se successo, -1 se errore (setta errno)
  */
-int writeFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client);
+int writeFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res);
 
 /**
  * Scrive del contenuto in append su un fileT all'interno della coda. 
@@ -144,9 +374,24 @@ int writeFileInQueue(queueT *queue, char *filepath, void *content, size_t size,
  * \param content -> puntatore al buffer che contiene i dati da scrivere in append
  * \param size -> dimensione in bytes del contenuto da scrivere in append
  * \param client -> file descriptor del client che ha richiesto l'operazione di append
+ * \param res -> prenotazione ottenuta con reserveSpace da consumare, NULL se nessuna
+ * \retval -> 0 se successo, -1 se errore (setta errno)
+ */
+int appendFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res);
+
+/**
+ * Scrive in append un ulteriore blocco di un contenuto ricevuto a blocchi, il cui primo blocco e' stato scritto con
+ * writeFileInQueue o appendFileInQueue. A differenza di appendFileInQueue non conta come un nuovo accesso per la politica
+ * di rimpiazzamento, quindi la dimensione dei blocchi non influisce sulle scelte di espulsione.
+ * \param queue -> puntatore alla coda che contiene il fileT su cui effettuare l'append
+ * \param filepath -> path assoluto (identificatore) del fileT su cui effettuare l'append
+ * \param content -> puntatore al buffer che contiene il blocco da scrivere in append
+ * \param size -> dimensione in bytes del blocco
+ * \param client -> file descriptor del client che ha richiesto l'operazione di scrittura
+ * \param res -> prenotazione ottenuta con reserveSpace da consumare, NULL se nessuna
  * \retval -> 0 se successo, -1 se errore (setta errno)
  */
-int appendFileInQueue(queueT *queue, char *filepath, void *content, size_t size, int client);
+int appendBlockInQueue(queueT *queue, char *filepath, void *content, size_t size, int client, reservationT *res);
 
 /**
  * Rimuove un fileT dalla coda e ne libera la memoria. 
@@ -166,6 +411,75 @@ int removeFileFromQueue(queueT *queue, char *filepath, int client);
  */
 fileT* find(queueT *queue, char *filepath);
 
+/**
+ * Cerca un fileT nella coda e, se presente, lo restituisce in prestito senza copiarlo, incrementandone il numero di riferimenti.
+ * Il file resta valido anche se nel frattempo viene espulso o rimosso dalla coda, finche' non viene chiamata releaseFile.
+ * Il contenuto va letto tenendo la lock f->rw in lettura. La lettura conta come accesso per la politica di rimpiazzamento
+ * e aggiorna le statistiche della coda (hit se il file e' presente, capacity miss se e' stato espulso di recente).
+ * \param queue -> puntatore alla coda sulla quale cercare il fileT
+ * \param filepath -> path assoluto del fileT da cercare
+ * \retval -> puntatore al fileT se trovato, NULL se non trovato (errno = ENOENT) o errore (setta errno)
+ */
+fileT* acquireFile(queueT *queue, char *filepath);
+
+/**
+ * Prende in prestito fino a n fileT della coda, in ordine qualsiasi, senza aggiornare i metadati della politica di rimpiazzamento.
+ * Ogni file ottenuto va restituito con releaseFile.
+ * \param queue -> puntatore alla coda dalla quale prendere i fileT
+ * \param files -> array (di almeno n elementi) nel quale salvare i puntatori ai fileT
+ * \param n -> numero massimo di fileT da prendere in prestito
+ * \retval -> numero di fileT presi in prestito, -1 se errore (setta errno)
+ */
+int acquireFiles(queueT *queue, fileT **files, size_t n);
+
+/**
+ * Termina il prestito di un fileT ottenuto con acquireFile.
+ * \param f -> fileT da restituire
+ */
+void releaseFile(fileT *f);
+
+/**
+ * Controlla se un fileT e' presente nella coda, senza copiarlo.
+ * \param queue -> puntatore alla coda sulla quale cercare il fileT
+ * \param filepath -> path assoluto del fileT da cercare
+ * \retval -> 1 se presente, 0 se non presente, -1 se errore (setta errno)
+ */
+int exists(queueT *queue, char *filepath);
+
+/**
+ * Copia i metadati di un fileT contenuto nella coda (O_LOCK, owner, open e size), senza copiarne il contenuto.
+ * \param queue -> puntatore alla coda sulla quale cercare il fileT
+ * \param filepath -> path assoluto del fileT da cercare
+ * \param info -> fileT nel quale copiare i metadati (filepath e content vengono impostati a NULL)
+ * \retval -> 0 se successo, -1 se non trovato (errno = ENOENT) o errore (setta errno)
+ */
+int statFile(queueT *queue, char *filepath, fileT *info);
+
+/**
+ * Registra nelle statistiche una richiesta per un file non presente nella coda: se il file e' stato espulso di recente,
+ * viene contato come capacity miss, con la dimensione che aveva al momento dell'espulsione. La acquireFile lo fa automaticamente.
+ * \param queue -> puntatore alla coda
+ * \param filepath -> path assoluto del file richiesto
+ * \retval -> 1 se contato come capacity miss, 0 se il file non e' stato espulso di recente, -1 se errore (setta errno)
+ */
+int recordMiss(queueT *queue, char *filepath);
+
+/**
+ * Copia le statistiche sulle letture effettuate con acquireFile (e sui miss registrati con recordMiss).
+ * \param queue -> puntatore alla coda della quale si vogliono le statistiche
+ * \param stats -> struttura nella quale copiare le statistiche
+ * \retval -> 0 se successo, -1 se errore (setta errno)
+ */
+int getStats(queueT *queue, statsT *stats);
+
+/**
+ * Copia le statistiche degli allocatori (fileT, nodi, elementi fantasma, bucket LFU, chunk del contenuto e una classe per ogni 
+ * lunghezza dei path), condivisi da tutte le code.
+ * \param stats -> array di almeno ALLOC_POOLS elementi nel quale copiare le statistiche
+ * \retval -> numero di allocatori copiati, -1 se errore (setta errno)
+ */
+int getAllocStats(slabStatsT *stats);
+
 /**
  * Restituisce la lunghezza attuale della coda (ovvero il numero di elementi presenti).
  * \param queue -> puntatore alla coda della quale si vuole conoscere la lunghezza
@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include <partialIO.h>
 
@@ -49,4 +50,33 @@ writen(int fd, void *ptr, size_t n) {
      ptr   = (char*)ptr + nwritten;
    }
    return(n - nleft); // return >= 0 
-}
\ No newline at end of file
+}
+
+ssize_t  // Write all the "iovcnt" buffers of "iov" to a descriptor (the array is modified)
+writevn(int fd, struct iovec *iov, int iovcnt) {
+   size_t   n = 0;
+   size_t   nleft;
+   ssize_t  nwritten;
+
+   for (int i = 0; i < iovcnt; i++) n += iov[i].iov_len;
+
+   nleft = n;
+   while (nleft > 0) {
+     if((nwritten = writev(fd, iov, iovcnt)) < 0) {
+        if (nleft == n) return -1; // error, return -1
+        else break; // error, return amount written so far
+     } else if (nwritten == 0) break;
+     nleft -= nwritten;
+     // skip the buffers written entirely, then advance into the first one written partially
+     while (iovcnt > 0 && (size_t) nwritten >= iov->iov_len) {
+        nwritten -= iov->iov_len;
+        iov++;
+        iovcnt--;
+     }
+     if (iovcnt > 0) {
+        iov->iov_base = (char*)iov->iov_base + nwritten;
+        iov->iov_len -= nwritten;
+     }
+   }
+   return(n - nleft); // return >= 0
+}
@@ -16,4 +16,9 @@
 ssize_t readn(int fd, void *ptr, size_t n);
 
 /* Write "n" bytes to a descriptor */
-ssize_t writen(int fd, void *ptr, size_t n);
\ No newline at end of file
+ssize_t writen(int fd, void *ptr, size_t n);
+
+#include <sys/uio.h>
+
+/* Write all the "iovcnt" buffers of "iov" to a descriptor (scatter-gather), the array is modified */
+ssize_t writevn(int fd, struct iovec *iov, int iovcnt);
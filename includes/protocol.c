@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include <protocol.h>
+
+// nomi testuali delle operazioni, nell'ordine dei codici
+static const char *opNames[OP_COUNT] = {
+    "hello", "openFile", "readFile", "readNFiles", "writeFile", "appendToFile", "lockFile", "unlockFile",
+    "closeFile", "removeFile", "batch"
+};
+
+// restituisce il nome testuale di un'operazione
+const char* opName(int op) {
+    if (op < 0 || op >= OP_COUNT) {
+        return NULL;
+    }
+
+    return opNames[op];
+}
+
+// compone l'header di una richiesta binaria
+ssize_t encodeRequest(protoHeaderT *hdr, int version, int op, int flags, uint32_t id, const char *path, uint64_t payloadLen) {
+    size_t pathLen = path ? strlen(path) : 0;
+
+    // controllo la validita' degli argomenti
+    if (!hdr || version < PROTO_V2 || version > PROTO_V4 || op < 0 || op >= OP_COUNT || flags < 0 || flags > 0xFF || pathLen > PROTO_MAXPATH) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(hdr, 0, sizeof(protoHeaderT));
+    hdr->magic = PROTO_MAGIC;
+    hdr->version = (uint8_t) version;
+    hdr->op = (uint8_t) op;
+    hdr->flags = (uint8_t) flags;
+    hdr->id = id;
+    hdr->pathLen = (uint32_t) pathLen;
+    hdr->payloadLen = payloadLen;
+
+    return (ssize_t) (sizeof(protoHeaderT) + pathLen);
+}
+
+// compone un comando testuale
+int formatTextRequest(char *cmd, int op, const char *path, long arg) {
+    // le operazioni hello e batch non esistono nel protocollo testuale
+    if (!cmd || op <= OP_HELLO || op >= OP_BATCH) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int len;
+    memset(cmd, '\0', PROTO_CMDSIZE);
+
+    switch (op) {
+        // operazioni con un path e un argomento numerico
+        case OP_OPEN:
+        case OP_WRITE:
+        case OP_APPEND:
+            len = snprintf(cmd, PROTO_CMDSIZE, "%s:%s:%ld", opNames[op], path ? path : "", arg);
+            break;
+
+        // operazione con il solo argomento numerico
+        case OP_READN:
+            len = snprintf(cmd, PROTO_CMDSIZE, "%s:%ld", opNames[op], arg);
+            break;
+
+        // operazioni con il solo path
+        default:
+            len = snprintf(cmd, PROTO_CMDSIZE, "%s:%s", opNames[op], path ? path : "");
+            break;
+    }
+
+    // il comando (compreso il terminatore) deve entrare in PROTO_CMDSIZE bytes
+    if (len < 0 || len >= PROTO_CMDSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// decodifica un comando testuale
+int parseTextRequest(char *cmd, requestT *req) {
+    // controllo la validita' degli argomenti
+    if (!cmd || !req) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(req, 0, sizeof(requestT));
+    req->version = PROTO_TEXT;
+
+    char *save = NULL;
+    char *token = strtok_r(cmd, ":", &save);
+    int op = OP_OPEN;
+
+    // cerco l'operazione tra quelle del protocollo testuale
+    while (token && op < OP_BATCH && strcmp(token, opNames[op]) != 0) {
+        op++;
+    }
+
+    // comando non riconosciuto
+    if (!token || op == OP_BATCH) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    req->op = (opT) op;
+
+    // readNFiles ha solo l'argomento numerico
+    if (op == OP_READN) {
+        char *num = strtok_r(NULL, ":", &save);
+        req->n = num ? strtol(num, NULL, 0) : 0;
+        return 0;
+    }
+
+    // un path mancante viene segnalato dalla procedura che serve la richiesta
+    req->path = strtok_r(NULL, ":", &save);
+
+    if (op == OP_OPEN || op == OP_WRITE || op == OP_APPEND) {
+        char *arg = strtok_r(NULL, ":", &save);
+        long value = arg ? strtol(arg, NULL, 0) : 0;
+
+        if (op == OP_OPEN) {
+            req->flags = (int) value;
+        }
+
+        else {
+            req->size = (size_t) value;
+        }
+    }
+
+    return 0;
+}
+
+// decodifica una richiesta binaria
+int parseBinaryRequest(const protoHeaderT *hdr, char *path, requestT *req) {
+    // controllo la validita' degli argomenti
+    if (!hdr || !req || (hdr->pathLen > 0 && !path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // controllo che la richiesta sia ben formata
+    if (hdr->magic != PROTO_MAGIC || hdr->version < PROTO_V2 || hdr->version > PROTO_V4 || hdr->op >= OP_COUNT || hdr->pathLen > PROTO_MAXPATH) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    memset(req, 0, sizeof(requestT));
+    req->op = (opT) hdr->op;
+    req->version = hdr->version;
+    req->flags = hdr->flags;
+    req->id = hdr->id;
+
+    if (hdr->pathLen > 0) {
+        path[hdr->pathLen] = '\0';
+        req->path = path;
+    }
+
+    if (req->op == OP_READN || req->op == OP_BATCH) {
+        req->n = (long) hdr->payloadLen;
+    }
+
+    else {
+        req->size = (size_t) hdr->payloadLen;
+    }
+
+    return 0;
+}
+
+/**
+ * Legge i flag di un comando testuale openFile dall'argomento che segue il path (arg punta al primo byte del path), come
+ * parseTextRequest. Restituisce -1 se l'argomento non e' ancora arrivato per intero.
+ */
+static int peekTextFlags(const char *arg, size_t len) {
+    // il comando termina al primo '\0' (il resto e' riempimento)
+    size_t end = strnlen(arg, len);
+    const char *sep = memchr(arg, ':', end);
+
+    if (end == len) {
+        return -1;
+    }
+
+    // senza argomento i flag sono 0
+    if (!sep) {
+        return 0;
+    }
+
+    char value[PROTO_CMDSIZE];
+    size_t n = end - (size_t) (sep + 1 - arg);
+
+    if (n >= sizeof(value)) {
+        return -1;
+    }
+
+    memcpy(value, sep + 1, n);
+    value[n] = '\0';
+
+    return (int) strtol(value, NULL, 0);
+}
+
+// riconosce l'operazione della richiesta all'inizio di buf (e, se sono gia' arrivati, i suoi flag)
+int peekRequestOp(const char *buf, size_t len, int *flags) {
+    if (!buf) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (flags) {
+        *flags = -1;
+    }
+
+    // richiesta binaria: il codice dell'operazione e' nell'header
+    if (len > 0 && (unsigned char) buf[0] == PROTO_MAGIC) {
+        if (len <= offsetof(protoHeaderT, op)) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        unsigned char op = (unsigned char) buf[offsetof(protoHeaderT, op)];
+
+        if (op >= OP_COUNT) {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        if (flags && len > offsetof(protoHeaderT, flags)) {
+            *flags = (unsigned char) buf[offsetof(protoHeaderT, flags)];
+        }
+
+        return op;
+    }
+
+    // comando testuale: il nome dell'operazione e' seguito da ':'
+    for (int op = OP_OPEN; op < OP_BATCH; op++) {
+        size_t n = strlen(opNames[op]);
+
+        if (len > n && strncmp(buf, opNames[op], n) == 0 && buf[n] == ':') {
+            // solo openFile ha dei flag, per gli altri comandi sono 0
+            if (flags) {
+                *flags = (op == OP_OPEN) ? peekTextFlags(buf + n + 1, len - n - 1) : 0;
+            }
+
+            return op;
+        }
+    }
+
+    errno = (len < PROTO_CMDSIZE) ? EAGAIN : EBADMSG;
+    return -1;
+}
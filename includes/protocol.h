@@ -0,0 +1,144 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PROTO_TEXT 1            // protocollo testuale: comandi "operazione:path:argomento" di PROTO_CMDSIZE bytes
+#define PROTO_V2 2              // protocollo binario: header di dimensione fissa seguito dal path
+#define PROTO_V3 3              // protocollo binario con pipelining (vedi protoHeaderT)
+#define PROTO_V4 4              // protocollo v3 con le richieste batch (vedi OP_BATCH)
+#define PROTO_MAGIC 0xC5        // primo byte delle richieste binarie (i comandi testuali iniziano con una lettera)
+#define PROTO_CMDSIZE 256       // dimensione dei comandi testuali
+#define PROTO_MAXPATH 255       // lunghezza massima di un path (come nel protocollo testuale)
+#define PROTO_MAXBATCH 1024     // numero massimo di richieste in un batch
+#define BATCH_CHAIN 0x80        // flag delle richieste di un batch: eseguita solo se la precedente ha avuto successo
+
+// codici delle operazioni
+typedef enum {
+    OP_HELLO = 0,       // negoziazione della versione del protocollo
+    OP_OPEN,
+    OP_READ,
+    OP_READN,
+    OP_WRITE,
+    OP_APPEND,
+    OP_LOCK,
+    OP_UNLOCK,
+    OP_CLOSE,
+    OP_REMOVE,
+    OP_BATCH,           // batch di richieste (protocollo v4)
+    OP_COUNT            // numero di operazioni
+} opT;
+
+/**
+ * Header delle richieste binarie, seguito da pathLen bytes di path (senza terminatore).
+ * Nel protocollo v2 il contenuto delle write e delle append (payloadLen bytes) viene inviato solo dopo la prima
+ * risposta del server, come nel protocollo testuale. Nel protocollo v3 (pipelining) il client puo' inviare piu'
+ * richieste senza attendere le risposte: il contenuto segue subito il path, il server serve le richieste di una
+ * connessione nell'ordine di arrivo e ogni risposta e' preceduta dall'id (uint32_t) della richiesta alla quale si
+ * riferisce. La hello usa sempre l'header v2 (e la sua risposta non ha l'id), cosi' i server che conoscono solo il v2
+ * la accettano. Nel protocollo v4 una richiesta OP_BATCH (payloadLen = numero di richieste, al piu' PROTO_MAXBATCH) e'
+ * seguita da richieste v4 complete (header, path e contenuto) di tipo OP_OPEN, OP_READ, OP_WRITE, OP_APPEND, OP_UNLOCK,
+ * OP_CLOSE o OP_REMOVE, con id consecutivi a quello del batch: il server risponde "ok" al batch e poi a ogni richiesta,
+ * nell'ordine, come se fosse stata inviata da sola. Una richiesta con il flag BATCH_CHAIN, se la precedente del batch e'
+ * fallita, non viene eseguita e termina con l'errore ECANCELED.
+ * I campi sono nell'ordine dei byte dell'host, poiche' client e server comunicano tramite un socket AF_UNIX.
+ */
+typedef struct {
+    uint8_t magic;          // PROTO_MAGIC
+    uint8_t version;        // versione del protocollo (da PROTO_V2 a PROTO_V4)
+    uint8_t op;             // codice dell'operazione (opT)
+    uint8_t flags;          // flag dell'operazione (O_CREATE, O_LOCK, BATCH_CHAIN)
+    uint32_t id;            // identificatore della richiesta, scelto dal client
+    uint32_t pathLen;       // lunghezza del path
+    uint32_t reserved;      // riservato, sempre 0
+    uint64_t payloadLen;    // write/append: dimensione del contenuto; readNFiles: numero di file richiesti; batch: numero
+                            // di richieste; hello: versione piu' alta supportata dal client, se maggiore di quella dell'header
+} protoHeaderT;
+
+#define FRAME_END 1             // frame che chiude una sequenza di file
+
+/**
+ * Frame che precede ogni file inviato dal server nel protocollo v2, seguito da pathLen bytes di path (senza terminatore)
+ * e size bytes di contenuto. Una sequenza di file (readNFiles, file espulsi da una write) termina con un frame con il
+ * flag FRAME_END, senza path ne' contenuto. Nel protocollo testuale, invece, il path occupa BUFSIZE bytes e la
+ * sequenza termina con il path ".FINE".
+ */
+typedef struct {
+    uint32_t pathLen;       // lunghezza del path
+    uint32_t flags;         // FRAME_END
+    uint64_t size;          // dimensione del contenuto
+} fileFrameT;
+
+// richiesta decodificata, indipendente dal formato con il quale e' stata ricevuta
+typedef struct {
+    opT op;                 // codice dell'operazione
+    int version;            // versione del protocollo della richiesta
+    int flags;              // flag dell'operazione
+    uint32_t id;            // identificatore della richiesta (0 per le richieste testuali)
+    char *path;             // path terminato da '\0', NULL se l'operazione non ne ha uno
+    size_t size;            // dimensione del contenuto di write e append
+    long n;                 // numero di file richiesti da readNFiles, numero di richieste di un batch
+} requestT;
+
+/**
+ * Restituisce il nome testuale di un'operazione.
+ * \param op -> codice dell'operazione
+ * \retval -> nome dell'operazione, NULL se il codice non e' valido
+ */
+const char* opName(int op);
+
+/**
+ * Compone l'header di una richiesta binaria.
+ * \param hdr -> header da riempire
+ * \param version -> versione del protocollo (da PROTO_V2 a PROTO_V4)
+ * \param op -> codice dell'operazione
+ * \param flags -> flag dell'operazione
+ * \param id -> identificatore della richiesta
+ * \param path -> path del file, puo' essere NULL
+ * \param payloadLen -> dimensione del contenuto (write/append), numero di file (readNFiles) o di richieste (batch)
+ * \retval -> numero di bytes della richiesta (header + path), -1 se errore (setta errno)
+ */
+ssize_t encodeRequest(protoHeaderT *hdr, int version, int op, int flags, uint32_t id, const char *path, uint64_t payloadLen);
+
+/**
+ * Compone un comando testuale di PROTO_CMDSIZE bytes (completato da '\0').
+ * \param cmd -> buffer di almeno PROTO_CMDSIZE bytes
+ * \param op -> codice dell'operazione
+ * \param path -> path del file, puo' essere NULL
+ * \param arg -> argomento numerico (flags, dimensione o numero di file), ignorato dalle operazioni che non lo usano
+ * \retval -> 0 se successo, -1 se errore (setta errno)
+ */
+int formatTextRequest(char *cmd, int op, const char *path, long arg);
+
+/**
+ * Decodifica un comando testuale. Il comando viene modificato e req->path punta al suo interno.
+ * \param cmd -> comando terminato da '\0'
+ * \param req -> richiesta decodificata
+ * \retval -> 0 se successo, -1 se il comando non e' valido (setta errno)
+ */
+int parseTextRequest(char *cmd, requestT *req);
+
+/**
+ * Decodifica una richiesta binaria. Il path (pathLen bytes) deve seguire l'header in un buffer con almeno un byte
+ * libero, nel quale viene scritto il terminatore: req->path punta al suo interno.
+ * \param hdr -> header ricevuto
+ * \param path -> path ricevuto dopo l'header
+ * \param req -> richiesta decodificata
+ * \retval -> 0 se successo, -1 se la richiesta non e' valida (setta errno)
+ */
+int parseBinaryRequest(const protoHeaderT *hdr, char *path, requestT *req);
+
+/**
+ * Riconosce l'operazione della richiesta all'inizio di buf senza decodificarla, per esempio per scegliere la priorita'
+ * con la quale servirla prima di averla letta (bastano i primi bytes di un comando testuale o dell'header binario).
+ * \param buf -> bytes ricevuti
+ * \param len -> numero di bytes in buf
+ * \param flags -> se non NULL, vi salva i flag della richiesta (nei comandi testuali l'argomento di openFile), -1 se 
+ * non sono ancora arrivati
+ * \retval -> codice dell'operazione, -1 se i bytes non bastano o non sono una richiesta valida (setta errno)
+ */
+int peekRequestOp(const char *buf, size_t len, int *flags);
+
+#endif
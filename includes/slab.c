@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <slab.h>
+
+#define SLAB_ALIGN 16    // allineamento degli oggetti, sufficiente per qualsiasi tipo
+#define ROUNDUP(x) (((x) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+// cache degli oggetti liberi di un thread
+typedef struct {
+    slabPoolT *pool;    // allocatore al quale appartengono gli oggetti
+    slabObjT *head;     // oggetti liberi
+    size_t len;         // numero di oggetti liberi
+} slabCacheT;
+
+// alla terminazione di un thread, restituisce all'allocatore gli oggetti presenti nella sua cache
+static void flushCache(void *arg) {
+    slabCacheT *cache = (slabCacheT*) arg;
+
+    if (cache->head) {
+        slabObjT *last = cache->head;
+        while (last->next) {
+            last = last->next;
+        }
+
+        pthread_mutex_lock(&cache->pool->m);
+        last->next = cache->pool->free;
+        cache->pool->free = cache->head;
+        pthread_mutex_unlock(&cache->pool->m);
+    }
+
+    free(cache);
+}
+
+// inizializza un allocatore di oggetti di dimensione fissa
+int slabInit(slabPoolT *pool, const char *name, size_t objSize) {
+    // controllo la validità degli argomenti
+    if (!pool || objSize == 0 || objSize > SLAB_SIZE / 4) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pool->name = name;
+    pool->objSize = ROUNDUP(objSize < sizeof(slabObjT) ? sizeof(slabObjT) : objSize);
+    pool->perSlab = (SLAB_SIZE - ROUNDUP(sizeof(slabT))) / pool->objSize;
+    pool->free = NULL;
+    pool->slabs = NULL;
+    pool->numSlabs = 0;
+    atomic_init(&pool->allocs, 0);
+    atomic_init(&pool->frees, 0);
+    atomic_init(&pool->refills, 0);
+
+    if ((errno = pthread_key_create(&pool->key, flushCache)) != 0) {
+        perror("pthread_key_create");
+        return -1;
+    }
+
+    if ((errno = pthread_mutex_init(&pool->m, NULL)) != 0) {
+        perror("pthread_mutex_init");
+        pthread_key_delete(pool->key);
+        return -1;
+    }
+
+    return 0;
+}
+
+// restituisce la cache del thread chiamante, creandola se non esiste
+static slabCacheT* getCache(slabPoolT *pool) {
+    slabCacheT *cache = pthread_getspecific(pool->key);
+
+    if (!cache) {
+        if ((cache = malloc(sizeof(slabCacheT))) == NULL) {
+            return NULL;
+        }
+
+        cache->pool = pool;
+        cache->head = NULL;
+        cache->len = 0;
+
+        if (pthread_setspecific(pool->key, cache) != 0) {
+            free(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+// alloca un nuovo blocco e ne inserisce gli oggetti nella lista degli oggetti liberi. Va chiamata con la lock dell'allocatore acquisita
+static int grow(slabPoolT *pool) {
+    slabT *slab = malloc(SLAB_SIZE);
+
+    if (!slab) {
+        return -1;
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->numSlabs++;
+
+    char *obj = (char*) slab + ROUNDUP(sizeof(slabT));
+
+    for (size_t i = 0; i < pool->perSlab; i++, obj += pool->objSize) {
+        ((slabObjT*) obj)->next = pool->free;
+        pool->free = (slabObjT*) obj;
+    }
+
+    return 0;
+}
+
+// alloca un oggetto
+void* slabAlloc(slabPoolT *pool) {
+    // controllo la validità dell'argomento
+    if (!pool) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    slabCacheT *cache = getCache(pool);
+    slabObjT *obj = NULL;
+
+    // se la cache del thread e' vuota, la riempio per meta' con gli oggetti liberi dell'allocatore
+    if (!cache || !cache->head) {
+        atomic_fetch_add_explicit(&pool->refills, 1, memory_order_relaxed);
+
+        pthread_mutex_lock(&pool->m);
+
+        if (!pool->free && grow(pool) == -1) {
+            pthread_mutex_unlock(&pool->m);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        // senza cache (malloc fallita) prendo un solo oggetto
+        if (!cache) {
+            obj = pool->free;
+            pool->free = obj->next;
+        }
+
+        else {
+            while (pool->free && cache->len < SLAB_CACHE / 2) {
+                slabObjT *temp = pool->free;
+                pool->free = temp->next;
+                temp->next = cache->head;
+                cache->head = temp;
+                cache->len++;
+            }
+        }
+
+        pthread_mutex_unlock(&pool->m);
+    }
+
+    if (!obj) {
+        obj = cache->head;
+        cache->head = obj->next;
+        cache->len--;
+    }
+
+    atomic_fetch_add(&pool->allocs, 1);
+
+    return (void*) obj;
+}
+
+// restituisce un oggetto all'allocatore
+void slabFree(slabPoolT *pool, void *obj) {
+    if (!pool || !obj) {
+        return;
+    }
+
+    atomic_fetch_add(&pool->frees, 1);
+
+    slabCacheT *cache = getCache(pool);
+    slabObjT *o = (slabObjT*) obj;
+
+    // senza cache restituisco l'oggetto direttamente all'allocatore
+    if (!cache) {
+        atomic_fetch_add_explicit(&pool->refills, 1, memory_order_relaxed);
+
+        pthread_mutex_lock(&pool->m);
+        o->next = pool->free;
+        pool->free = o;
+        pthread_mutex_unlock(&pool->m);
+        return;
+    }
+
+    o->next = cache->head;
+    cache->head = o;
+    cache->len++;
+
+    // se la cache e' piena, ne restituisco meta' all'allocatore
+    if (cache->len > SLAB_CACHE) {
+        atomic_fetch_add_explicit(&pool->refills, 1, memory_order_relaxed);
+
+        slabObjT *first = cache->head;
+        slabObjT *last = first;
+
+        for (size_t i = 1; i < SLAB_CACHE / 2; i++) {
+            last = last->next;
+        }
+
+        cache->head = last->next;
+        cache->len -= SLAB_CACHE / 2;
+
+        pthread_mutex_lock(&pool->m);
+        last->next = pool->free;
+        pool->free = first;
+        pthread_mutex_unlock(&pool->m);
+    }
+}
+
+// copia le statistiche di un allocatore
+void slabStats(slabPoolT *pool, slabStatsT *stats) {
+    if (!pool || !stats) {
+        return;
+    }
+
+    stats->name = pool->name;
+    stats->objSize = pool->objSize;
+    // leggo prima le deallocazioni, in modo che live non risulti mai negativo
+    stats->frees = atomic_load(&pool->frees);
+    stats->allocs = atomic_load(&pool->allocs);
+    stats->live = stats->allocs - stats->frees;
+    stats->refills = atomic_load(&pool->refills);
+
+    pthread_mutex_lock(&pool->m);
+    stats->slabs = pool->numSlabs;
+    pthread_mutex_unlock(&pool->m);
+
+    stats->reserved = stats->slabs * SLAB_SIZE;
+}
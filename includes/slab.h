@@ -0,0 +1,82 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define SLAB_SIZE (64 * 1024)   // dimensione in bytes di un blocco (slab) dal quale vengono ricavati gli oggetti
+#define SLAB_CACHE 64           // numero massimo di oggetti liberi nella cache di un thread
+
+// oggetto libero: il primo campo dell'oggetto viene usato per collegarlo alla lista degli oggetti liberi
+typedef struct slabObj {
+    struct slabObj *next;
+} slabObjT;
+
+// blocco di memoria dal quale vengono ricavati gli oggetti
+typedef struct slab {
+    struct slab *next;
+} slabT;
+
+/**
+ * Allocatore di oggetti di dimensione fissa. Gli oggetti vengono ricavati da blocchi di SLAB_SIZE bytes, che non vengono
+ * mai restituiti al sistema: gli oggetti liberati vengono riusati dalle allocazioni successive.
+ * Ogni thread mantiene una cache di al piu' SLAB_CACHE oggetti liberi, quindi la lock dell'allocatore viene acquisita
+ * solo quando la cache del thread e' vuota (o piena).
+ */
+typedef struct {
+    const char *name;       // nome dell'allocatore (per le statistiche)
+    size_t objSize;         // dimensione degli oggetti (arrotondata a un multiplo di 16 bytes)
+    size_t perSlab;         // numero di oggetti ricavati da ogni blocco
+    slabObjT *free;         // oggetti liberi non presenti nelle cache dei thread
+    slabT *slabs;           // blocchi allocati
+    size_t numSlabs;        // numero di blocchi allocati
+    pthread_key_t key;      // chiave della cache di ogni thread
+    pthread_mutex_t m;      // lock che protegge free, slabs e numSlabs
+    atomic_size_t allocs;   // numero di allocazioni
+    atomic_size_t frees;    // numero di deallocazioni
+    atomic_size_t refills;  // numero di volte in cui una cache di un thread e' stata riempita (o svuotata) tramite la lock
+} slabPoolT;
+
+// statistiche di un allocatore
+typedef struct {
+    const char *name;       // nome dell'allocatore
+    size_t objSize;         // dimensione degli oggetti
+    size_t allocs;          // numero di allocazioni
+    size_t frees;           // numero di deallocazioni
+    size_t live;            // oggetti attualmente in uso
+    size_t refills;         // acquisizioni della lock dell'allocatore
+    size_t slabs;           // blocchi allocati
+    size_t reserved;        // bytes richiesti al sistema
+} slabStatsT;
+
+/**
+ * Inizializza un allocatore di oggetti di dimensione fissa.
+ * \param pool -> puntatore all'allocatore da inizializzare
+ * \param name -> nome dell'allocatore
+ * \param objSize -> dimensione in bytes degli oggetti
+ * \retval -> 0 se successo, -1 se errore (setta errno)
+ */
+int slabInit(slabPoolT *pool, const char *name, size_t objSize);
+
+/**
+ * Alloca un oggetto. Il contenuto dell'oggetto non e' inizializzato.
+ * \param pool -> puntatore all'allocatore
+ * \retval -> puntatore all'oggetto, NULL se errore (setta errno)
+ */
+void* slabAlloc(slabPoolT *pool);
+
+/**
+ * Restituisce un oggetto all'allocatore dal quale e' stato allocato.
+ * \param pool -> puntatore all'allocatore
+ * \param obj -> puntatore all'oggetto da liberare, puo' essere NULL
+ */
+void slabFree(slabPoolT *pool, void *obj);
+
+/**
+ * Copia le statistiche di un allocatore.
+ * \param pool -> puntatore all'allocatore
+ * \param stats -> puntatore alla struttura nella quale copiare le statistiche
+ */
+void slabStats(slabPoolT *pool, slabStatsT *stats);
+
+#endif
@@ -1,98 +1,614 @@
 // libreria presa dalla soluzione dell'esercitazione 11
 
 #include <stdio.h>
-#include <assert.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <strings.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <threadpool.h>
 
+// nomi delle modalita' del threadpool, nell'ordine di poolModeT
+static const char *modeNames[POOL_MODES] = { "stealing", "ring" };
+
+// indice del worker nel pool al quale appartiene il thread, -1 se il thread non e' un worker
+static __thread int workerId = -1;
+
+// istante attuale in ns, usato per misurare l'attesa dei task in coda
+static long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// accumula l'attesa in coda di un task appena prelevato, letta dal controllore dei pool a dimensione variabile
+static void recordDelay(threadpool_t *pool, taskfun_t *task) {
+    if (task->enqueued != 0) {
+        atomic_fetch_add_explicit(&pool->delaysum, nowNs() - task->enqueued, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->delaycount, 1, memory_order_relaxed);
+    }
+}
+
+/* preleva il task piu' vecchio della classe lane dalla coda q (di chi la chiama o di un altro worker, al quale il task
+   viene rubato). Restituisce 1 se ha prelevato un task, 0 se la coda e' vuota, -1 in caso di errore */
+static int takeTask(workqueue_t *q, int lane, taskfun_t *task) {
+    // le code vuote vengono scartate senza acquisirne la lock
+    if (atomic_load(&q->lanecount[lane]) == 0) {
+        return 0;
+    }
+
+    if (pthread_mutex_lock(&(q->lock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return -1;
+    }
+
+    int found = 0;
+
+    if (atomic_load(&q->lanecount[lane]) > 0) {
+        threadpool_t *pool = q->pool;
+
+        *task = q->tasks[lane][q->head[lane]];
+
+        q->head[lane]++;
+        q->head[lane] = (q->head[lane] == pool->capacity) ? 0 : q->head[lane];
+
+        atomic_fetch_sub(&q->lanecount[lane], 1);
+        atomic_fetch_sub(&q->count, 1);
+        atomic_fetch_add(&pool->taskonthefly, 1);
+        atomic_fetch_sub(&pool->queued[lane], 1);
+        atomic_fetch_sub(&pool->lanepending[lane], 1);
+        atomic_fetch_sub(&pool->pending, 1);
+        found = 1;
+    }
+
+    if (pthread_mutex_unlock(&(q->lock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
+        return -1;
+    }
+
+    return found;
+}
+
+// numero di task presenti nelle code, di tutte le classi
+static int queuedTasks(threadpool_t *pool) {
+    int n = 0;
+
+    for (int lane = 0; lane < POOL_PRIOS; lane++) {
+        n += atomic_load(&pool->queued[lane]);
+    }
+
+    return n;
+}
+
+/* classe dalla quale un worker cerca per prima un task: quella urgente, a meno che il worker non abbia gia' prelevato 
+   POOL_HIGHBURST task urgenti di seguito (streak) */
+static int firstLane(int streak) {
+    return (streak >= POOL_HIGHBURST) ? POOL_PRIO_NORMAL : POOL_PRIO_HIGH;
+}
+
+/* aggiorna il numero di task urgenti prelevati di seguito da un worker dopo che ha prelevato un task della classe lane,
+   contando i task normali prelevati mentre ce n'erano di urgenti in attesa (urgent) */
+static int updateStreak(threadpool_t *pool, int streak, int lane, int urgent) {
+    if (lane == POOL_PRIO_HIGH) {
+        return (streak < POOL_HIGHBURST) ? streak + 1 : streak;
+    }
+
+    if (urgent) {
+        atomic_fetch_add_explicit(&pool->promoted, 1, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+// segna come risvegliato il worker della coda q (della quale si possiede la lock): restituisce 1 se era in attesa, 0 altrimenti
+static int wakeWorker(workqueue_t *q) {
+    if (!atomic_load(&q->parked)) {
+        return 0;
+    }
+
+    atomic_store(&q->parked, 0);
+    atomic_fetch_sub(&q->pool->idle, 1);
+    return 1;
+}
+
 // funzione eseguita dal thread worker che appartiene al pool
-static void *workerpool_thread(void *threadpool) {    
-    threadpool_t *pool = (threadpool_t *)threadpool; // cast
+static void *workerpool_thread(void *workqueue) {
+    workqueue_t *self = (workqueue_t *)workqueue; // cast
+    threadpool_t *pool = self->pool;
     taskfun_t task;  // generic task
-    pthread_t self = pthread_self();
-    int myid = -1;
-
-    do {
-    	for (int i=0; i<pool->numthreads; ++i) {
-    	    if (pthread_equal(pool->threads[i], self)) {
-        		myid = i;
-        		break;
+    int myid = self->id;
+    int victim = myid;      // ultima coda dalla quale ho rubato un task
+    int streak = 0;         // task urgenti prelevati di seguito
+
+    workerId = myid;
+
+    for (;;) {
+        if (atomic_load(&pool->exiting) > 1) {
+            break; // exit forzato, esco immediatamente
+        }
+
+        // il controllore ha ridotto i worker: termino dopo aver eseguito i task gia' assegnati alla mia coda
+        if (myid >= atomic_load(&pool->active) && atomic_load(&self->count) == 0) {
+            break;
+        }
+
+        /* una classe alla volta, a partire da quella urgente: prima la propria coda, poi quelle degli altri worker a 
+        partire da quella del furto precedente */
+        int first = firstLane(streak);
+        int lane = first;
+        int r = 0;
+
+        for (int k = 0; r == 0 && k < POOL_PRIOS; k++) {
+            lane = (first + k) % POOL_PRIOS;
+            r = takeTask(self, lane, &task);
+
+            for (int i = 0; r == 0 && i < pool->numqueues && atomic_load(&pool->queued[lane]) > 0; i++) {
+                victim = (victim + 1 == pool->numqueues) ? 0 : victim + 1;
+                r = (victim == myid) ? 0 : takeTask(&pool->queues[victim], lane, &task);
             }
+
+            // la coda derubata potrebbe avere altri task: il prossimo furto riparte da questa
+            if (r == 1 && victim != myid) {
+                victim = (victim == 0) ? pool->numqueues - 1 : victim - 1;
+            }
+        }
+
+        if (r == -1) {
+            return NULL;
+        }
+
+        if (r == 1) {
+            streak = updateStreak(pool, streak, lane, atomic_load(&pool->queued[POOL_PRIO_HIGH]) > 0);
+            recordDelay(pool, &task);
+
+            // eseguo la funzione 
+            (*(task.fun))(task.arg);
+
+            atomic_fetch_sub(&pool->taskonthefly, 1);
+            continue;
         }
-    } while (myid < 0);
 
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {
-        fprintf(stderr, "ERRORE FATALE lock\n");               
-        return NULL;  
-    }        
+        if (pthread_mutex_lock(&(self->lock)) != 0) {
+            fprintf(stderr, "ERRORE FATALE lock\n");
+            return NULL;
+        }
+
+        /* mi metto in attesa solo se non ci sono task in nessuna coda: chi aggiunge un task incrementa queued prima di
+        cercare un worker in attesa, quindi o vede idle e parked o il worker vede il task (non si perdono risvegli) */
+        atomic_store(&self->parked, 1);
+        atomic_fetch_add(&pool->idle, 1);
+
+        // chi mi risveglia azzera parked, cosi' i task successivi vengono assegnati a un altro worker in attesa
+        while (atomic_load(&self->parked) && atomic_load(&self->count) == 0 && queuedTasks(pool) == 0 && 
+            !atomic_load(&pool->exiting) && myid < atomic_load(&pool->active)) {
+            pthread_cond_wait(&(self->cond), &(self->lock));
+        }
+
+        if (atomic_load(&self->parked)) {
+            atomic_store(&self->parked, 0);
+            atomic_fetch_sub(&pool->idle, 1);
+        }
+
+        if (pthread_mutex_unlock(&(self->lock)) != 0) {
+            fprintf(stderr, "ERRORE FATALE unlock\n");
+            return NULL;
+        }
+
+        // devo uscire e non ci sono messaggi pendenti
+        if (atomic_load(&pool->exiting) == 1 && atomic_load(&pool->pending) == 0) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "Thread %d exiting...\n", myid);
+    return NULL;
+}
+
+// attende sul futex finche' vale val (o fino a un risveglio)
+static void futexWait(atomic_uint *futex, unsigned int val) {
+    syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+// risveglia al piu' n thread in attesa sul futex
+static void futexWake(atomic_uint *futex, int n) {
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+// attesa attiva di un worker della modalita' POOL_RING
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause");
+#endif
+}
+
+/* inserisce un task nella coda lock-free: la cella in posizione pos e' libera quando seq = pos, l'inserimento la
+   pubblica ponendo seq = pos + 1. Restituisce 0 se successo, 1 se la coda e' piena */
+static int ringPush(taskring_t *ring, taskfun_t *task) {
+    size_t pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
+    ringcell_t *cell;
 
     for (;;) {
-        // in attesa di un messaggio, controllo spurious wakeups
-        while((pool->count == 0) && (!pool->exiting)) {
-            pthread_cond_wait(&(pool->cond), &(pool->lock));
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        // cella libera: provo a prenotarla
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        // la cella contiene ancora un task di un giro precedente
+        else if (diff < 0) {
+            return 1;
+        }
+
+        // un altro produttore ha prenotato la cella
+        else {
+            pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
         }
+    }
+
+    cell->task = *task;
+    atomic_store(&cell->seq, pos + 1);
+    return 0;
+}
+
+/* preleva un task dalla coda lock-free: la cella in posizione pos contiene un task quando seq = pos + 1, il prelievo la
+   libera per il giro successivo ponendo seq = pos + numero di celle. Restituisce 1 se ha prelevato un task, 0 se la coda e' vuota */
+static int ringPop(taskring_t *ring, taskfun_t *task) {
+    size_t pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+    ringcell_t *cell;
 
-        if (pool->exiting > 1) {
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        // cella con un task: provo a prenotarla
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        // coda vuota
+        else if (diff < 0) {
+            return 0;
+        }
+
+        // un altro consumatore ha prelevato il task
+        else {
+            pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+        }
+    }
+
+    *task = cell->task;
+    atomic_store_explicit(&cell->seq, pos + ring->mask + 1, memory_order_release);
+    return 1;
+}
+
+// restituisce 1 se la coda lock-free non contiene task pubblicati
+static int ringEmpty(taskring_t *ring) {
+    size_t pos = atomic_load(&ring->dequeuePos);
+    return atomic_load(&ring->cells[pos & ring->mask].seq) != pos + 1;
+}
+
+// restituisce 1 se le code lock-free di tutte le classi sono vuote
+static int ringsEmpty(threadpool_t *pool) {
+    for (int lane = 0; lane < POOL_PRIOS; lane++) {
+        if (!ringEmpty(&pool->ring[lane])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* preleva un task dalle code lock-free, una classe alla volta a partire da first. Restituisce 1 se ha prelevato un task
+   (della classe *lane), 0 se le code sono vuote */
+static int ringTake(threadpool_t *pool, int first, taskfun_t *task, int *lane) {
+    for (int k = 0; k < POOL_PRIOS; k++) {
+        *lane = (first + k) % POOL_PRIOS;
+
+        if (ringPop(&pool->ring[*lane], task)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* risveglia un worker della modalita' POOL_RING, se qualcuno e' in attesa (o sta per attendere) e non ce n'e' gia' uno
+   appena risvegliato: quest'ultimo, ripartendo, risveglia il successivo se trova altri task */
+static void ringWake(threadpool_t *pool) {
+    if (atomic_load(&pool->idle) > 0 && atomic_exchange(&pool->waking, 1) == 0) {
+        atomic_fetch_add(&pool->futex, 1);
+        futexWake(&pool->futex, 1);
+    }
+}
+
+// funzione eseguita dal thread worker che appartiene a un pool in modalita' POOL_RING
+static void *ringworker_thread(void *workqueue) {
+    workqueue_t *self = (workqueue_t *)workqueue; // cast
+    threadpool_t *pool = self->pool;
+    taskfun_t task;  // generic task
+    int streak = 0;  // task urgenti prelevati di seguito
+
+    workerId = self->id;
+
+    for (;;) {
+        if (atomic_load(&pool->exiting) > 1) {
             break; // exit forzato, esco immediatamente
         }
 
-    	// devo uscire ma ci sono messaggi pendenti 
-    	if (pool->exiting == 1 && !pool->count) {
-            break;  
+        // il controllore ha ridotto i worker: termino, lasciando agli altri worker i task rimasti
+        if (self->id >= atomic_load(&pool->active)) {
+            if (!ringsEmpty(pool)) {
+                ringWake(pool);
+            }
+
+            break;
         }
 
-        // nuovo task
-        task.fun = pool->pending_queue[pool->head].fun;
-        task.arg = pool->pending_queue[pool->head].arg;
+        // se le code sono vuote riprovo per un po' prima di attendere: i task brevi arrivano spesso a raffica
+        int first = firstLane(streak);
+        int lane;
+        int r = ringTake(pool, first, &task, &lane);
 
-        pool->head++; pool->count--;
-        pool->head = (pool->head == abs(pool->queue_size)) ? 0 : pool->head;
+        for (int i = 0; r == 0 && i < pool->spin; i++) {
+            cpuRelax();
+            r = ringTake(pool, first, &task, &lane);
+        }
 
-        pool->taskonthefly++;
+        if (r == 1) {
+            atomic_fetch_add(&pool->taskonthefly, 1);
+            atomic_fetch_sub(&pool->lanepending[lane], 1);
+            atomic_fetch_sub(&pool->pending, 1);
+            streak = updateStreak(pool, streak, lane, !ringEmpty(&pool->ring[POOL_PRIO_HIGH]));
+            recordDelay(pool, &task);
 
-        if (pthread_mutex_unlock(&(pool->lock)) != 0) { 
-            fprintf(stderr, "ERRORE FATALE unlock\n");              
-            return NULL;        
-        }   
+            // eseguo la funzione 
+            (*(task.fun))(task.arg);
 
-        // eseguo la funzione 
-        (*(task.fun))(task.arg);
-	
-        if (pthread_mutex_lock(&(pool->lock))!=0) { 
-            fprintf(stderr, "ERRORE FATALE lock\n");                
-            return NULL;                               
-        }   
+            atomic_fetch_sub(&pool->taskonthefly, 1);
+            continue;
+        }
+
+        // devo uscire e non ci sono messaggi pendenti
+        if (atomic_load(&pool->exiting) == 1 && atomic_load(&pool->pending) == 0) {
+            break;
+        }
+
+        /* mi metto in attesa sul futex solo se la coda e' ancora vuota dopo essermi dichiarato idle: chi inserisce un task
+        lo pubblica prima di leggere idle e incrementa il futex prima di risvegliare, quindi il risveglio non va perso */
+        unsigned int val = atomic_load(&pool->futex);
+        atomic_fetch_add(&pool->idle, 1);
+
+        /* azzero waking anche prima di attendere: se chi l'ha settato ha incrementato il futex prima della lettura di val
+        il flag viene azzerato qui, altrimenti la futexWait termina subito e lo azzera dopo */
+        atomic_store(&pool->waking, 0);
+
+        if (ringsEmpty(pool) && !atomic_load(&pool->exiting) && self->id < atomic_load(&pool->active)) {
+            futexWait(&pool->futex, val);
+            atomic_store(&pool->waking, 0);
+        }
 
-        pool->taskonthefly--;
+        atomic_fetch_sub(&pool->idle, 1);
+
+        // se ci sono altri task oltre a quello per il quale sono stato risvegliato, risveglio un altro worker
+        if (!ringsEmpty(pool)) {
+            ringWake(pool);
+        }
     }
 
-    if (pthread_mutex_unlock(&(pool->lock))!=0) {  
-        fprintf(stderr, "ERRORE FATALE unlock\n");              
-        return NULL;                               
+    fprintf(stderr, "Thread %d exiting...\n", self->id);
+    return NULL;
+}
+
+// avvia il worker di indice pari al numero di thread avviati. Restituisce 0 se successo, -1 in caso di errore
+static int startWorker(threadpool_t *pool) {
+    int i = atomic_load(&pool->numthreads);
+    void *(*worker)(void *) = (pool->mode == POOL_RING) ? ringworker_thread : workerpool_thread;
+
+    if (pthread_create(&(pool->threads[i]), NULL, worker, (void*) &pool->queues[i]) != 0) {
+        return -1;
+    }
+
+    atomic_fetch_add(&pool->numthreads, 1);
+
+    if (i + 1 > pool->peakthreads) {
+        pool->peakthreads = i + 1;
+    }
+
+    return 0;
+}
+
+/* termina il worker con indice piu' alto: dopo il decremento di active il worker non si mette piu' in attesa, quindi
+   basta risvegliarlo (acquisendo la lock della sua coda per non perdere il risveglio). Restituisce 0 se successo, -1 in caso di errore */
+static int stopWorker(threadpool_t *pool) {
+    int i = atomic_fetch_sub(&pool->active, 1) - 1;
+    workqueue_t *q = &pool->queues[i];
+
+    if (pool->mode == POOL_RING) {
+        atomic_fetch_add(&pool->futex, 1);
+        futexWake(&pool->futex, INT_MAX);
+    }
+
+    if (pthread_mutex_lock(&(q->lock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return -1;
+    }
+
+    wakeWorker(q);
+    int r = pthread_cond_signal(&(q->cond));
+
+    if (pthread_mutex_unlock(&(q->lock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
+        return -1;
+    }
+
+    if (r != 0 || pthread_join(pool->threads[i], NULL) != 0) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    atomic_fetch_sub(&pool->numthreads, 1);
+    return 0;
+}
+
+// registra una decisione del controllore con la funzione di log del pool (si possiede ctllock)
+static void logDecision(threadpool_t *pool, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void logDecision(threadpool_t *pool, const char *fmt, ...) {
+    if (!pool->logfun) {
+        return;
+    }
+
+    char msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    pool->logfun(msg, pool->logarg);
+}
+
+/* funzione eseguita dal thread controllore dei pool a dimensione variabile: ogni POOL_TICK ms aggiunge worker se i task
+   pendenti superano i worker attivi (quanti ne mancano) o se l'attesa media in coda supera POOL_MAXDELAY us (uno alla volta),
+   e ne termina la meta' di quelli rimasti sempre inattivi dopo POOL_IDLETICKS intervalli senza task pendenti */
+static void *controller_thread(void *arg) {
+    threadpool_t *pool = (threadpool_t *)arg; // cast
+    int idleticks = 0;      // intervalli consecutivi senza task pendenti e con worker inattivi
+    int minidle = INT_MAX;  // minimo numero di worker inattivi in questi intervalli
+
+    if (pthread_mutex_lock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return NULL;
+    }
+
+    while (!atomic_load(&pool->exiting)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += POOL_TICK * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+
+        pthread_cond_timedwait(&(pool->ctlcond), &(pool->ctllock), &ts);
+
+        if (atomic_load(&pool->exiting)) {
+            break;
+        }
+
+        int active = atomic_load(&pool->active);
+        int pending = atomic_load(&pool->pending);
+        int idle = atomic_load(&pool->idle);
+        size_t count = atomic_exchange(&pool->delaycount, 0);
+        long long sum = atomic_exchange(&pool->delaysum, 0);
+        double delay = (count > 0) ? (double) sum / count / 1000.0 : 0;   // attesa media in us
+
+        // carico in aumento: aggiungo worker
+        if ((pending > active || delay > POOL_MAXDELAY) && active < pool->maxthreads) {
+            int target = active + ((pending > active) ? pending - active : 1);
+            target = (target > pool->maxthreads) ? pool->maxthreads : target;
+
+            while (atomic_load(&pool->active) < target) {
+                atomic_fetch_add(&pool->active, 1);
+
+                if (startWorker(pool) != 0) {
+                    atomic_fetch_sub(&pool->active, 1);
+                    break;
+                }
+
+                pool->grown++;
+            }
+
+            logDecision(pool, "Threadpool: worker %d -> %d (%d task pendenti, attesa media in coda %.2f ms).\n", active, 
+                atomic_load(&pool->active), pending, delay / 1000.0);
+
+            idleticks = 0;
+            minidle = INT_MAX;
+            continue;
+        }
+
+        // nessun task pendente e worker inattivi: dopo POOL_IDLETICKS intervalli termino la meta' di quelli sempre inattivi
+        if (pending > 0 || idle == 0 || active == pool->minthreads) {
+            idleticks = 0;
+            minidle = INT_MAX;
+            continue;
+        }
+
+        minidle = (idle < minidle) ? idle : minidle;
+
+        if (++idleticks < POOL_IDLETICKS) {
+            continue;
+        }
+
+        int target = active - (minidle + 1) / 2;
+        target = (target < pool->minthreads) ? pool->minthreads : target;
+
+        while (atomic_load(&pool->active) > target) {
+            if (stopWorker(pool) != 0) {
+                perror("stopWorker");
+                break;
+            }
+
+            pool->shrunk++;
+        }
+
+        logDecision(pool, "Threadpool: worker %d -> %d (%d inattivi da %d ms).\n", active, atomic_load(&pool->active), minidle, 
+            POOL_IDLETICKS * POOL_TICK);
+
+        idleticks = 0;
+        minidle = INT_MAX;
+    }
+
+    if (pthread_mutex_unlock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
     }
 
-    fprintf(stderr, "Thread %d exiting...\n", myid);
     return NULL;
 }
 
 static int freePoolResources(threadpool_t *pool) {
-    if(pool->threads) {
-        free(pool->threads);
-        free(pool->pending_queue);
-	
-        pthread_mutex_destroy(&(pool->lock));
-        pthread_cond_destroy(&(pool->cond));
+    if(pool->queues) {
+        for (int i = 0; i < pool->numqueues; i++) {
+            for (int lane = 0; lane < POOL_PRIOS; lane++) {
+                free(pool->queues[i].tasks[lane]);
+            }
+
+            pthread_mutex_destroy(&(pool->queues[i].lock));
+            pthread_cond_destroy(&(pool->queues[i].cond));
+        }
+
+        free(pool->queues);
+    }
+
+    if (pool->ring) {
+        for (int lane = 0; lane < POOL_PRIOS; lane++) {
+            free(pool->ring[lane].cells);
+        }
+
+        free(pool->ring);
     }
 
+    pthread_mutex_destroy(&(pool->ctllock));
+    pthread_cond_destroy(&(pool->ctlcond));
+    free(pool->threads);
     free(pool);    
     return 0;
 }
 
-threadpool_t *createThreadPool(int numthreads, int pending_size) {
-    if(numthreads <= 0 || pending_size < 0) {
+threadpool_t *createThreadPool(int numthreads, int maxthreads, int pending_size, poolModeT mode) {
+    if(numthreads <= 0 || maxthreads < numthreads || pending_size < 0 || mode < 0 || mode >= POOL_MODES) {
 	   errno = EINVAL;
         return NULL;
     }
@@ -103,43 +619,141 @@ threadpool_t *createThreadPool(int numthreads, int pending_size) {
     }
 
     // condizioni iniziali
-    pool->numthreads   = 0;
-    pool->taskonthefly = 0;
+    pool->numqueues    = 0;
+    pool->minthreads = numthreads;
+    pool->maxthreads = maxthreads;
+    pool->peakthreads = 0;
+    pool->grown = pool->shrunk = 0;
+    pool->logfun = NULL;
+    pool->logarg = NULL;
     pool->queue_size = (pending_size == 0 ? -1 : pending_size);
-    pool->head = pool->tail = pool->count = 0;
-    pool->exiting = 0;
+    pool->capacity = (pending_size == 0 ? maxthreads : pending_size);
+    pool->mode = mode;
+    pool->queues = NULL;
+    pool->ring = NULL;
+    pool->spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? POOL_SPIN : 0;  // con una sola CPU l'attesa attiva e' inutile
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->futex, 0);
+    atomic_init(&pool->waking, 0);
+    atomic_init(&pool->taskonthefly, 0);
+    atomic_init(&pool->idle, 0);
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->exiting, 0);
+    atomic_init(&pool->maxpending, 0);
+    atomic_init(&pool->added, 0);
+    atomic_init(&pool->rejected, 0);
+    atomic_init(&pool->urgent, 0);
+    atomic_init(&pool->promoted, 0);
+    atomic_init(&pool->numthreads, 0);
+    atomic_init(&pool->active, numthreads);
+    atomic_init(&pool->delaysum, 0);
+    atomic_init(&pool->delaycount, 0);
+
+    for (int lane = 0; lane < POOL_PRIOS; lane++) {
+        atomic_init(&pool->lanepending[lane], 0);
+        atomic_init(&pool->queued[lane], 0);
+    }
+
+    if ((pthread_mutex_init(&(pool->ctllock), NULL) != 0) || (pthread_cond_init(&(pool->ctlcond), NULL) != 0)) {
+        free(pool);
+        return NULL;
+    }
 
-    /* Alloca thread e task queue */
-    pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * numthreads);
+    /* Alloca thread e code dei task, per il massimo numero di worker */
+    pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * maxthreads);
     if (pool->threads == NULL) {
+        pthread_mutex_destroy(&(pool->ctllock));
+        pthread_cond_destroy(&(pool->ctlcond));
     	free(pool);
     	return NULL;
     }
 
-    pool->pending_queue = (taskfun_t *) malloc(sizeof(taskfun_t) * abs(pool->queue_size));
-    if (pool->pending_queue == NULL) {
-    	free(pool->threads);
-    	free(pool);
+    void *queues = NULL;
+    if ((errno = posix_memalign(&queues, 64, sizeof(workqueue_t) * maxthreads)) != 0) {
+        freePoolResources(pool);
 	   return NULL;
     }
+    pool->queues = (workqueue_t *) queues;
 
-    if ((pthread_mutex_init(&(pool->lock), NULL) != 0) || (pthread_cond_init(&(pool->cond), NULL) != 0)) {
-    	free(pool->threads);
-    	free(pool->pending_queue);
-    	free(pool);
-    	return NULL;
+    // ogni coda lock-free ha un numero di celle pari alla potenza di 2 successiva al massimo numero di task pendenti
+    if (mode == POOL_RING) {
+        void *ring = NULL;
+        size_t cells = 1;
+
+        while (cells < (size_t) pool->capacity) {
+            cells *= 2;
+        }
+
+        if ((errno = posix_memalign(&ring, 64, sizeof(taskring_t) * POOL_PRIOS)) != 0) {
+            freePoolResources(pool);
+            return NULL;
+        }
+        pool->ring = (taskring_t *) ring;
+
+        for (int lane = 0; lane < POOL_PRIOS; lane++) {
+            pool->ring[lane].mask = cells - 1;
+            atomic_init(&pool->ring[lane].enqueuePos, 0);
+            atomic_init(&pool->ring[lane].dequeuePos, 0);
+            pool->ring[lane].cells = (ringcell_t *) malloc(sizeof(ringcell_t) * cells);
+        }
+
+        for (int lane = 0; lane < POOL_PRIOS; lane++) {
+            if (pool->ring[lane].cells == NULL) {
+                freePoolResources(pool);
+                return NULL;
+            }
+
+            for (size_t i = 0; i < cells; i++) {
+                atomic_init(&pool->ring[lane].cells[i].seq, i);
+            }
+        }
     }
 
-    for (int i = 0; i < numthreads; i++) {
+    for (int i = 0; i < maxthreads; i++) {
+        workqueue_t *q = &pool->queues[i];
+
+        // nella modalita' POOL_RING le code dei worker servono solo a passare pool e id ai thread
+        int failed = 0;
+
+        for (int lane = 0; lane < POOL_PRIOS; lane++) {
+            q->tasks[lane] = (mode == POOL_STEALING) ? (taskfun_t *) malloc(sizeof(taskfun_t) * pool->capacity) : NULL;
+            failed |= (mode == POOL_STEALING && q->tasks[lane] == NULL);
+            q->head[lane] = q->tail[lane] = 0;
+            atomic_init(&q->lanecount[lane], 0);
+        }
+
+        if (failed || (pthread_mutex_init(&(q->lock), NULL) != 0) || (pthread_cond_init(&(q->cond), NULL) != 0)) {
+            for (int lane = 0; lane < POOL_PRIOS; lane++) {
+                free(q->tasks[lane]);
+            }
+
+            freePoolResources(pool);
+            return NULL;
+        }
 
-        if (pthread_create(&(pool->threads[i]), NULL, workerpool_thread, (void*) pool) != 0) {
-            /* errore fatale, libero tutto forzando l'uscita dei threads */
+        atomic_init(&q->count, 0);
+        atomic_init(&q->parked, 0);
+        q->pool = pool;
+        q->id = i;
+        pool->numqueues++;
+    }
+
+    for (int i = 0; i < numthreads; i++) {
+        if (startWorker(pool) != 0) {
+            /* errore fatale, libero tutto forzando l'uscita dei threads (il controllore non e' ancora stato avviato) */
+            pool->maxthreads = numthreads;
             destroyThreadPool(pool, 1);
             errno = EFAULT;
             return NULL;
         }
+    }
 
-        pool->numthreads++;
+    // il controllore serve solo se il numero di worker puo' variare
+    if (maxthreads > numthreads && pthread_create(&(pool->controller), NULL, controller_thread, (void*) pool) != 0) {
+        pool->maxthreads = numthreads;
+        destroyThreadPool(pool, 1);
+        errno = EFAULT;
+        return NULL;
     }
 
     return pool;
@@ -152,37 +766,56 @@ int destroyThreadPool(threadpool_t *pool, int force) {
     	return -1;
     }
 
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {  
-        fprintf(stderr, "ERRORE FATALE lock\n");                
-        return -1;                               
-    }   
+    // termino per primo il controllore, cosi' il numero di worker non cambia piu'
+    if (pthread_mutex_lock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return -1;
+    }
 
-    pool->exiting = 1 + force;
+    atomic_store(&pool->exiting, 1 + force);
+    pthread_cond_signal(&(pool->ctlcond));
 
-    if (pthread_cond_broadcast(&(pool->cond)) != 0) {
-        if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-            fprintf(stderr, "ERRORE FATALE unlock\n");              
-            return -1;    
-        }       
+    if (pthread_mutex_unlock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
+        return -1;
+    }
 
+    if (pool->maxthreads > pool->minthreads && pthread_join(pool->controller, NULL) != 0) {
         errno = EFAULT;
         return -1;
     }
 
-    if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-        fprintf(stderr, "ERRORE FATALE unlock\n");              
-        return -1;    
-    }     
+    // nella modalita' POOL_RING i worker attendono sul futex: lo incremento (chi sta per attendere non si blocca) e li risveglio
+    if (pool->mode == POOL_RING) {
+        atomic_fetch_add(&pool->futex, 1);
+        futexWake(&pool->futex, INT_MAX);
+    }
+
+    // risveglio tutti i worker, acquisendo la lock della coda per non perdere il risveglio di chi si sta mettendo in attesa
+    for (int i = 0; i < pool->numqueues; i++) {
+        workqueue_t *q = &pool->queues[i];
+
+        if (pthread_mutex_lock(&(q->lock)) != 0) {  
+            fprintf(stderr, "ERRORE FATALE lock\n");                
+            return -1;                               
+        }   
+
+        int r = pthread_cond_broadcast(&(q->cond));
+
+        if (pthread_mutex_unlock(&(q->lock)) != 0) {  
+            fprintf(stderr, "ERRORE FATALE unlock\n");              
+            return -1;    
+        }     
+
+        if (r != 0) {
+            errno = EFAULT;
+            return -1;
+        }
+    }
 
     for (int i = 0; i < pool->numthreads; i++) {
     	if (pthread_join(pool->threads[i], NULL) != 0) {
     	    errno = EFAULT;
-
-            if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-                fprintf(stderr, "ERRORE FATALE unlock\n");              
-                return -1;    
-            }   
-
     	    return -1;
     	}
     }
@@ -192,71 +825,191 @@ int destroyThreadPool(threadpool_t *pool, int force) {
 }
 
 int addToThreadPool(threadpool_t *pool, void (*f)(void *), void *arg) {
-    if(pool == NULL || f == NULL) {
+    return addToThreadPoolPrio(pool, f, arg, POOL_PRIO_NORMAL);
+}
+
+int addToThreadPoolPrio(threadpool_t *pool, void (*f)(void *), void *arg, poolPrioT prio) {
+    if(pool == NULL || f == NULL || prio < 0 || prio >= POOL_PRIOS) {
     	errno = EINVAL;
     	return -1;
     }
 
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {  
-        fprintf(stderr, "ERRORE FATALE lock\n");                
-        return -1;                               
-    }   
-
     int queue_size = abs(pool->queue_size);
     int nopending = (pool->queue_size == -1); // non dobbiamo gestire messaggi pendenti
+    int active = atomic_load(&pool->active);
+    taskfun_t task = { f, arg, (pool->maxthreads > pool->minthreads) ? nowNs() : 0 };
 
-    // coda piena o in fase di uscita
-    if (pool->count >= queue_size || pool->exiting)  {
-        if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-            fprintf(stderr, "ERRORE FATALE unlock\n");              
-            return -1;    
-        } 
+    // in fase di uscita
+    if (atomic_load(&pool->exiting)) {
+        return 1; // esco con valore "coda piena"
+    }
+
+    /* prenoto un posto tra i task pendenti della classe: se non c'e' (coda piena o tutti i thread occupati senza task 
+    pendenti) rinuncio */
+    int lanepending = atomic_fetch_add(&pool->lanepending[prio], 1);
+    int pending = atomic_fetch_add(&pool->pending, 1);
 
+    if (lanepending >= queue_size || (nopending && pending + atomic_load(&pool->taskonthefly) >= active)) {
+        atomic_fetch_sub(&pool->lanepending[prio], 1);
+        atomic_fetch_sub(&pool->pending, 1);
+        atomic_fetch_add_explicit(&pool->rejected, 1, memory_order_relaxed);
         return 1; // esco con valore "coda piena"
     }
-    
-    if (pool->taskonthefly >= pool->numthreads) {
-    	if (nopending) { 
-    	    // tutti i thread sono occupati e non si gestiscono task pendenti
-    	    assert(pool->count == 0);
-    	    
-            if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-                fprintf(stderr, "ERRORE FATALE unlock\n");              
-                return -1;    
-            } 
-
-    	    return 1;  // esco con valore "coda piena"
-    	}
-    } 
-    
-    pool->pending_queue[pool->tail].fun = f;
-    pool->pending_queue[pool->tail].arg = arg;
-    pool->count++;    
-    pool->tail++;
 
-    if (pool->tail >= queue_size) {
-        pool->tail = 0;
+    atomic_fetch_add_explicit(&pool->added, 1, memory_order_relaxed);
+
+    if (prio == POOL_PRIO_HIGH) {
+        atomic_fetch_add_explicit(&pool->urgent, 1, memory_order_relaxed);
+    }
+
+    // aggiorno il massimo numero di task pendenti
+    int max = atomic_load_explicit(&pool->maxpending, memory_order_relaxed);
+    while (pending + 1 > max) {
+        if (atomic_compare_exchange_weak_explicit(&pool->maxpending, &max, pending + 1, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    // coda lock-free: il posto e' gia' stato prenotato, quindi l'inserimento non puo' fallire
+    if (pool->mode == POOL_RING) {
+        if (ringPush(&pool->ring[prio], &task) != 0) {
+            atomic_fetch_sub(&pool->lanepending[prio], 1);
+            atomic_fetch_sub(&pool->pending, 1);
+            return 1;
+        }
+
+        ringWake(pool);
+
+        return 0;
     }
+
+    // assegno il task a un worker in attesa, se c'e', altrimenti alle code dei worker attivi a turno
+    unsigned int start = atomic_fetch_add(&pool->next, 1) % active;
+    workqueue_t *q = &pool->queues[start];
+
+    for (int i = 0; i < pool->numqueues && atomic_load(&pool->idle) > 0; i++) {
+        workqueue_t *w = &pool->queues[(start + i) % pool->numqueues];
+
+        if (atomic_load(&w->parked)) {
+            q = w;
+            break;
+        }
+    }
+
+    if (pthread_mutex_lock(&(q->lock)) != 0) {  
+        fprintf(stderr, "ERRORE FATALE lock\n");                
+        return -1;                               
+    }   
+
+    q->tasks[prio][q->tail[prio]] = task;
+    atomic_fetch_add(&q->lanecount[prio], 1);
+    atomic_fetch_add(&q->count, 1);
+    atomic_fetch_add(&pool->queued[prio], 1);
+    q->tail[prio]++;
+
+    if (q->tail[prio] >= pool->capacity) {
+        q->tail[prio] = 0;
+    }
+    
+    // risveglio il worker al quale e' stato assegnato il task
+    int woken = wakeWorker(q);
+    int r = (woken == 1) ? pthread_cond_signal(&(q->cond)) : 0;
     
-    int r;
-    if ((r=pthread_cond_signal(&(pool->cond))) != 0) {
-        if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
+    if (pthread_mutex_unlock(&(q->lock)) != 0) {  
+        fprintf(stderr, "ERRORE FATALE unlock\n");              
+        return -1;    
+    } 
+
+    // se non era in attesa ma un altro worker lo e' (o si e' appena messo in attesa), risveglio quest'ultimo per rubare il task
+    for (int i = 1; !woken && r == 0 && i < pool->numqueues && atomic_load(&pool->idle) > 0; i++) {
+        workqueue_t *w = &pool->queues[(start + i) % pool->numqueues];
+
+        if (!atomic_load(&w->parked)) {
+            continue;
+        }
+
+        if (pthread_mutex_lock(&(w->lock)) != 0) {  
+            fprintf(stderr, "ERRORE FATALE lock\n");                
+            return -1;                               
+        }   
+
+        // il worker potrebbe essere stato risvegliato nel frattempo
+        woken = wakeWorker(w);
+        r = (woken == 1) ? pthread_cond_signal(&(w->cond)) : 0;
+
+        if (pthread_mutex_unlock(&(w->lock)) != 0) {  
             fprintf(stderr, "ERRORE FATALE unlock\n");              
             return -1;    
         } 
+    }
 
+    if (r != 0) {
         errno = r;
         return -1;
     }
-    
-    if (pthread_mutex_unlock(&(pool->lock)) != 0) {  
-        fprintf(stderr, "ERRORE FATALE unlock\n");              
-        return -1;    
-    } 
 
     return 0;
 }
 
+int threadPoolStats(threadpool_t *pool, poolstats_t *stats) {
+    if (pool == NULL || stats == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    stats->pending = atomic_load(&pool->pending);
+    stats->maxpending = atomic_load(&pool->maxpending);
+    stats->running = atomic_load(&pool->taskonthefly);
+    stats->threads = atomic_load(&pool->active);
+    stats->added = atomic_load(&pool->added);
+    stats->rejected = atomic_load(&pool->rejected);
+    stats->urgent = atomic_load(&pool->urgent);
+    stats->promoted = atomic_load(&pool->promoted);
+
+    // i contatori del controllore sono protetti da ctllock
+    if (pthread_mutex_lock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return -1;
+    }
+
+    stats->peakthreads = pool->peakthreads;
+    stats->grown = pool->grown;
+    stats->shrunk = pool->shrunk;
+
+    if (pthread_mutex_unlock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int setThreadPoolLogger(threadpool_t *pool, void (*fun)(const char *msg, void *arg), void *arg) {
+    if (pool == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (pthread_mutex_lock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE lock\n");
+        return -1;
+    }
+
+    pool->logfun = fun;
+    pool->logarg = arg;
+
+    if (pthread_mutex_unlock(&(pool->ctllock)) != 0) {
+        fprintf(stderr, "ERRORE FATALE unlock\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int threadPoolWorkerId(void) {
+    return workerId;
+}
+
 
 // funzione eseguita dal thread worker che non appartiene al pool
 static void *proxy_thread(void *arg) {    
@@ -301,4 +1054,29 @@ int spawnThread(void (*f)(void*), void* arg) {
     }
     
     return 0;
-}
\ No newline at end of file
+}
+// converte il nome di una modalita' del threadpool nel valore corrispondente
+int parsePoolMode(const char *name) {
+    if (!name) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (int i = 0; i < POOL_MODES; i++) {
+        if (strcasecmp(name, modeNames[i]) == 0) {
+            return i;
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+// restituisce il nome di una modalita' del threadpool
+const char* poolModeName(poolModeT mode) {
+    if (mode < 0 || mode >= POOL_MODES) {
+        return NULL;
+    }
+
+    return modeNames[mode];
+}
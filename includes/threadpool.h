@@ -4,6 +4,7 @@
 #define THREADPOOL_H_
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 /**
  *  @struct taskfun_t
@@ -14,35 +15,189 @@
 typedef struct taskfun_t {
     void (*fun)(void *);
     void *arg;
+    long long enqueued;     // istante di inserimento in ns (solo nei pool a dimensione variabile, per misurare l'attesa)
 } taskfun_t;
 
+#define POOL_SPIN 200       // tentativi di prelievo di un worker della coda lock-free prima di attendere sul futex
+#define POOL_TICK 100       // intervallo (in ms) tra due decisioni del controllore dei pool a dimensione variabile
+#define POOL_MAXDELAY 1000  // attesa media in coda (in us) oltre la quale il controllore aggiunge un worker
+#define POOL_IDLETICKS 50   // intervalli consecutivi con worker inattivi dopo i quali il controllore ne termina alcuni
+#define POOL_HIGHBURST 8    // task urgenti consecutivi dopo i quali un worker preleva un task normale, se c'e'
+
+/**
+ *  @enum poolModeT
+ *  @brief modalita' di gestione dei task pendenti, scelta alla creazione del threadpool
+ */
+typedef enum {
+    POOL_STEALING = 0,  // una coda con lock per ogni worker, i worker senza lavoro rubano i task dalle altre code
+    POOL_RING,          // una coda circolare lock-free condivisa, i worker senza lavoro attendono su un futex
+    POOL_MODES          // numero di modalita'
+} poolModeT;
+
+/**
+ *  @enum poolPrioT
+ *  @brief classi di priorita' dei task: ogni classe ha le proprie code e i worker prelevano prima i task urgenti. Per 
+ *         evitare la starvation dei task normali, dopo POOL_HIGHBURST task urgenti consecutivi un worker preleva un task 
+ *         normale, se c'e'.
+ */
+typedef enum {
+    POOL_PRIO_HIGH = 0, // task brevi che non devono attendere quelli lunghi (es. le operazioni sui metadati dei file)
+    POOL_PRIO_NORMAL,   // tutti gli altri task
+    POOL_PRIOS          // numero di classi
+} poolPrioT;
+
+struct threadpool_t;
+
+/**
+ *  @struct workqueue_t
+ *  @brief coda dei task assegnati a un worker. Il worker preleva i task dalla propria coda e, quando e' vuota, li ruba
+ *         dalle code degli altri worker: ogni coda ha la propria lock, quindi i worker non si contendono una lock unica.
+ *         La struttura e' allineata alla linea di cache, cosi' le code di worker diversi non la condividono.
+ */
+typedef struct workqueue_t {
+    pthread_mutex_t lock;       // mutua esclusione nell'accesso alla coda
+    pthread_cond_t  cond;       // usata per risvegliare il worker proprietario della coda
+    taskfun_t *tasks[POOL_PRIOS];       // buffer circolari dei task, uno per classe di priorita'
+    int head[POOL_PRIOS], tail[POOL_PRIOS]; // riferimenti delle code
+    atomic_int lanecount[POOL_PRIOS];   // numero di task di ogni classe (letto senza lock da chi cerca task da rubare)
+    atomic_int count;           // numero totale di task nella coda
+    atomic_int parked;          // 1 se il worker e' in attesa di un task
+    struct threadpool_t *pool;  // threadpool di appartenenza
+    int id;                     // indice del worker
+} __attribute__((aligned(64))) workqueue_t;
+
+/**
+ *  @struct ringcell_t
+ *  @brief cella della coda lock-free: seq indica se la cella e' libera (seq = posizione di inserimento) o contiene un 
+ *         task (seq = posizione di prelievo + 1)
+ */
+typedef struct ringcell_t {
+    atomic_size_t seq;          // numero di sequenza della cella
+    taskfun_t task;             // task contenuto nella cella
+} ringcell_t;
+
+/**
+ *  @struct taskring_t
+ *  @brief coda circolare lock-free con piu' produttori e piu' consumatori (modalita' POOL_RING, una per classe di 
+ *         priorita'). Le posizioni di inserimento e di prelievo sono su linee di cache diverse, cosi' chi inserisce e 
+ *         chi preleva non se le contendono.
+ */
+typedef struct taskring_t {
+    atomic_size_t enqueuePos __attribute__((aligned(64)));  // prossima posizione di inserimento
+    atomic_size_t dequeuePos __attribute__((aligned(64)));  // prossima posizione di prelievo
+    ringcell_t *cells __attribute__((aligned(64)));         // celle della coda
+    size_t mask;                // numero di celle - 1 (il numero di celle e' una potenza di 2)
+} taskring_t;
+
 /**
  *  @struct threadpool
  *  @brief Rappresentazione dell'oggetto threadpool
  */
 typedef struct threadpool_t {
-    pthread_mutex_t  lock;    // mutua esclusione nell'accesso all'oggetto
-    pthread_cond_t   cond;    // usata per notificare un worker thread 
     pthread_t      * threads; // array di worker id
-    int numthreads;           // numero di thread (size dell'array threads)
-    taskfun_t *pending_queue; // coda interna per task pendenti
-    int queue_size;     // massima size della coda, puo' essere anche -1 ad indicare che non si vogliono gestire task pendenti
-    int taskonthefly;         // numero di task attualmente in esecuzione 
-    int head, tail;           // riferimenti della coda
-    int count;                // numero di task nella coda dei task pendenti
-    int exiting;    // se > 0 e' iniziato il protocollo di uscita, se 1 il thread aspetta che non ci siano piu' lavori in coda
+    poolModeT mode;           // modalita' di gestione dei task pendenti
+    workqueue_t    * queues;  // code dei task, una per worker (POOL_STEALING)
+    taskring_t     * ring;    // code lock-free condivise, una per classe di priorita' (POOL_RING)
+    atomic_uint futex __attribute__((aligned(64)));  // POOL_RING: incrementato a ogni risveglio, i worker in attesa lo osservano
+    atomic_int waking;        // POOL_RING: 1 se un worker e' stato risvegliato e non e' ancora ripartito
+    int spin;                 // tentativi di prelievo dalla coda lock-free prima di attendere (0 con una sola CPU)
+    int numqueues;            // numero di code (size dell'array queues, pari al massimo numero di thread)
+    atomic_int numthreads;    // numero di thread avviati (parte usata dell'array threads)
+    atomic_int active;        // numero di worker attivi: il worker di indice >= active termina
+    int minthreads;           // minimo numero di worker
+    int maxthreads;           // massimo numero di worker (se uguale a minthreads il pool ha dimensione fissa)
+    int peakthreads;          // massimo numero di worker raggiunto
+    size_t grown;             // numero di worker aggiunti dal controllore
+    size_t shrunk;            // numero di worker terminati dal controllore
+    pthread_t controller;     // thread che adatta il numero di worker al carico
+    pthread_mutex_t ctllock;  // protegge le decisioni del controllore e la funzione di log
+    pthread_cond_t ctlcond;   // usata per terminare il controllore
+    void (*logfun)(const char *, void *);   // funzione che registra le decisioni del controllore, puo' essere NULL
+    void *logarg;             // argomento della funzione di log
+    atomic_llong delaysum;    // somma delle attese in coda (in ns) dall'ultima decisione del controllore
+    atomic_size_t delaycount; // numero di task prelevati dall'ultima decisione del controllore
+    int queue_size;     // massima size della coda di ogni classe, puo' essere anche -1 ad indicare che non si vogliono gestire task pendenti
+    int capacity;             // size di ogni coda del POOL_STEALING (i task pendenti potrebbero essere tutti nella stessa)
+    atomic_int pending;       // numero di task pendenti (compresi quelli in fase di inserimento)
+    atomic_int lanepending[POOL_PRIOS];     // numero di task pendenti di ogni classe, limitato da queue_size
+    atomic_int queued[POOL_PRIOS];          // numero di task di ogni classe presenti nelle code
+    atomic_int taskonthefly;  // numero di task attualmente in esecuzione
+    atomic_int idle;          // numero di worker in attesa di un task
+    atomic_uint next;         // coda alla quale assegnare il prossimo task se nessun worker e' in attesa
+    atomic_int exiting; // se > 0 e' iniziato il protocollo di uscita, se 1 il thread aspetta che non ci siano piu' lavori in coda
+    atomic_int maxpending;    // massimo numero di task pendenti raggiunto
+    atomic_size_t added;      // numero di task aggiunti
+    atomic_size_t urgent;     // numero di task aggiunti con priorita' POOL_PRIO_HIGH
+    atomic_size_t promoted;   // task normali prelevati prima di task urgenti in attesa, per evitarne la starvation
+    atomic_size_t rejected;   // numero di aggiunte rifiutate perche' la coda era piena (o tutti i thread occupati)
 } threadpool_t;
 
+/**
+ *  @struct poolstats_t
+ *  @brief statistiche del threadpool, per controllare il carico di chi aggiunge i task
+ */
+typedef struct poolstats_t {
+    int pending;              // task pendenti (profondita' attuale della coda)
+    int maxpending;           // massimo numero di task pendenti raggiunto
+    int running;              // task attualmente in esecuzione
+    int threads;              // numero attuale di worker
+    int peakthreads;          // massimo numero di worker raggiunto
+    size_t grown;             // worker aggiunti dal controllore
+    size_t shrunk;            // worker terminati dal controllore
+    size_t added;             // task aggiunti
+    size_t urgent;            // task aggiunti con priorita' POOL_PRIO_HIGH
+    size_t promoted;          // task normali prelevati prima di task urgenti in attesa (protezione dalla starvation)
+    size_t rejected;          // aggiunte rifiutate perche' la coda era piena
+} poolstats_t;
+
 /**
  * @function createThreadPool
  * @brief Crea un oggetto thread pool.
- * @param numthreads è il numero di thread del pool
+ * @param numthreads è il numero di thread del pool (il minimo, se il pool ha dimensione variabile)
+ * @param maxthreads è il massimo numero di thread del pool. Se è maggiore di numthreads un thread controllore, ogni 
+ *        POOL_TICK ms, aggiunge worker quando i task pendenti superano i worker o la loro attesa media in coda supera 
+ *        POOL_MAXDELAY us, e li termina (fino a numthreads) quando restano inattivi per POOL_IDLETICKS intervalli.
  * @param pending_size è la size delle richieste che possono essere pendenti. 
  *        Questo parametro è 0 se si vuole utilizzare un modello per il pool con 1 thread 1 richiesta, 
  *        cioe' non ci sono richieste pendenti.
+ * @param mode è la modalita' di gestione dei task pendenti: POOL_STEALING (una coda per worker) o POOL_RING (una coda 
+ *        lock-free condivisa, con latenza minore per i task brevi)
  * @return un nuovo thread pool oppure NULL ed errno settato opportunamente
  */
-threadpool_t *createThreadPool(int numthreads, int pending_size);
+threadpool_t *createThreadPool(int numthreads, int maxthreads, int pending_size, poolModeT mode);
+
+/**
+ * @function setThreadPoolLogger
+ * @brief imposta la funzione con la quale il controllore registra le proprie decisioni (un messaggio terminato da '\n')
+ * @param pool oggetto thread pool
+ * @param fun funzione di log, NULL per non registrare le decisioni
+ * @param arg argomento passato alla funzione di log
+ * @return 0 se successo, -1 in caso di fallimento, errno viene settato opportunamente.
+ */
+int setThreadPoolLogger(threadpool_t *pool, void (*fun)(const char *msg, void *arg), void *arg);
+
+/**
+ * @function threadPoolWorkerId
+ * @brief restituisce l'indice (da 0) del worker che la chiama, stabile anche se il numero di worker varia
+ * @return l'indice del worker, -1 se chi la chiama non e' un worker di un thread pool
+ */
+int threadPoolWorkerId(void);
+
+/**
+ * @function parsePoolMode
+ * @brief Converte il nome di una modalita' del threadpool ("stealing", "ring") nel valore corrispondente.
+ * @param name nome della modalita' (non case sensitive)
+ * @return modalita' corrispondente, -1 se il nome non e' valido (errno = EINVAL)
+ */
+int parsePoolMode(const char *name);
+
+/**
+ * @function poolModeName
+ * @brief Restituisce il nome di una modalita' del threadpool.
+ * @param mode modalita' della quale si vuole il nome
+ * @return nome della modalita', NULL se non valida
+ */
+const char* poolModeName(poolModeT mode);
 
 /**
  * @function destroyThreadPool
@@ -56,8 +211,9 @@ int destroyThreadPool(threadpool_t *pool, int force);
 
 /**
  * @function addTaskToThreadPool
- * @brief aggiunge un task al pool, se ci sono thread liberi il task viene assegnato ad uno di questi, 
- *        se non ci sono thread liberi e pending_size > 0 allora si cerca di inserire il task come task pendente. 
+ * @brief aggiunge un task al pool, se ci sono thread liberi il task viene assegnato ad uno di questi (che viene risvegliato), 
+ *        se non ci sono thread liberi e pending_size > 0 allora si cerca di inserire il task come task pendente nella coda
+ *        di uno dei worker, dalla quale potra' essere rubato da un altro worker che resta senza lavoro. 
  *        Se non c'e' posto nella coda interna allora la chiamata fallisce. 
  * @param pool oggetto thread pool
  * @param fun  funzione da eseguire per eseguire il task
@@ -66,6 +222,29 @@ int destroyThreadPool(threadpool_t *pool, int force);
  */
 int addToThreadPool(threadpool_t *pool, void (*fun)(void *),void *arg);
 
+/**
+ * @function addToThreadPoolPrio
+ * @brief come addToThreadPool (che aggiunge i task con priorita' POOL_PRIO_NORMAL), ma con la classe di priorita' prio.
+ *        Ogni classe ha una coda di pending_size task, quindi i task urgenti non vengono rifiutati perche' la coda e'
+ *        piena di task normali.
+ * @param pool oggetto thread pool
+ * @param fun  funzione da eseguire per eseguire il task
+ * @param arg  argomento della funzione
+ * @param prio classe di priorita' del task
+ * @return 0 se successo, 1 se non ci sono thread disponibili e/o la coda è piena, -1 in caso di fallimento, errno viene settato opportunamente.
+ */
+int addToThreadPoolPrio(threadpool_t *pool, void (*fun)(void *), void *arg, poolPrioT prio);
+
+
+/**
+ * @function threadPoolStats
+ * @brief copia le statistiche del pool (i valori sono letti senza lock, quindi possono essere gia' cambiati)
+ * @param pool oggetto thread pool
+ * @param stats struttura nella quale copiare le statistiche
+ * @return 0 se successo, -1 in caso di fallimento, errno viene settato opportunamente.
+ */
+int threadPoolStats(threadpool_t *pool, poolstats_t *stats);
+
 
 /**
  * @function spawnThread
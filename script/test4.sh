@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# batch e pipelining: avvia il server con la configurazione in config/config.txt, esegue i casi di test e controlla
+# gli esiti. Restituisce 1 se almeno un controllo fallisce
+
+OUT=$(mktemp -d)
+FAILED=0
+
+# stampa l'esito di un controllo (il primo argomento e' il codice di uscita del controllo)
+check() {
+	if [ $1 -eq 0 ]; then
+		echo "$2: ok"
+	else
+		echo "$2: FALLITO"
+		FAILED=1
+	fi
+}
+
+./server > $OUT/server.txt 2>&1 &
+SERVER=$!
+sleep 1
+
+# un batch di scrittura (open, write e close concatenate) su un file gia' esistente: la open fallisce, quindi la write
+# e la close vengono annullate, mentre il file successivo del batch e la lettura seguente vanno a buon fine
+./client -f mysock -W test/file1.txt > $OUT/client1.txt 2>&1
+./client -f mysock -W test/file1.txt,test/file2.txt -r test/file2.txt -d $OUT/letti -p > $OUT/client2.txt 2>&1
+
+grep -a -q "test/file1.txt *Esito: errore" $OUT/client2.txt
+check $? "batch: open di un file esistente fallita"
+grep -a -q "test/file2.txt *Esito: ok" $OUT/client2.txt && grep -a -q "test/file2.txt *Dimensione: 33 B.*Esito: ok" $OUT/client2.txt
+check $? "batch: scrittura e lettura del file successivo"
+cmp -s $OUT/letti/test-file2.txt test/file2.txt
+check $? "batch: contenuto letto"
+
+# pipelining: le risposte devono arrivare nell'ordine delle richieste (le api verificano l'id di ogni risposta e
+# pipelineWait fallisce altrimenti), con fino a 64 richieste in volo su una sola connessione
+./bench pipeline mysock 2000 64 > $OUT/pipeline.txt 2>&1
+check $? "pipelining: risposte nell'ordine delle richieste"
+
+# termino il server, cosi' il file di log e' completo
+kill -1 $SERVER
+wait $SERVER
+check $? "terminazione del server"
+
+[ $(grep -a -c "test/file1.txt) annullata" logs/logs.txt) -eq 2 ]
+check $? "batch: write e close concatenate annullate"
+
+rm -rf $OUT
+exit $FAILED
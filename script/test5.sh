@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# politiche di rimpiazzamento e modalita' della threadpool: per ogni configurazione avvia il server, esegue il carico di
+# test2.sh (con pochi file nello storage, quindi con molte espulsioni), poi scrive e rilegge un file e controlla che il
+# contenuto sia corretto e che il server termini senza errori. Restituisce 1 se almeno un controllo fallisce
+
+OUT=$(mktemp -d)
+FAILED=0
+
+# stampa l'esito di un controllo (il primo argomento e' il codice di uscita del controllo)
+check() {
+	if [ $1 -eq 0 ]; then
+		echo "$2: ok"
+	else
+		echo "$2: FALLITO"
+		FAILED=1
+	fi
+}
+
+# esegue il carico con la configurazione passata come argomento (righe da aggiungere a quella di test2)
+run() {
+	printf "threadpoolSize:4\npendingQueueSize:100\nsockName:mysock\nmaxFiles:10\nmaxSize:1000\nqueueShards:4\n$1logFile:logs" > config/config.txt
+	rm -rf $OUT/letti
+
+	./server > $OUT/server.txt 2>&1 &
+	SERVER=$!
+	sleep 1
+
+	./script/test2.sh > $OUT/carico.txt 2>&1
+	./client -f mysock -W test/filepesante,test/filemedio -r test/filemedio,test/filepesante -d $OUT/letti > $OUT/client.txt 2>&1
+	cmp -s $OUT/letti/test-filemedio test/filemedio && cmp -s $OUT/letti/test-filepesante test/filepesante
+	check $? "$2: contenuto riletto"
+
+	kill -1 $SERVER
+	wait $SERVER
+	check $? "$2: terminazione del server"
+
+	grep -a -q "$3" $OUT/server.txt
+	check $? "$2: configurazione applicata"
+
+	grep -a -q "che ha causato un capacity miss" logs/logs.txt
+	check $? "$2: file espulsi"
+}
+
+for POLICY in FIFO LRU CLOCK LFU 2Q ARC GDSF; do
+	run "evictionPolicy:$POLICY\n" "$POLICY" "Politica di rimpiazzamento = $POLICY"
+done
+
+run "threadpoolMode:ring\n" "ring" "= ring"
+run "threadpoolMode:ring\nthreadpoolMax:8\nevictionPolicy:CLOCK\n" "ring adattiva, CLOCK" "= ring"
+
+rm -rf $OUT Rdir Wdir
+exit $FAILED
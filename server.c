@@ -13,15 +13,27 @@
 #include <assert.h>
 #include <stdatomic.h>
 #include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <poll.h>
 
 // librerie in /includes
 #include <threadpool.h>
 #include <fileQueue.h>
 #include <partialIO.h>
+#include <protocol.h>
 
 #define UNIX_PATH_MAX 108 
-#define CMDSIZE 256
+#define CMDSIZE PROTO_CMDSIZE
+#define REQSIZE (CMDSIZE + PROTO_MAXPATH + 1)	// dimensione del buffer di una richiesta (testuale o binaria)
+#define INBUFSIZE (2 * REQSIZE)	// dimensione del buffer di ricezione di ogni connessione
 #define BUFSIZE 1000000	// 10KB
+#define SENDFILE_IOV 64	// numero massimo di buffer inviati con una sola writev
+#define STREAMSIZE (64 * 1024)	// dimensione dei blocchi con cui viene ricevuto il contenuto di write e append
+#define MAXEVENTS 64	// numero massimo di eventi restituiti da una epoll_wait
+#define MAXBURST 16		// numero massimo di richieste gia' arrivate servite da un worker prima di riattivare il client
+#define MAXFDS 1024		// numero di descrittori gestiti se il limite del processo non e' noto
 #define LOGLINESIZE 512
 //#define DEBUG
 
@@ -41,18 +53,62 @@ typedef struct struct_waiting {
 	struct struct_waiting *next;	// puntatore al prossimo elemento della lista
 } waitingT;
 
-// struttura dati che contiene gli argomenti da passare ai worker threads
+/**
+ * Bytes ricevuti da un client e non ancora consumati. Con il pipelining (protocollo v3) una sola read puo' ricevere piu'
+ * richieste: quelle successive restano nel buffer e vengono servite prima di leggere di nuovo dal socket.
+ */
+typedef struct {
+	char buf[INBUFSIZE];
+	size_t start;			// primo byte non ancora consumato
+	size_t end;				// fine dei bytes ricevuti
+} inputT;
+
+// struttura dati che contiene gli argomenti da passare ai worker threads: una per ogni client connesso
 typedef struct struct_thread {
-	long *args;
+	long args[4];			// descrittore del client, puntatore al flag quit, closePipe e descrittore di epoll
+	inputT in;				// bytes ricevuti dal client e non ancora consumati
 	queueT *queue;			// puntatore alla coda dei file nello storage
 	logT *logFileT;			// puntatore alla struct del file di log
 	threadpool_t *pool;		// puntatore alla threadpool
+	poolPrioT prio;			// classe di priorita' della richiesta per la quale il client e' stato assegnato a un worker
+	struct struct_backlog *backlog;	// client rimandati dal manager (vedi backlogT)
 	pthread_mutex_t *lock;	
 	waitingT **waiting;		// puntatore alla coda dei client in attesa di ottenere la lock su un file
 } threadT;
 
+/**
+ * Client con una richiesta pronta che il manager non ha potuto assegnare a un worker perche' la coda della threadpool era
+ * piena, in ordine di arrivo. Restano disattivati su epoll (EPOLLONESHOT) e vengono riproposti alla threadpool appena si 
+ * libera un posto; finche' la coda non si svuota il manager non accetta nuove connessioni. Il worker che prende un task 
+ * mentre waiting e' settato sveglia il manager scrivendo su efd, registrato su epoll.
+ */
+typedef struct struct_backlog {
+	int *fds;				// descrittori dei client (coda circolare di maxFds elementi)
+	size_t size;			// dimensione di fds
+	size_t head;			// posizione del primo client
+	size_t len;				// numero di client rimandati
+	size_t deferred;		// numero totale di volte in cui un client e' stato rimandato
+	size_t maxLen;			// massimo numero di client rimandati contemporaneamente
+	size_t pauses;			// numero di volte in cui e' stata sospesa l'accettazione delle nuove connessioni
+	int paused;				// 1 se l'accettazione delle nuove connessioni e' sospesa
+	int efd;				// eventfd con cui i worker notificano al manager che si e' liberato un posto nella threadpool
+	atomic_int waiting;		// 1 se il manager attende la notifica su efd per riproporre i client rimandati
+} backlogT;
+
+static pthread_key_t streamKey;							// buffer di ricezione di ogni worker (vedi streamBuffer)
+static pthread_once_t streamOnce = PTHREAD_ONCE_INIT;
+
 // funzioni dei thread worker e del thread che gestisce i segnali
 static void serverThread(void *par);
+static int needInput(long fd_c, inputT *in, size_t n);
+static int takeInput(long fd_c, inputT *in, void *dst, size_t n);
+static int readRequest(long fd_c, inputT *in, char *buf, requestT *req);
+static int receiveContent(long fd_c, inputT *in, queueT *queue, char *filepath, size_t size, int replace, reservationT *res);
+static int discardContent(long fd_c, inputT *in, size_t size);
+static void rearmClient(int epfd, long fd_c, int pending);
+static poolPrioT requestPriority(threadT *t);
+static int dispatchClient(threadpool_t *pool, threadT *t);
+static void* streamBuffer(void);
 static void* sigThread(void *par);
 
 // funzioni per la gestione della lista d'attesa per le lock
@@ -60,38 +116,54 @@ int addWaiting(waitingT **waiting, char *file, int fd);
 int removeFirstWaiting(waitingT **waiting, char *file);
 void clearWaiting(waitingT **waiting);
 
+// funzioni del manager per il controllo del carico (backpressure)
+static void deferClient(backlogT *backlog, int fd, int epfd, int fd_skt, logT *logFileT);
+static int drainBacklog(backlogT *backlog, threadpool_t *pool, threadT **conns, int epfd, int fd_skt, logT *logFileT);
+static int pauseAccept(int epfd, int fd_skt, int pause);
+
 // funzioni per il file di log e le statistiche
 int writeLog(logT *logFileT, char *logString);
 int updateStats(logT *logFileT, queueT *queue, int miss);
-void printStats(logT *logFileT);
-
-int parser(char *command, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
-
-// procedure chiamate dal parser, corrispondenti ai comandi inviati dal client
-void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFileT);
-void readFile(char *filepath, queueT *queue, long fd_c, logT *logFileT);
-void readNFiles(char *numStr, queueT *queue, long fd_c, logT *logFileT);
-void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logFileT, int append);
-void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
-void unlockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
-void closeFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
-void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
-
-// funzione ausiliaria
-int sendFile(fileT *f, long fd_c, logT *logFileT);
+void printStats(logT *logFileT, queueT *queue);
+void printLoadStats(logT *logFileT, poolstats_t *poolStats, backlogT *backlog);
+void logPoolDecision(const char *msg, void *logFileT);
+
+int parser(requestT *req, threadT *t);
+poolPrioT opPriority(int op, int flags);
+
+// procedure chiamate dal parser, corrispondenti ai comandi inviati dal client (quelle che restituiscono un int
+// restituiscono -1 se hanno risposto al client con un errore)
+void hello(int version, long fd_c, logT *logFileT);
+int openFile(char *filepath, int flags, queueT *queue, long fd_c, int version, logT *logFileT);
+int readFile(char *filepath, queueT *queue, long fd_c, int version, logT *logFileT);
+void readNFiles(int n, queueT *queue, long fd_c, int version, logT *logFileT);
+int writeFile(char *filepath, size_t size, queueT *queue, long fd_c, inputT *in, int version, logT *logFileT, int append);
+int lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
+int unlockFile(char *filepath, queueT *queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
+int closeFile(char *filepath, queueT *queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
+int removeFile(char *filepath, queueT* queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting);
+int batch(long n, int version, threadT *t);
+
+// funzioni ausiliarie
+int sendFile(fileT *f, long fd_c, int version, logT *logFileT);
+int sendEnd(long fd_c, int version);
 
 int main(int argc, char *argv[]) {
-	int fd_skt, fd_c, fd_max;
+	int fd_skt, fd_c, epfd;
 	struct sockaddr_un sa;
 	sigset_t sigset;
 	struct sigaction siga;
 	char sockName[256] = "./mysock";		// nome del socket
 	char logName[256] = "logs/log.txt";		// nome del file di log
 	int threadpoolSize = 1;					// numero di thread workers nella threadPool
+	int threadpoolMax = 0;					// massimo numero di thread workers (se maggiore di threadpoolSize la threadPool si adatta al carico)
 	int pendingQueueSize = 1;				// dimensione della coda d'attesa della threadPool
+	poolModeT threadpoolMode = POOL_STEALING;	// modalita' di gestione dei task pendenti della threadPool
 	size_t maxFiles = 1;					// massimo numero di file supportati
 	size_t maxSize = 1;						// massima dimensione supportata (in bytes)
-	int sigPipe[2], requestPipe[2];			// pipe di comunicazione tra il main e il thread worker/signal handler
+	size_t queueShards = 1;					// numero di shard (partizioni con lock indipendenti) della coda di file
+	policyT evictionPolicy = POLICY_FIFO;	// politica di rimpiazzamento dei file nello storage
+	int sigPipe[2], closePipe[2];			// pipe di comunicazione tra il main e il signal handler/thread worker
 	FILE *configFile;						// file di configurazione per il server
 	FILE *logFile;							// file di log
 	pthread_mutex_t lock;					// lock per le funzioni che operano sul flag O_LOCK dei file
@@ -131,6 +203,36 @@ int main(int argc, char *argv[]) {
 
 	remove("mysock");
 
+	// ogni client connesso occupa un descrittore: alzo il limite soft al massimo consentito
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			perror("setrlimit");
+		}
+	}
+
+	/**
+	 * argomenti dei worker, indicizzati dal descrittore del client: vengono allocati quando il client si connette e
+	 * riusati per tutte le sue richieste, quindi assegnare una richiesta a un worker non richiede allocazioni
+	 */
+	size_t maxFds = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) ? rl.rlim_cur : MAXFDS;
+	threadT **conns = NULL;
+
+	if ((conns = calloc(maxFds, sizeof(threadT*))) == NULL) {
+		perror("calloc conns");
+		return 1;
+	}
+
+	// ogni client puo' essere rimandato una sola volta (resta disattivato finche' non viene assegnato a un worker)
+	backlogT backlog = {0};
+	backlog.size = maxFds;
+
+	if ((backlog.fds = malloc(maxFds * sizeof(int))) == NULL) {
+		perror("malloc backlog");
+		return 1;
+	}
+
 	// stampo messaggio d'introduzione
 	printf("File Storage Server avviato.\n");
 	fflush(stdout);
@@ -174,6 +276,22 @@ int main(int argc, char *argv[]) {
 			fflush(stdout);
 		}
 
+		// configuro il massimo numero di worker della threadpool
+		else if (strcmp("threadpoolMax", option) == 0) {
+			threadpoolMax = strtol(value, NULL, 0);
+
+			if (threadpoolMax <= 0) {
+				printf("Errore di configurazione: il massimo numero di worker della threadPool dev'essere maggiore o uguale a 1.\n");
+				fflush(stdout);
+				free(option);
+				fclose(configFile);	// chiudo il file di configurazione
+				return 1;
+			}
+
+			printf("CONFIG: Massimo numero di worker della threadPool = %d\n", threadpoolMax);
+			fflush(stdout);
+		}
+
 		// configuro la dimensione della coda d'attesa della threadpool
 		else if (strcmp("pendingQueueSize", option) == 0) {
 			pendingQueueSize = strtol(value, NULL, 0);
@@ -190,6 +308,25 @@ int main(int argc, char *argv[]) {
 			fflush(stdout);
 		}
 
+		// configuro la modalita' della threadpool
+		else if (strcmp("threadpoolMode", option) == 0) {
+			value[strcspn(value, "\n")] = 0;	// rimuovo la newline dal nome della modalita'
+			int mode = parsePoolMode(value);
+
+			if (mode == -1) {
+				printf("Errore di configurazione: modalita' della threadpool '%s' non riconosciuta (stealing, ring).\n", value);
+				fflush(stdout);
+				free(option);
+				fclose(configFile);
+				return 1;
+			}
+
+			threadpoolMode = (poolModeT) mode;
+
+			printf("CONFIG: Modalita' della threadPool = %s\n", poolModeName(threadpoolMode));
+			fflush(stdout);
+		}
+
 		// configuro il nome del socket
 		else if (strcmp("sockName", option) == 0) {
 			strncpy(sockName, value, 256);
@@ -231,6 +368,43 @@ int main(int argc, char *argv[]) {
 			fflush(stdout);
 		}
 
+		// configuro il numero di shard della coda di file
+		else if (strcmp("queueShards", option) == 0) {
+			long shards = strtol(value, NULL, 0);
+
+			if (shards <= 0) {
+				printf("Errore di configurazione: il numero di shard della coda dev'essere maggiore o uguale a 1.\n");
+				fflush(stdout);
+				free(option);
+				fclose(configFile);
+				return 1;
+			}
+
+			queueShards = (size_t) shards;
+
+			printf("CONFIG: Numero di shard della coda = %zu\n", queueShards);
+			fflush(stdout);
+		}
+
+		// configuro la politica di rimpiazzamento
+		else if (strcmp("evictionPolicy", option) == 0) {
+			value[strcspn(value, "\n")] = 0;	// rimuovo la newline dal nome della politica
+			int policy = parsePolicy(value);
+
+			if (policy == -1) {
+				printf("Errore di configurazione: politica di rimpiazzamento '%s' non riconosciuta (FIFO, LRU, CLOCK, LFU, 2Q, ARC).\n", value);
+				fflush(stdout);
+				free(option);
+				fclose(configFile);
+				return 1;
+			}
+
+			evictionPolicy = (policyT) policy;
+
+			printf("CONFIG: Politica di rimpiazzamento = %s\n", policyName(evictionPolicy));
+			fflush(stdout);
+		}
+
 		// configuro il nome del file nel quale verranno scritti i logs
 		else if (strcmp("logFile", option) == 0) {
 
@@ -331,9 +505,15 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	// creo la pipe di comunicazione fra i thread worker e il manager
-	if (pipe(requestPipe) == -1) {
-		perror("requestPipe");
+	// creo la pipe con cui i thread worker comunicano al manager la chiusura di una connessione
+	if (pipe(closePipe) == -1) {
+		perror("closePipe");
+		return 1;
+	}
+
+	// e l'eventfd con cui segnalano che si e' liberato un posto nella coda della threadpool
+	if ((backlog.efd = eventfd(0, EFD_NONBLOCK)) == -1) {
+		perror("eventfd");
 		return 1;
 	}
 
@@ -345,17 +525,30 @@ int main(int argc, char *argv[]) {
 	}
 
 	// creo la coda di file
-	queueT *queue = createQueue(maxFiles, maxSize);
+	queueT *queue = createQueue(maxFiles, maxSize, queueShards, evictionPolicy);
+
+	if (!queue) {
+		perror("createQueue.\n");
+		return 1;
+	}
 
 	// creo la threadpool
 	threadpool_t *pool = NULL;
-	pool = createThreadPool(threadpoolSize, pendingQueueSize);
+	// senza threadpoolMax (o con un valore minore di threadpoolSize) la threadpool ha dimensione fissa
+	threadpoolMax = (threadpoolMax < threadpoolSize) ? threadpoolSize : threadpoolMax;
+	pool = createThreadPool(threadpoolSize, threadpoolMax, pendingQueueSize, threadpoolMode);
 
 	if (!pool) {
 		perror("createThreadPool.\n");
 		return 1;
 	}
 
+	// le decisioni del controllore della threadpool vengono registrate sul file di log
+	if (setThreadPoolLogger(pool, logPoolDecision, logFileT) == -1) {
+		perror("setThreadPoolLogger.\n");
+		return 1;
+	}
+
 	// scrivo sul logFile
 	char newTPoolStr[128] = "Creata threadpool di dimensione ";
 	char tPoolSizeStr[64];
@@ -370,276 +563,278 @@ int main(int argc, char *argv[]) {
 	// creo la lista che conterra' i client in attesa di ottenere la lock su un file
 	waitingT *waiting = NULL;
 
-	fd_set set, tmpset;
-	FD_ZERO(&set);
-	FD_ZERO(&tmpset);
-	FD_SET(fd_skt, &set);			// al set da ascoltare aggiungo: il socket,
-	FD_SET(sigPipe[0], &set);		// l'fd di lettura della pipe fra sigThread e il manager,
-	FD_SET(requestPipe[0], &set);	// e quello della pipe fra i worker e il manager
-
-	// controllo quale fd ha id maggiore
-	fd_max = fd_skt;
-	if (sigPipe[0] > fd_max) {
-		fd_max = fd_skt;
+	/**
+	 * il manager attende gli eventi con epoll: il socket e le due pipe restano sempre registrati, mentre i client sono 
+	 * registrati con EPOLLONESHOT. Quando un client ha una richiesta pronta, epoll lo disattiva automaticamente finche' 
+	 * il worker che la serve non lo riattiva direttamente (epoll_ctl e' thread-safe), quindi la richiesta di un client 
+	 * non puo' essere consegnata a due worker e il manager si occupa solo delle nuove connessioni, delle chiusure e dei 
+	 * segnali. Il costo di ogni attesa dipende solo dal numero di eventi, non dal numero di client connessi.
+	 */
+	if ((epfd = epoll_create1(0)) == -1) {
+		perror("epoll_create1");
+		return 1;
 	}
 
-	if (requestPipe[0] > fd_max) {
-		fd_max = requestPipe[0];
+	struct epoll_event ev;
+	struct epoll_event events[MAXEVENTS];
+	int managerFds[4] = {fd_skt, sigPipe[0], closePipe[0], backlog.efd};	// il socket, le pipe fra sigThread/worker e manager, e l'eventfd
+
+	for (int i = 0; i < 4; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = managerFds[i];
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, managerFds[i], &ev) == -1) {
+			perror("epoll_ctl");
+			return 1;
+		}
 	}
 
 	while (!quit) {
-		// copio il set nella variabile temporanea. Bisogna inizializzare ogni volta perché select modifica tmpset
-		tmpset = set;
+		/* ripropongo alla threadpool i client rimandati: se ne restano, il primo worker che prende un task dalla coda 
+		mi sveglia tramite l'eventfd */
+		int closed = drainBacklog(&backlog, pool, conns, epfd, fd_skt, logFileT);
+		numberOfConnections -= closed;
+
+		if (closed > 0 && stopIncomingConnections && numberOfConnections <= 0) {
+			quit = 1;
+			pthread_cancel(st);	// termino il signalThread
+			break;
+		}
+
+		int nfds = epoll_wait(epfd, events, MAXEVENTS, -1);
 
-		// fd_max+1 è il numero dei descrittori attivi
-		if (select(fd_max+1, &tmpset, NULL, NULL, NULL) == -1) {
-			perror("select server main");
+		if (nfds == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			perror("epoll_wait server main");
 			return 1;
 		}
 
-		// la select ha avuto successo
-		else { 
-			// controllo da quale fd ho ricevuto la richiesta
-			for (int fd = 0; fd <= fd_max; fd++) {
-				if (FD_ISSET(fd, &tmpset)) {
-					// se l'ho ricevuta dal sock connect, è una nuova richiesta di connessione
-					if (fd == fd_skt) {
-						if (!stopIncomingConnections) {
-							if ((fd_c = accept(fd_skt, NULL, 0)) == -1) {
-								perror("accept");
-								return 1;
-							}
-
-							#ifdef DEBUG
-							printf("Nuovo client connesso. fd_c = %d\n", fd_c);
-							fflush(stdout);
-							#endif
-
-							// Scrivo sul logFile
-							char newConStr[25] = "Nuovo client: ";
-							char fdStr[128];
-							snprintf(fdStr, sizeof(int)+1, "%d", fd_c);
-							strncat(newConStr, fdStr, strlen(fdStr)+1);
-							strncat(newConStr, "\n", 2);
-							if (writeLog(logFileT, newConStr) == -1) {
-								perror("writeLog");
-								return -1;
-							}
-
-							// creo ed inizializzo la struct da passare come argomento al thread worker
-							threadT *t = calloc(1, sizeof(threadT));
-							t->args = calloc(1, 3*sizeof(long));
-							t->args[0] = fd_c;
-			    			t->args[1] = (long) &quit;
-			    			t->args[2] = (long) requestPipe[1];
-			    			t->queue = queue;
-			    			t->logFileT = logFileT;
-			    			t->pool = pool;
-			    			t->lock = &lock;
-			    			t->waiting = &waiting;
-
-							int r = addToThreadPool(pool, serverThread, (void*) t);
-
-							// task aggiunto alla pool con successo
-							if (r == 0) {
-								#ifdef DEBUG
-								printf("Task aggiunto alla pool da una nuove connessione: %d\n", fd_c);
-								fflush(stdout);
-								#endif
-
-								numberOfConnections++;
-								continue;
-							}
-
-							// errore interno
-							else if (r < 0) {
-								perror("addToThreadPool");
-							}
-
-							// coda pendenti piena
-							else {
-								#ifdef DEBUG
-								perror("Coda pendenti piena");
-								#endif
-							}
-
-							if (t->args) {
-								free(t->args);
-							}
-
-							if (t) {
-								free(t);
-							}
-
-							close(fd_c);
-						}
-
-						else {
-							#ifdef DEBUG
-							printf("Nuova connessione rifiutata: il server e' in fase di terminazione.\n");
-							fflush(stdout);
-							#endif
-
-							FD_CLR(fd, &set);
-							close(fd);
-						}
+		// servo gli eventi ricevuti
+		for (int i = 0; i < nfds && !quit; i++) {
+			int fd = events[i].data.fd;
 
-						continue;
+			// se l'ho ricevuta dal sock connect, è una nuova richiesta di connessione
+			if (fd == fd_skt) {
+				// l'evento potrebbe essere arrivato prima che l'accettazione venisse sospesa
+				if (backlog.paused) {
+					continue;
+				}
+
+				if (!stopIncomingConnections) {
+					if ((fd_c = accept(fd_skt, NULL, 0)) == -1) {
+						perror("accept");
+						return 1;
 					}
 
-					// se l'ho ricevuta dalla requestPipe, una richiesta singola è stata servita
-					else if (fd == requestPipe[0]) {
-						// leggo il descrittore dalla pipe
-						int fdr;
-						if (readn(requestPipe[0], &fdr, sizeof(int)) == -1) {
-							perror("readn");
-							break;
-						}
-
-						// se il worker thread ha chiuso la connessione...
-						if (fdr == -1) {
-							#ifdef DEBUG
-							printf("Il worker thread ha chiuso la connessione con un client.\n");
-							fflush(stdout);
-							#endif
-
-							numberOfConnections--;
-
-							#ifdef DEBUG
-							printf("numberOfConnections = %d\n", numberOfConnections);
-							fflush(stdout);
-							#endif
-
-							// ...controllo se devo terminare il server
-							if (stopIncomingConnections && numberOfConnections <= 0) {
-								#ifdef DEBUG
-								printf("Non ci sono altri client connessi, termino.\n");
-								fflush(stdout);
-								#endif
-								quit = 1;
-								pthread_cancel(st);	// termino il signalThread
-							}
-
-							break;
-						}
-
-						#ifdef DEBUG
-						printf("Una richiesta singola del client %d e' stata servita.\n", fdr);
-						fflush(stdout);
-						#endif
-
-						// altrimenti riaggiungo il descrittore al set, in modo che possa essere servito nuovamente
-						FD_SET(fdr, &set);
-
-						
-						if (fdr > fd_max) {
-							fd_max = fdr;
-						}
-
-						continue;	
+					#ifdef DEBUG
+					printf("Nuovo client connesso. fd_c = %d\n", fd_c);
+					fflush(stdout);
+					#endif
+
+					// Scrivo sul logFile
+					char newConStr[25] = "Nuovo client: ";
+					char fdStr[128];
+					snprintf(fdStr, sizeof(int)+1, "%d", fd_c);
+					strncat(newConStr, fdStr, strlen(fdStr)+1);
+					strncat(newConStr, "\n", 2);
+					if (writeLog(logFileT, newConStr) == -1) {
+						perror("writeLog");
+						return -1;
 					}
 
-					/* se l'ho ricevuta dalla sigPipe, controllo se devo terminare immediatamente 
-					o solo smettere di accettare nuove connessioni */
-					else if (fd == sigPipe[0]) {
-						int code;
-						if (readn(sigPipe[0], &code, sizeof(int)) == -1) {
-							perror("readn");
-							break;
-						}
-
-						if (code == 0) {
-							stopIncomingConnections = 1;
-
-							#ifdef DEBUG
-							printf("Ricevuto un segnale di stop alle nuove connessioni.\n");
-							printf("Numero di connessioni attive: %d\n", numberOfConnections);
-							fflush(stdout);
-							#endif
-
-							if (numberOfConnections == 0) {
-								quit = 1;
-								pthread_cancel(st);	// termino il signalThread
-							}
-						}
-
-						else if (code == 1) {
-							#ifdef DEBUG
-							printf("Ricevuto un segnale di terminazione immediata.\n");
-							fflush(stdout);
-							#endif
-
-							quit = 1;
-						}
-
-						else {
-							perror("Errore: codice inviato dal sigThread invalido.\n");
-						}
-						
-						break;
+					// creo ed inizializzo la struct da passare come argomento ai worker che serviranno il client
+					threadT *t = ((size_t) fd_c < maxFds) ? calloc(1, sizeof(threadT)) : NULL;
+
+					if (!t) {
+						perror("calloc threadT");
+						close(fd_c);
+						continue;
 					}
 
-					// altrimenti è una richiesta di I/O da un client già connesso
-					else {
-						FD_CLR(fd, &set);
-
-						if (fd > fd_max) {
-							fd_max = fd;
-						}
-
-						// creo ed inizializzo la struct da passare come argomento al thread worker
-						threadT *t = calloc(1, sizeof(threadT));
-						t->args = calloc(1, 3*sizeof(long));
-						t->args[0] = fd;
-			    		t->args[1] = (long) &quit;
-			    		t->args[2] = (long) requestPipe[1];
-			    		t->queue = queue;
-			    		t->logFileT = logFileT;
-			    		t->pool = pool;
-			    		t->lock = &lock;
-			    		t->waiting = &waiting;
-
-						int r = addToThreadPool(pool, serverThread, (void*) t);
-
-						// task aggiunto alla pool con successo
-						if (r == 0) {
-							#ifdef DEBUG
-							printf("Task aggiunto alla pool da un client gia' connesso: %d\n", fd);
-							#endif
-							continue;
-						}
-
-						// errore interno
-						else if (r < 0) {
-							perror("addToThreadPool");
-						}
-
-						// coda pendenti piena
-						else {
-							#ifdef DEBUG
-							perror("Coda pendenti piena");
-							#endif
-						}
-
-						if (t->args) {
-							free(t->args);
-						}
-
-						if (t) {
-							free(t);
-						}
-
-						close(fd);
+					t->args[0] = fd_c;
+					t->args[1] = (long) &quit;
+					t->args[2] = (long) closePipe[1];
+					t->args[3] = (long) epfd;
+					t->queue = queue;
+					t->logFileT = logFileT;
+					t->pool = pool;
+					t->prio = POOL_PRIO_NORMAL;
+					t->backlog = &backlog;
+					t->lock = &lock;
+					t->waiting = &waiting;
+
+					// registro il client: verra' assegnato a un worker quando inviera' la prima richiesta
+					memset(&ev, 0, sizeof(ev));
+					ev.events = EPOLLIN | EPOLLONESHOT;
+					ev.data.fd = fd_c;
+
+					if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd_c, &ev) == -1) {
+						perror("epoll_ctl");
+						free(t);
+						close(fd_c);
 						continue;
 					}
-				}	
-			}	
+
+					conns[fd_c] = t;
+
+					numberOfConnections++;
+				}
+
+				else {
+					#ifdef DEBUG
+					printf("Nuova connessione rifiutata: il server e' in fase di terminazione.\n");
+					fflush(stdout);
+					#endif
+
+					epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+					close(fd);
+				}
+			}
+
+			// se l'ho ricevuta dalla closePipe, un worker thread ha chiuso la connessione con un client
+			else if (fd == closePipe[0]) {
+				int fdr;
+				if (readn(closePipe[0], &fdr, sizeof(int)) == -1) {
+					perror("readn");
+					continue;
+				}
+
+				#ifdef DEBUG
+				printf("Il worker thread ha chiuso la connessione con un client.\n");
+				fflush(stdout);
+				#endif
+
+				/* chiudo il descrittore solo ora, dopo averne liberato lo stato: se lo chiudesse il worker, una nuova 
+				connessione potrebbe ottenere lo stesso descrittore prima che il manager legga la notifica */
+				free(conns[fdr]);
+				conns[fdr] = NULL;
+				close(fdr);
+				numberOfConnections--;
+
+				#ifdef DEBUG
+				printf("numberOfConnections = %d\n", numberOfConnections);
+				fflush(stdout);
+				#endif
+
+				// controllo se devo terminare il server
+				if (stopIncomingConnections && numberOfConnections <= 0) {
+					#ifdef DEBUG
+					printf("Non ci sono altri client connessi, termino.\n");
+					fflush(stdout);
+					#endif
+					quit = 1;
+					pthread_cancel(st);	// termino il signalThread
+				}
+			}
+
+			// se l'ho ricevuta dall'eventfd, si e' liberato un posto nella threadpool: i client rimandati vengono riproposti all'inizio del ciclo
+			else if (fd == backlog.efd) {
+				eventfd_t value;
+				if (eventfd_read(backlog.efd, &value) == -1 && errno != EAGAIN) {
+					perror("eventfd_read");
+				}
+			}
+
+			/* se l'ho ricevuta dalla sigPipe, controllo se devo terminare immediatamente 
+			o solo smettere di accettare nuove connessioni */
+			else if (fd == sigPipe[0]) {
+				int code;
+				if (readn(sigPipe[0], &code, sizeof(int)) == -1) {
+					perror("readn");
+					continue;
+				}
+
+				if (code == 0) {
+					stopIncomingConnections = 1;
+
+					#ifdef DEBUG
+					printf("Ricevuto un segnale di stop alle nuove connessioni.\n");
+					printf("Numero di connessioni attive: %d\n", numberOfConnections);
+					fflush(stdout);
+					#endif
+
+					if (numberOfConnections == 0) {
+						quit = 1;
+						pthread_cancel(st);	// termino il signalThread
+					}
+				}
+
+				else if (code == 1) {
+					#ifdef DEBUG
+					printf("Ricevuto un segnale di terminazione immediata.\n");
+					fflush(stdout);
+					#endif
+
+					quit = 1;
+				}
+
+				else {
+					perror("Errore: codice inviato dal sigThread invalido.\n");
+				}
+			}
+
+			// altrimenti è una richiesta di I/O da un client già connesso (disattivato da EPOLLONESHOT finche' non viene servito)
+			else {
+				/* assegno la richiesta a un worker, passandogli la struct creata alla connessione del client. Se ci sono
+				client rimandati, il client viene messo in coda dopo di loro, a meno che la richiesta non sia urgente (le 
+				richieste urgenti hanno una coda propria nella threadpool) */
+				int r = (backlog.len > 0 && requestPriority(conns[fd]) != POOL_PRIO_HIGH) ? 1 : dispatchClient(pool, conns[fd]);
+
+				// task aggiunto alla pool con successo
+				if (r == 0) {
+					#ifdef DEBUG
+					printf("Task aggiunto alla pool da un client gia' connesso: %d\n", fd);
+					#endif
+					continue;
+				}
+
+				// coda pendenti piena: il client resta connesso e viene servito appena un worker si libera
+				if (r == 1) {
+					#ifdef DEBUG
+					printf("Coda pendenti piena, client %d rimandato\n", fd);
+					#endif
+					deferClient(&backlog, fd, epfd, fd_skt, logFileT);
+					continue;
+				}
+
+				// errore interno
+				perror("addToThreadPool");
+
+				// chiudendo il descrittore il client viene rimosso anche da epoll
+				free(conns[fd]);
+				conns[fd] = NULL;
+				close(fd);
+				numberOfConnections--;
+
+				if (stopIncomingConnections && numberOfConnections <= 0) {
+					quit = 1;
+					pthread_cancel(st);	// termino il signalThread
+				}
+			}
 		}
 	}
 
+	close(epfd);
+
+	// il manager non aggiunge piu' task: le statistiche della threadpool sono definitive
+	poolstats_t poolStats;
+	threadPoolStats(pool, &poolStats);
 	destroyThreadPool(pool, 0);		// notifico a tutti i thread workers di terminare
+	close(backlog.efd);
+
+	// libero gli argomenti dei client ancora connessi
+	for (size_t i = 0; i < maxFds; i++) {
+		free(conns[i]);
+	}
+	free(conns);
 	clearWaiting(&waiting);		// distruggo la coda dei client in attesa di ottenere una lock
-	printStats(logFileT);	// stampo il sunto delle operazioni effettuate durante l'esecuzione del server
+	printStats(logFileT, queue);	// stampo il sunto delle operazioni effettuate durante l'esecuzione del server
+	printLoadStats(logFileT, &poolStats, &backlog);	// e quello del carico della threadpool
+	free(backlog.fds);
 
 	// stampo i file contenuti nello storage al momento della chiusura del server
 	if (printQueue(queue) == -1) {
@@ -682,149 +877,471 @@ static void serverThread(void *par) {
 		return;
 	}
 
+	// la struct appartiene alla connessione (viene liberata dal manager quando il client si disconnette)
 	threadT *t = (threadT*) par;
 	long *args = t->args;
 	long fd_c = args[0];
 	long *quit = (long*) (args[1]);
 	int pipe = (int) (args[2]);
-	queueT *queue = t->queue;
+	int epfd = (int) (args[3]);
+	inputT *in = &t->in;
 	logT *logFileT = t->logFileT;
-	threadpool_t *pool = t->pool;
-	pthread_mutex_t *lock = t->lock;
-	waitingT **waiting = t->waiting;
 	sigset_t sigset;
-	fd_set set, tmpset;	
-	pthread_t tid = pthread_self();		// identificatore del thread worker
-    int myid = -1;
-
-    for (int i = 0; i < pool->numthreads; i++) {
-    	if (pthread_equal(pool->threads[i], tid)) {
-        	myid = i;
-        	break;
-        }
-    } 
-
-	// libera la memoria del threadT passato come parametro
-	free(par);
-	
+	struct pollfd pfd = {fd_c, POLLIN, 0};
+    int myid = threadPoolWorkerId();	// indice del worker (il numero di worker puo' variare)
+
+	// prendendo il task si e' liberato un posto nella coda della threadpool: se ci sono client rimandati sveglio il manager
+	if (atomic_exchange(&(t->backlog)->waiting, 0) && eventfd_write((t->backlog)->efd, 1) == -1) {
+		perror("eventfd_write");
+	}
+
 	// maschero tutti i segnali nel thread
 	if (sigfillset(&sigset) == -1) {
 		perror("sigfillset.\n");
-		goto cleanup;
+		return;
 	}
 
 	if (pthread_sigmask(SIG_SETMASK, &sigset, NULL) == -1) {
 		perror("sigmask.\n");
-		goto cleanup;
+		return;
+	}
+
+	/* il manager assegna ai worker solo i client con una richiesta gia' arrivata (segnalata da epoll), quindi la read 
+	non si blocca mai su un client inattivo. Se il server sta terminando immediatamente, la richiesta non viene servita */
+	if (*quit) {
+		return;
+	}
+
+	char buf[REQSIZE];
+	int served = 0;
+
+	// un client riattivato da rearmClient potrebbe non avere richieste da servire: lo rimetto in attesa su epoll
+	if (in->start == in->end && poll(&pfd, 1, 0) <= 0) {
+		rearmClient(epfd, fd_c, 0);
+		return;
 	}
 
-	FD_ZERO(&set);
-	FD_SET(fd_c, &set);
+	/* servo le richieste del client finche' ce ne sono di gia' arrivate (nel buffer della connessione o sul socket), 
+	senza ripassare da epoll, ma al massimo MAXBURST di seguito per non monopolizzare il worker. Un worker assegnato a una
+	richiesta urgente non serve di seguito una richiesta normale: il client viene riassegnato con la nuova priorita', 
+	cosi' le richieste urgenti degli altri client non la attendono */
+	do {
+		memset(buf, '\0', REQSIZE);
 
-	while (*quit == 0) {
-		tmpset = set;
-		int r;
-		struct timeval timeout = {0, 100000};	// ogni 100ms controllo se devo terminare
+		requestT req;
 
-		if ((r = select(fd_c + 1, &tmpset, NULL, NULL, &timeout)) < 0) {
-		    perror("select server thread");
-		    goto cleanup;
+		// leggo la richiesta del client: un comando testuale di CMDSIZE bytes oppure una richiesta binaria
+		int valid = (readRequest(fd_c, in, buf, &req) == 0);
+
+		// dal protocollo v3 ogni risposta e' preceduta dall'id della richiesta
+		if (valid && req.version >= PROTO_V3 && writen(fd_c, &req.id, sizeof(uint32_t)) == -1) {
+			perror("writen");
+			valid = 0;
 		}
 
-		// se il timeout è terminato, controllo se devo uscire o riprovare
-		if (r == 0) {
-		    if (*quit) {
-		    	goto cleanup;
-		    }
+		#ifdef DEBUG
+		if (valid) {
+			printf("SERVER THREAD: ho ricevuto %s %s dal client %ld\n", opName(req.op), req.path ? req.path : "", fd_c);
+			fflush(stdout);
 		}
+		#endif
 
-		else {
-			break;
+		// servo la richiesta: il parser fallisce solo se la richiesta (o un batch) non e' valida
+		int r = valid ? parser(&req, t) : -1;
+
+		// se il client ha chiuso la connessione o ha inviato una richiesta non valida, chiudo la connessione
+		if (r == -1) {
+			#ifdef DEBUG
+			printf("SERVER THREAD: chiudo la connessione col client\n");
+			fflush(stdout);
+			#endif
+
+			// comunico al manager che la connessione va chiusa (il descrittore viene chiuso dal manager)
+			int fdInt = (int) fd_c;
+			if (writen(pipe, &fdInt, sizeof(int)) == -1) {
+				perror("writen");
+				return;
+			}	
+
+			// scrivo sul logFile
+			char closeConStr[64] = "Chiusa connessione con il client ";
+			char closeConnFdStr[32];
+			snprintf(closeConnFdStr, sizeof(fd_c)+1, "%ld", fd_c);
+			strncat(closeConStr, closeConnFdStr, strlen(closeConnFdStr)+1);
+			strncat(closeConStr, ".\n", 3);
+			if (writeLog(logFileT, closeConStr) == -1) {
+				perror("writeLog");
+			}
+
+			return;
+		}
+
+		// scrivo sul logFile
+		char workStr[128] = "Il thread ";
+		char tidStr[64];
+		char fdWorkStr[64];
+		snprintf(tidStr, sizeof(myid)+1, "%d", myid);
+		snprintf(fdWorkStr, sizeof(fd_c)+1, "%ld", fd_c);
+		strncat(workStr, tidStr, strlen(tidStr)+1);
+		strncat(workStr, " ha servito una richiesta del client ", 64);
+		strncat(workStr, fdWorkStr, strlen(fdWorkStr)+1);
+		strncat(workStr, ".\n", 3);
+		if (writeLog(logFileT, workStr) == -1) {
+			perror("writeLog");
 		}
+
+		/* il client e' in attesa di una lock: le sue richieste successive non vengono servite (quindi l'ordine delle 
+		operazioni sui file e' quello di invio) finche' chi rilascia la lock non lo riattiva */
+		if (r == 1) {
+			return;
+		}
+
+		served++;
+		pfd.revents = 0;
+	} while (served < MAXBURST && *quit == 0 && (in->start < in->end || poll(&pfd, 1, 0) > 0) && 
+		(t->prio != POOL_PRIO_HIGH || requestPriority(t) == POOL_PRIO_HIGH));
+
+	// riattivo il descrittore: da qui in poi il client puo' essere servito da un altro worker
+	rearmClient(epfd, fd_c, in->start < in->end);
+}
+
+/**
+ * Si assicura che nel buffer della connessione ci siano almeno n bytes (n <= INBUFSIZE), leggendo dal socket tutti 
+ * quelli disponibili: con il pipelining una sola read riceve anche le richieste successive.
+ */
+static int needInput(long fd_c, inputT *in, size_t n) {
+	while (in->end - in->start < n) {
+		// sposto all'inizio del buffer i bytes non ancora consumati
+		if (in->start > 0) {
+			memmove(in->buf, in->buf + in->start, in->end - in->start);
+			in->end -= in->start;
+			in->start = 0;
+		}
+
+		ssize_t r = read(fd_c, in->buf + in->end, INBUFSIZE - in->end);
+
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+
+		// il client ha chiuso la connessione
+		if (r <= 0) {
+			if (r == 0) {
+				errno = ECONNRESET;
+			}
+
+			return -1;
+		}
+
+		in->end += r;
 	}
 
-	char buf[CMDSIZE];
-	memset(buf, '\0', CMDSIZE);
+	return 0;
+}
+
+// legge n bytes dal client: prima quelli gia' nel buffer della connessione, poi direttamente dal socket
+static int takeInput(long fd_c, inputT *in, void *dst, size_t n) {
+	size_t k = (in->end - in->start < n) ? in->end - in->start : n;
 
-	int n;
-	// leggo il messaggio del client	
-	if ((n = read(fd_c, buf, CMDSIZE)) == -1) {	
-		perror("read");
+	memcpy(dst, in->buf + in->start, k);
+	in->start += k;
 
-		goto cleanup;
+	if (k < n && readn(fd_c, (char*) dst + k, n - k) != n - k) {
+		errno = EREMOTEIO;
+		return -1;
 	}
 
-	if (n == 0 || strcmp(buf, "quit\n") == 0) {
-		#ifdef DEBUG
-		printf("SERVER THREAD: chiudo la connessione col client\n");
-		fflush(stdout);
-		#endif
+	return 0;
+}
 
-		close(fd_c);
+// legge e decodifica la prossima richiesta del client, copiandola in buf (REQSIZE bytes)
+static int readRequest(long fd_c, inputT *in, char *buf, requestT *req) {
+	if (needInput(fd_c, in, 1) == -1) {
+		return -1;
+	}
 
-		int close = -1;
+	// richiesta testuale: un comando di CMDSIZE bytes
+	if ((unsigned char) in->buf[in->start] != PROTO_MAGIC) {
+		if (needInput(fd_c, in, CMDSIZE) == -1) {
+			return -1;
+		}
 
-		// comunico al manager che ho chiuso la connessione
-		if (writen(pipe, &close, sizeof(int)) == -1) {
-			perror("writen");
-			goto cleanup;
-		}	
+		memcpy(buf, in->buf + in->start, CMDSIZE);
+		in->start += CMDSIZE;
 
-		// scrivo sul logFile
-		char closeConStr[64] = "Chiusa connessione con il client ";
-		char closeConnFdStr[32];
-		snprintf(closeConnFdStr, sizeof(fd_c)+1, "%ld", fd_c);
-		strncat(closeConStr, closeConnFdStr, strlen(closeConnFdStr)+1);
-		strncat(closeConStr, ".\n", 3);
-		if (writeLog(logFileT, closeConStr) == -1) {
+		if (strcmp(buf, "quit\n") == 0) {
+			return -1;
+		}
+
+		return parseTextRequest(buf, req);
+	}
+
+	// richiesta binaria: l'header...
+	protoHeaderT hdr;
+
+	if (needInput(fd_c, in, sizeof(protoHeaderT)) == -1) {
+		return -1;
+	}
+
+	memcpy(&hdr, in->buf + in->start, sizeof(protoHeaderT));
+
+	if (hdr.pathLen > PROTO_MAXPATH) {
+		errno = EBADMSG;
+		return -1;
+	}
+
+	// ...e il path
+	size_t total = sizeof(protoHeaderT) + hdr.pathLen;
+
+	if (needInput(fd_c, in, total) == -1) {
+		return -1;
+	}
+
+	memcpy(buf, in->buf + in->start, total);
+	in->start += total;
+
+	return parseBinaryRequest(&hdr, buf + sizeof(protoHeaderT), req);
+}
+
+/**
+ * Riattiva il descrittore di un client su epoll. Se ci sono richieste gia' lette nel buffer della connessione (pending),
+ * il descrittore viene attivato anche in scrittura: EPOLLOUT viene segnalato subito, quindi il manager riassegna il
+ * client a un worker anche se sul socket non arriva nient'altro.
+ */
+static void rearmClient(int epfd, long fd_c, int pending) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLONESHOT | (pending ? EPOLLOUT : 0);
+	ev.data.fd = (int) fd_c;
+
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd_c, &ev) == -1) {
+		perror("epoll_ctl");
+	}
+}
+
+/**
+ * Classe di priorita' della prossima richiesta di un client, riconosciuta dai primi bytes senza consumarli (nel buffer 
+ * della connessione o sul socket). Un client che ha chiuso la connessione e' urgente (va solo chiuso), una richiesta 
+ * non ancora riconoscibile ha priorita' normale.
+ */
+static poolPrioT requestPriority(threadT *t) {
+	inputT *in = &t->in;
+	char peek[CMDSIZE];
+	int op, flags;
+
+	if (in->start < in->end) {
+		op = peekRequestOp(in->buf + in->start, in->end - in->start, &flags);
+	}
+
+	else {
+		ssize_t len = recv((int) t->args[0], peek, sizeof(peek), MSG_PEEK | MSG_DONTWAIT);
+
+		if (len == 0) {
+			return POOL_PRIO_HIGH;
+		}
+
+		op = (len > 0) ? peekRequestOp(peek, (size_t) len, &flags) : -1;
+	}
+
+	return (op == -1) ? POOL_PRIO_NORMAL : opPriority(op, flags);
+}
+
+// assegna la prossima richiesta di un client a un worker, con la sua priorita'. Restituisce il valore di addToThreadPoolPrio
+static int dispatchClient(threadpool_t *pool, threadT *t) {
+	t->prio = requestPriority(t);
+
+	return addToThreadPoolPrio(pool, serverThread, (void*) t, t->prio);
+}
+
+/**
+ * Sospende (pause = 1) o riprende l'accettazione delle nuove connessioni: il socket resta registrato su epoll, ma senza
+ * eventi, quindi le nuove connessioni attendono nella coda di listen. Se il socket e' gia' stato rimosso da epoll (server 
+ * in fase di terminazione) non fa nulla. Restituisce 0 se successo, -1 se errore.
+ */
+static int pauseAccept(int epfd, int fd_skt, int pause) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = pause ? 0 : EPOLLIN;
+	ev.data.fd = fd_skt;
+
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd_skt, &ev) == -1 && errno != ENOENT) {
+		perror("epoll_ctl");
+		return -1;
+	}
+
+	return 0;
+}
+
+// mette in coda un client che la threadpool ha rifiutato e, se non lo e' gia', sospende l'accettazione delle nuove connessioni
+static void deferClient(backlogT *backlog, int fd, int epfd, int fd_skt, logT *logFileT) {
+	backlog->fds[(backlog->head + backlog->len) % backlog->size] = fd;
+	backlog->len++;
+	backlog->deferred++;
+
+	if (backlog->len > backlog->maxLen) {
+		backlog->maxLen = backlog->len;
+	}
+
+	if (!backlog->paused && pauseAccept(epfd, fd_skt, 1) == 0) {
+		backlog->paused = 1;
+		backlog->pauses++;
+
+		char logStr[LOGLINESIZE];
+		snprintf(logStr, LOGLINESIZE, "Coda della threadpool piena: sospese le nuove connessioni, client %d in attesa di un worker.\n", fd);
+		if (writeLog(logFileT, logStr) == -1) {
 			perror("writeLog");
 		}
+	}
+}
+
+/**
+ * Ripropone alla threadpool i client rimandati, nell'ordine di arrivo, finche' la coda della threadpool non e' di nuovo 
+ * piena; quando non ne restano riprende l'accettazione delle nuove connessioni. I client che non e' possibile assegnare
+ * per un errore interno vengono chiusi. Restituisce il numero di client chiusi.
+ */
+static int drainBacklog(backlogT *backlog, threadpool_t *pool, threadT **conns, int epfd, int fd_skt, logT *logFileT) {
+	int closed = 0;
 
-		goto cleanup;
+	/* chiedo la notifica prima di riproporre i client: un posto liberato dopo un tentativo fallito sveglia sicuramente 
+	il manager, anche se il worker lo libera prima che il manager arrivi alla epoll_wait */
+	if (backlog->len > 0) {
+		atomic_store(&backlog->waiting, 1);
 	}
 
-	#ifdef DEBUG
-	printf("SERVER THREAD: ho ricevuto %s dal client %ld\n", buf, fd_c);
-	fflush(stdout);
-	#endif
+	while (backlog->len > 0) {
+		int fd = backlog->fds[backlog->head];
+		int r = dispatchClient(pool, conns[fd]);
 
-	if (parser(buf, queue, fd_c, logFileT, lock, waiting) == -1) {
-		#ifdef DEBUG
-		printf("SERVER THREAD: errore parser.\n");
-		fflush(stdout);
-		#endif
+		// coda ancora piena
+		if (r == 1) {
+			break;
+		}
+
+		backlog->head = (backlog->head + 1) % backlog->size;
+		backlog->len--;
 
-		goto cleanup;
+		// errore interno: chiudendo il descrittore il client viene rimosso anche da epoll
+		if (r == -1) {
+			perror("addToThreadPool");
+			free(conns[fd]);
+			conns[fd] = NULL;
+			close(fd);
+			closed++;
+		}
 	}
 
-	memset(buf, '\0', CMDSIZE);
+	if (backlog->len == 0) {
+		atomic_store(&backlog->waiting, 0);
+	}
 
-	// comunico al manager che la richiesta è stata servita
-	int fdInt = (int) fd_c;
-	if (writen(pipe, &fdInt, sizeof(int)) == -1) {
-		perror("writen");
-	}	
+	if (backlog->len == 0 && backlog->paused && pauseAccept(epfd, fd_skt, 0) == 0) {
+		backlog->paused = 0;
 
-	// scrivo sul logFile
-	char workStr[128] = "Il thread ";
-	char tidStr[64];
-	char fdWorkStr[64];
-	snprintf(tidStr, sizeof(myid)+1, "%d", myid);
-	snprintf(fdWorkStr, sizeof(fd_c)+1, "%ld", fd_c);
-	strncat(workStr, tidStr, strlen(tidStr)+1);
-	strncat(workStr, " ha servito una richiesta del client ", 64);
-	strncat(workStr, fdWorkStr, strlen(fdWorkStr)+1);
-	strncat(workStr, ".\n", 3);
-	if (writeLog(logFileT, workStr) == -1) {
-		perror("writeLog");
+		if (writeLog(logFileT, "Coda della threadpool libera: riprese le nuove connessioni.\n") == -1) {
+			perror("writeLog");
+		}
+	}
+
+	return closed;
+}
+
+// crea la chiave dei buffer di ricezione dei worker: ogni buffer viene liberato quando il suo worker termina
+static void initStreamKey(void) {
+	if ((errno = pthread_key_create(&streamKey, free)) != 0) {
+		perror("pthread_key_create");
+	}
+}
+
+// restituisce il buffer di ricezione (STREAMSIZE bytes) del worker chiamante, allocandolo al primo utilizzo
+static void* streamBuffer(void) {
+	pthread_once(&streamOnce, initStreamKey);
+
+	void *buf = pthread_getspecific(streamKey);
+
+	if (!buf && (buf = malloc(STREAMSIZE)) != NULL && pthread_setspecific(streamKey, buf) != 0) {
+		free(buf);
+		buf = NULL;
+	}
+
+	return buf;
+}
+
+/**
+ * Riceve dal client size bytes di contenuto e li scrive sul file un blocco di STREAMSIZE bytes alla volta, usando il
+ * buffer di ricezione del worker, quindi la memoria usata non dipende dalla dimensione del file. I primi bytes possono
+ * essere gia' nel buffer della connessione (dal protocollo v3). Se replace = 1 il primo blocco sostituisce il contenuto del file,
+ * altrimenti tutti i blocchi vengono scritti in append; durante la ricezione le letture vedono la parte gia' scritta.
+ * Se la scrittura di un blocco fallisce, il resto del contenuto viene comunque letto (e scartato), in modo che la
+ * prossima richiesta del client venga letta correttamente.
+ */
+static int receiveContent(long fd_c, inputT *in, queueT *queue, char *filepath, size_t size, int replace, reservationT *res) {
+	void *buf = streamBuffer();
+	size_t received = 0;
+	int err = 0;
+
+	if (!buf) {
+		return -1;
+	}
+
+	do {
+		size_t len = (size - received < STREAMSIZE) ? size - received : STREAMSIZE;
+
+		// il client si e' disconnesso prima di inviare tutto il contenuto
+		if (takeInput(fd_c, in, buf, len) == -1) {
+			return -1;
+		}
+
+		// il primo blocco e' l'accesso al file, i successivi lo completano
+		if (err == 0) {
+			int r;
+
+			if (received > 0) {
+				r = appendBlockInQueue(queue, filepath, buf, len, fd_c, res);
+			}
+
+			else if (replace) {
+				r = writeFileInQueue(queue, filepath, buf, len, fd_c, res);
+			}
+
+			else {
+				r = appendFileInQueue(queue, filepath, buf, len, fd_c, res);
+			}
+
+			if (r == -1) {
+				err = errno;
+			}
+		}
+
+		received += len;
+	} while (received < size);
+
+	if (err != 0) {
+		errno = err;
+		return -1;
 	}
 
-	// ripulisco la memoria
-	cleanup: {
-		if (args) {
-			free(args);
+	return 0;
+}
+
+// legge e scarta size bytes di contenuto (dal protocollo v3: il contenuto di una write fallita segue comunque la richiesta)
+static int discardContent(long fd_c, inputT *in, size_t size) {
+	void *buf = streamBuffer();
+
+	if (!buf) {
+		return -1;
+	}
+
+	while (size > 0) {
+		size_t len = (size < STREAMSIZE) ? size : STREAMSIZE;
+
+		if (takeInput(fd_c, in, buf, len) == -1) {
+			return -1;
 		}
+
+		size -= len;
 	}
+
+	return 0;
 }
 
 // thread che svolge la funzione di "signal handler"
@@ -925,14 +1442,26 @@ int updateStats(logT *logFileT, queueT *queue, int miss) {
 	return 0;
 }
 
-// stampa le statistiche nel logFile su standard output
-void printStats(logT *logFileT) {
-	// controllo la validita' dell'argomento
-	if (!logFileT) {
+// stampa le statistiche nel logFile e quelle sulle letture della coda su standard output
+void printStats(logT *logFileT, queueT *queue) {
+	// controllo la validita' degli argomenti
+	if (!logFileT || !queue) {
 		errno = EINVAL;
 		return;
 	}
 
+	statsT stats;
+	if (getStats(queue, &stats) == -1) {
+		perror("getStats");
+		return;
+	}
+
+	// hit ratio e byte hit ratio delle letture (i capacity miss sono le letture di file espulsi di recente)
+	size_t reads = stats.hits + stats.misses;
+	size_t readBytes = stats.hitBytes + stats.missBytes;
+	double hitRatio = reads ? stats.hits / (double) reads : 0;
+	double byteHitRatio = readBytes ? stats.hitBytes / (double) readBytes : 0;
+
 	pthread_mutex_lock(&logFileT->m);
 
 	double res = logFileT->maxSize/(double) 1000000;
@@ -940,6 +1469,18 @@ void printStats(logT *logFileT) {
 	printf("Numero massimo di file memorizzati nel server: %zu\n", logFileT->maxFiles);
 	printf("Dimensione massima raggiunta dal file storage: %lf MB\n", res);
 	printf("Numero di capacity misses nella cache: %zu\n", logFileT->cacheMiss);
+	printf("Hit ratio delle letture: %lf (%zu hit, %zu capacity miss)\n", hitRatio, stats.hits, stats.misses);
+	printf("Byte hit ratio delle letture: %lf (%zu bytes da hit, %zu bytes da capacity miss)\n", byteHitRatio, stats.hitBytes, stats.missBytes);
+
+	// statistiche degli allocatori dei metadati (solo quelli usati)
+	slabStatsT allocStats[ALLOC_POOLS];
+	int pools = getAllocStats(allocStats);
+	for (int i = 0; i < pools; i++) {
+		if (allocStats[i].allocs > 0) {
+			printf("Allocatore %s: %zu allocazioni, %zu deallocazioni, %zu oggetti in uso, %zu blocchi (%zu KB)\n", allocStats[i].name, 
+				allocStats[i].allocs, allocStats[i].frees, allocStats[i].live, allocStats[i].slabs, allocStats[i].reserved / 1024);
+		}
+	}
 	fflush(stdout);
 
 	// scrivo sul logFile
@@ -955,6 +1496,13 @@ void printStats(logT *logFileT) {
 	char statsMissStr[64];
 	snprintf(statsMissStr, sizeof(size_t)+1, "%zu", logFileT->cacheMiss);
 	strncat(statsStr, statsMissStr, strlen(statsMissStr)+1);
+	strncat(statsStr, ".\nHit ratio delle letture: ", 64);
+	char statsRatioStr[64];
+	snprintf(statsRatioStr, sizeof(statsRatioStr), "%lf", hitRatio);
+	strncat(statsStr, statsRatioStr, strlen(statsRatioStr)+1);
+	strncat(statsStr, ".\nByte hit ratio delle letture: ", 64);
+	snprintf(statsRatioStr, sizeof(statsRatioStr), "%lf", byteHitRatio);
+	strncat(statsStr, statsRatioStr, strlen(statsRatioStr)+1);
 	strncat(statsStr, ".\n", 3);
 	if (fwrite(statsStr, 1, strlen(statsStr)+1, logFileT->file) == -1) {
 		perror("fwrite");
@@ -963,98 +1511,161 @@ void printStats(logT *logFileT) {
 	pthread_mutex_unlock(&logFileT->m);	
 }
 
-// effettua il parsing dei comandi
-int parser(char *command, queueT *queue, long fd_c, logT* logFileT, pthread_mutex_t *lock, waitingT **waiting) {
+// stampa il sunto del carico della threadpool e dei client rimandati perche' la sua coda era piena
+void printLoadStats(logT *logFileT, poolstats_t *poolStats, backlogT *backlog) {
 	// controllo la validita' degli argomenti
-	if (!command || !queue || !logFileT || !waiting) {
+	if (!logFileT || !poolStats || !backlog) {
 		errno = EINVAL;
-		return -1;
+		return;
 	}
 
-	// parso il comando ricevuto dal client
-	char *token = NULL, *save = NULL, *token2 = NULL, *token3 = NULL;
-	token = strtok_r(command, ":", &save);
+	char loadStr[LOGLINESIZE];
+	snprintf(loadStr, LOGLINESIZE, "Richieste assegnate ai worker: %zu (coda della threadpool: al massimo %d in attesa, %zu rifiuti).\n"
+		"Client rimandati per la coda piena: %zu (al massimo %zu insieme), nuove connessioni sospese %zu volte.\n"
+		"Worker della threadpool: %d (al massimo %d), %zu aggiunti e %zu terminati dal controllore.\n"
+		"Richieste urgenti: %zu, richieste normali servite prima di quelle urgenti in attesa: %zu.\n", poolStats->added, 
+		poolStats->maxpending, poolStats->rejected, backlog->deferred, backlog->maxLen, backlog->pauses, poolStats->threads, 
+		poolStats->peakthreads, poolStats->grown, poolStats->shrunk, poolStats->urgent, poolStats->promoted);
 
-	// controllo quale comando ho ricevuto e chiamo la procedura opportuna
-	if (token && strcmp(token, "openFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
-		token3 = strtok_r(NULL, ":", &save);
-		int arg = (int) strtol(token3, NULL, 0);
+	printf("%s", loadStr);
+	fflush(stdout);
 
-		openFile(token2, arg, queue, fd_c, logFileT);
+	if (writeLog(logFileT, loadStr) == -1) {
+		perror("writeLog");
 	}
+}
 
-	else if (token && strcmp(token, "readFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
+// registra sul file di log una decisione del controllore della threadpool (aggiunta o terminazione di worker)
+void logPoolDecision(const char *msg, void *logFileT) {
+	printf("%s", msg);
+	fflush(stdout);
 
-		readFile(token2, queue, fd_c, logFileT);
+	if (writeLog((logT*) logFileT, (char*) msg) == -1) {
+		perror("writeLog");
 	}
+}
 
-	else if (token && strcmp(token, "readNFiles") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
+/**
+ * Classe di priorita' con la quale servire un'operazione (flags = -1 se i flag non sono noti): sono urgenti quelle sui 
+ * metadati, che non trasferiscono il contenuto dei file, cosi' non attendono dietro alle letture e alle scritture di 
+ * file grandi. Una openFile con O_CREATE puo' espellere un file e inviarlo al client, quindi e' urgente solo senza.
+ */
+poolPrioT opPriority(int op, int flags) {
+	switch (op) {
+		case OP_OPEN:
+			// flags = 0 o 2: !O_CREATE (vedi openFile)
+			return (flags == 0 || flags == 2) ? POOL_PRIO_HIGH : POOL_PRIO_NORMAL;
+
+		case OP_HELLO:
+		case OP_LOCK:
+		case OP_UNLOCK:
+		case OP_CLOSE:
+		case OP_REMOVE:
+			return POOL_PRIO_HIGH;
+
+		default:
+			return POOL_PRIO_NORMAL;
+	}
+}
 
-		readNFiles(token2, queue, fd_c, logFileT);
+// effettua il parsing dei comandi: restituisce 1 se il client e' stato messo in attesa di una lock, -1 se il comando non
+// e' valido
+int parser(requestT *req, threadT *t) {
+	// controllo la validita' degli argomenti
+	if (!req || !t || !t->queue || !t->logFileT || !t->waiting) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	else if (token && strcmp(token, "writeFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
-		token3 = strtok_r(NULL, ":", &save);
-		size_t sz = (size_t) strtol(token3, NULL, 0);
+	queueT *queue = t->queue;
+	long fd_c = t->args[0];
+	int epfd = (int) t->args[3];
+	logT *logFileT = t->logFileT;
+	pthread_mutex_t *lock = t->lock;
+	waitingT **waiting = t->waiting;
+
+	// controllo quale comando ho ricevuto e chiamo la procedura opportuna
+	switch (req->op) {
+		case OP_HELLO:
+			hello((req->size > (size_t) req->version) ? (int) req->size : req->version, fd_c, logFileT);
+			break;
+
+		case OP_OPEN:
+			openFile(req->path, req->flags, queue, fd_c, req->version, logFileT);
+			break;
 
-		writeFile(token2, sz, queue, fd_c, logFileT, 0);
-	}
+		case OP_READ:
+			readFile(req->path, queue, fd_c, req->version, logFileT);
+			break;
 
-	else if (token && strcmp(token, "appendToFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
-		token3 = strtok_r(NULL, ":", &save);
-		size_t sz = (size_t) strtol(token3, NULL, 0);
+		case OP_READN:
+			readNFiles((int) req->n, queue, fd_c, req->version, logFileT);
+			break;
+
+		case OP_WRITE:
+			writeFile(req->path, req->size, queue, fd_c, &t->in, req->version, logFileT, 0);
+			break;
 
 		// l'operazione di append chiama la stessa procedura di writeFile, ma con l'ultima variabile = 1
-		writeFile(token2, sz, queue, fd_c, logFileT, 1);
-	}
+		case OP_APPEND:
+			writeFile(req->path, req->size, queue, fd_c, &t->in, req->version, logFileT, 1);
+			break;
 
-	else if (token && strcmp(token, "lockFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
+		case OP_LOCK:
+			return lockFile(req->path, queue, fd_c, logFileT, lock, waiting);
 
-		lockFile(token2, queue, fd_c, logFileT, lock, waiting);
-	}
+		case OP_UNLOCK:
+			unlockFile(req->path, queue, fd_c, epfd, logFileT, lock, waiting);
+			break;
 
-	else if (token && strcmp(token, "unlockFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
+		case OP_CLOSE:
+			closeFile(req->path, queue, fd_c, epfd, logFileT, lock, waiting);
+			break;
 
-		unlockFile(token2, queue, fd_c, logFileT, lock, waiting);
-	}
+		case OP_REMOVE:
+			removeFile(req->path, queue, fd_c, epfd, logFileT, lock, waiting);
+			break;
 
-	else if (token && strcmp(token, "closeFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
-		closeFile(token2, queue, fd_c, logFileT, lock, waiting);
-	}
+		case OP_BATCH:
+			return batch(req->n, req->version, t);
 
-	else if (token && strcmp(token, "removeFile") == 0) {
-		token2 = strtok_r(NULL, ":", &save);
-		removeFile(token2, queue, fd_c, logFileT, lock, waiting);
+		// comando non riconosciuto
+		default:
+			#ifdef DEBUG
+			printf("PARSER: comando non riconosciuto.\n");
+			fflush(stdout);
+			#endif
+
+			return -1;
 	}
 
-	// comando non riconosciuto
-	else {
-		#ifdef DEBUG
-		printf("PARSER: comando non riconosciuto.\n");
-		fflush(stdout);
-		#endif
+	return 0;
+}
 
-		return -1;
+// negozia con il client la versione del protocollo: risponde con la piu' alta supportata da entrambi
+void hello(int version, long fd_c, logT *logFileT) {
+	char ok[3] = "ok";
+	int chosen = (version < PROTO_V4) ? version : PROTO_V4;
+
+	if (writen(fd_c, ok, 3) == -1 || writen(fd_c, &chosen, sizeof(int)) == -1) {
+		perror("writen");
+		return;
 	}
 
-	return 0;
+	// scrivo sul logFile
+	char helloStr[LOGLINESIZE];
+	snprintf(helloStr, LOGLINESIZE, "Il client %ld usa la versione %d del protocollo.\n", fd_c, chosen);
+	if (writeLog(logFileT, helloStr) == -1) {
+		perror("writeLog");
+	}
 }
 
 // apri o crea un nuovo file nello storage
-void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFileT) {
-	void *res = malloc(BUFSIZE);
+int openFile(char *filepath, int flags, queueT *queue, long fd_c, int version, logT *logFileT) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
 	char es[3] = "es";		// messaggio che verra' mandato al client se un file e' stato espulso dalla cache
-	void *buf = NULL;
 
 	memcpy(res, ok, 3);
 	fileT *espulso = NULL;
@@ -1083,13 +1694,7 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 	}
 
 	// cerco se il file e' presente nel server
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-	if (findF != NULL) {
-		found = 1;
-	}
-
-	destroyFile(findF);
+	found = (exists(queue, filepath) == 1);
 
 	// se il client richiede di creare un file che esiste già, errore
 	if (O_CREATE && found) {
@@ -1098,8 +1703,9 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 		goto send;
 	}
 	
-	// se il client cerca di aprire un file inesistente, errore
+	// se il client cerca di aprire un file inesistente, errore (se il file e' stato espulso di recente, e' un capacity miss)
 	else if (!O_CREATE && !found) {
+		recordMiss(queue, filepath);
 		errno = ENOENT;
 		memcpy(res, er, 3);
 		goto send;
@@ -1107,18 +1713,25 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 
 	// il client vuole creare il file
 	else if (O_CREATE && !found) {
-		// se la cache e' piena, espelli un file secondo la politica FIFO
-		if (getLen(queue) == queue->maxLen) {
-			espulso = dequeue(queue);
+		// riservo il posto per il nuovo file: se la cache e' piena, viene espulso un file secondo la politica di rimpiazzamento
+		reservationT reservation;
+		fileT **victims = NULL;
+		int n = reserveSpace(queue, 0, 1, NULL, &reservation, &victims);
 
-			if (espulso == NULL) {
-				perror("dequeue");
-				memcpy(res, er, 3);
-				goto send;
-			}
+		if (n == -1) {
+			perror("reserveSpace");
+			memcpy(res, er, 3);
+			goto send;
+		}
+
+		if (n > 0) {
+			// per riservare un solo file (senza bytes) reserveSpace espelle al piu' un file: la risposta ne contiene uno solo
+			assert(n == 1);
+			espulso = victims[0];
+			free(victims);
 
 			// aggiorno il file delle statistiche
-			updateStats(logFileT, queue, 1);
+			updateStats(logFileT, queue, n);
 
 			memcpy(res, es, 3);
 		}
@@ -1128,11 +1741,14 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 
 		if (f == NULL) {
 			perror("createFileT");
+			cancelReservation(queue, &reservation);
 			memcpy(res, er, 3);
 		}
 
-		else if (enqueue(queue, f) != 0) {
+		else if (enqueue(queue, f, &reservation) != 0) {
 			//perror("enqueue");
+			destroyFile(f);
+			cancelReservation(queue, &reservation);
 			memcpy(res, er, 3);
 		}
 
@@ -1152,9 +1768,7 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 
 	// invia risposta al client
 	send:
-		buf = malloc(BUFSIZE);
-		memcpy(buf, res, 3);
-		if (writen(fd_c, buf, 3) == -1) {
+		if (writen(fd_c, res, 3) == -1) {
 			perror("writen");
 			goto cleanup;
 		}
@@ -1180,7 +1794,7 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 				goto cleanup;
 			}	
 
-			if (sendFile(espulso, fd_c, logFileT) == -1) {
+			if (sendFile(espulso, fd_c, version, logFileT) == -1) {
 				perror("sendFile");
 				goto cleanup;
 			}
@@ -1233,23 +1847,21 @@ void openFile(char *filepath, int flags, queueT *queue, long fd_c, logT *logFile
 
 	// libera la memoria
 	cleanup: 
-		if (buf) {
-			free(buf);
-		}
 
 		if (espulso) {
 			destroyFile(espulso);
 		}
 
-		free(res);
+		return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
 // leggi un file dallo storage e invialo al client
-void readFile(char *filepath, queueT *queue, long fd_c, logT *logFileT) {
-	void *res = malloc(BUFSIZE);
+int readFile(char *filepath, queueT *queue, long fd_c, int version, logT *logFileT) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
-	void *buf = NULL;
+	fileT *findF = NULL;
+	fileT info;
 
 	memcpy(res, ok, 3);
 
@@ -1260,29 +1872,23 @@ void readFile(char *filepath, queueT *queue, long fd_c, logT *logFileT) {
 		goto send;
 	}
 
-	// cerco il file da leggere nello storage
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
+	// prendo in prestito il file da leggere, senza copiarlo (la acquireFile aggiorna anche le statistiche di hit e miss)
 
 	// se il file non e' presente, errore
-	if (findF == NULL) {
+	if ((findF = acquireFile(queue, filepath)) == NULL || statFile(queue, filepath, &info) == -1) {
 		errno = ENOENT;
 		memcpy(res, er, 3);
 	}
 
 	// se il file non e' stato precedentemente aperto, errore
-	else if (!findF->open) {
+	else if (!info.open) {
 		errno = EPERM;
 		memcpy(res, er, 3);
 	}
 
 	// invia risposta al client
 	send:
-		buf = malloc(BUFSIZE);
-		
-		memcpy(buf, res, 3);
-
-		if (writen(fd_c, buf, 3) == -1) {
+		if (writen(fd_c, res, 3) == -1) {
 			perror("writen");
 			goto cleanup;
 		}
@@ -1309,7 +1915,7 @@ void readFile(char *filepath, queueT *queue, long fd_c, logT *logFileT) {
 
 		// altrimenti, invia il file al client
 		else {
-			if (sendFile(findF, fd_c, logFileT) == -1) {
+			if (sendFile(findF, fd_c, version, logFileT) == -1) {
 				perror("sendFile");
 				goto cleanup;
 			}
@@ -1330,40 +1936,30 @@ void readFile(char *filepath, queueT *queue, long fd_c, logT *logFileT) {
 		}
 
 	cleanup:
-		if (buf) {
-			free(buf);
-		}
 
 		if (findF) {
-			destroyFile(findF);
+			releaseFile(findF);
 		}
 
-		if (res) {
-			free(res);
-		}
+		return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
 // invia al client 'n' file qualsiasi attualmente memorizzati nello storage
-void readNFiles(char *numStr, queueT *queue, long fd_c, logT *logFileT) {
-	void *res = malloc(BUFSIZE);
+void readNFiles(int n, queueT *queue, long fd_c, int version, logT *logFileT) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
-	void *buf = NULL;
-	int n = strtol(numStr, NULL, 0);
 
 	memcpy(res, ok, 3);
 
 	// controllo la validita' degli argomenti
-	if (!numStr || !queue || !logFileT) {
+	if (!queue || !logFileT) {
 		errno = EINVAL;
 		memcpy(res, er, 3);
 	}
-	
-	buf = malloc(BUFSIZE);
-	memcpy(buf, res, 3);
 
 	// invio risposta al client
-	if (writen(fd_c, buf, 3) == -1) {
+	if (writen(fd_c, res, 3) == -1) {
 		perror("writen");
 	}
 
@@ -1397,39 +1993,49 @@ void readNFiles(char *numStr, queueT *queue, long fd_c, logT *logFileT) {
 			n = getLen(queue);
 		}
 
+		// prendo in prestito i file senza toglierli dalla coda, in modo da non alterare l'ordine di rimpiazzamento
+		fileT **files = NULL;
+		int count = 0;
 		int i = 0;
-		// invia i file al client
-		while (i < n && i < getLen(queue)) {
-			fileT *f = dequeue(queue);
 
-			if (f == NULL) {
-				break;
-			}
+		if (n > 0 && (files = malloc(n * sizeof(fileT*))) == NULL) {
+			perror("malloc files");
+			return;
+		}
+
+		if ((count = acquireFiles(queue, files, n)) == -1) {
+			perror("acquireFiles");
+			free(files);
+			return;
+		}
+
+		// invia i file al client
+		for (i = 0; i < count; i++) {
+			fileT *f = files[i];
 
 			// se il client ha i permessi per leggere il file, invialo
 			if (!f->O_LOCK || f->owner == fd_c) {
-					if (sendFile(f, fd_c, logFileT) == -1) {
+				if (sendFile(f, fd_c, version, logFileT) == -1) {
 					perror("sendFile");
-					goto cleanup;
+					break;
 				}
 			}
+		}
 
-			if (enqueue(queue, f) == -1) {
-				perror("enqueue");
-				goto cleanup;
-			}
+		for (int j = 0; j < count; j++) {
+			releaseFile(files[j]);
+		}
+
+		free(files);
 
-			i++;
+		if (i < count) {
+			return;
 		}
-		
-		// avverto il client che ho finito di mandare file, mandando la stringa ".FINE"
-		char fine[6] = ".FINE";
-		memset(buf, 0, BUFSIZE);
-		memcpy(buf, fine, 6);
 
-		if (writen(fd_c, buf, BUFSIZE) == -1) {
-			perror("writen");
-			goto cleanup;
+		// avverto il client che ho finito di mandare file
+		if (sendEnd(fd_c, version) == -1) {
+			perror("sendEnd");
+			return;
 		}
 
 		// scrivo sul logFile
@@ -1450,23 +2056,18 @@ void readNFiles(char *numStr, queueT *queue, long fd_c, logT *logFileT) {
 			perror("writeLog");
 		}	
 	}
-
-	cleanup:
-		free(buf);
-		free(res);
 }
 
 // sovrascrivi o fai l'append su un file gia' presente nello storage
-void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logFileT, int append) {
-	void *res = malloc(BUFSIZE);
-	void *buf = NULL;
+int writeFile(char *filepath, size_t size, queueT *queue, long fd_c, inputT *in, int version, logT *logFileT, int append) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
 	char es[3] = "es";		// messaggio che verra' mandato al client se un file e' stato espulso dalla cache
 	int found = 0;
-	fileT *espulso = NULL;
-	void *content = NULL;
-	content = malloc(size);
+	reservationT reservation = {0, 0};	// spazio riservato nella cache per la scrittura
+	fileT **victims = NULL;				// file espulsi per fare spazio alla scrittura
+	int nVictims = 0;
 
 	memcpy(res, ok, 3);
 	
@@ -1477,15 +2078,14 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
 		goto send;
 	}
 
-	// verifico se il file su cui si vuole scrivere e' presente nello storage
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-	if (findF != NULL) {
+	// verifico se il file su cui si vuole scrivere e' presente nello storage, leggendone solo i metadati
+	fileT info;
+	fileT *findF = &info;
+	if (statFile(queue, filepath, findF) == 0) {
 		found = 1;
 
 		// se la dimensione del file scritto diventerebbe piu' grande della capacita' massima della cache, errore
 		if (findF->size + size > queue->maxSize) {
-			destroyFile(findF);
 			errno = EFBIG;
 			memcpy(res, er, 3);
 			goto send;
@@ -1516,22 +2116,28 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
             goto send;
 		}
 
-		// se non c'e' abbastanza spazio nella cache, espelli un file secondo la politica FIFO
-		if (getSize(queue) + size > queue->maxSize) {
+		/**
+		 * riservo lo spazio per la scrittura: se non c'e' abbastanza spazio nella cache, i file da espellere vengono scelti 
+		 * in un'unica passata secondo la politica di rimpiazzamento (escluso il file su cui si scrive), e lo spazio liberato 
+		 * non puo' essere occupato da altri client prima che la scrittura sia completata
+		 */
+		nVictims = reserveSpace(queue, size, 0, filepath, &reservation, &victims);
+
+		if (nVictims == -1) {
+			perror("reserveSpace");
+			nVictims = 0;
+			memcpy(res, er, 3);
+			goto send;
+		}
+
+		if (nVictims > 0) {
 			#ifdef DEBUG
-			printf("writeFile: cache piena (queue->size = %zu), espello un elemento.\n", getSize(queue));
+			printf("writeFile: cache piena, espulsi %d file.\n", nVictims);
 			fflush(stdout);
 			#endif
-			espulso = dequeue(queue);
 
-			if (espulso == NULL) {
-				perror("dequeue");
-				memcpy(res, er, 3);
-				goto send;
-			}
-
-			// aggiorno il file delle statistiche
-			updateStats(logFileT, queue, 1);
+			// aggiorno il file delle statistiche una sola volta per tutte le espulsioni
+			updateStats(logFileT, queue, nVictims);
 
 			memcpy(res, es, 3);
 		}
@@ -1544,25 +2150,34 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
 		goto send;
 	}
 
-	destroyFile(findF);
-
 	// invia risposta al client
 	send:
-		buf = malloc(BUFSIZE);
-		memcpy(buf, res, 3);
 
-		if (writen(fd_c, buf, 3) == -1) {
+		/* dal protocollo v3 il contenuto segue la richiesta: lo ricevo (o lo scarto, se c'e' stato un errore) prima di 
+		rispondere, quindi i file espulsi vengono inviati dopo averlo ricevuto */
+		if (version >= PROTO_V3 && strcmp(res, "er") == 0) {
+			int err = errno;
+
+			if (discardContent(fd_c, in, size) == -1) {
+				perror("discardContent");
+			}
+
+			errno = err;
+		}
+
+		else if (version >= PROTO_V3 && receiveContent(fd_c, in, queue, filepath, size, strcmp(res, "es") == 0 && !append, 
+			&reservation) == -1) {
+			perror("receiveContent");
+			memcpy(res, er, 3);
+		}
+
+		if (writen(fd_c, res, 3) == -1) {
 			perror("writen");
 			goto cleanup;
 		}
 
-		// se un file e' stato espulso dalla coda, lo invio al client
+		// se dei file sono stati espulsi dalla coda, li invio al client
 		if (strcmp(res, "es") == 0) {
-			if (sendFile(espulso, fd_c, logFileT) == -1) {
-				perror("sendFile");
-				goto cleanup;
-			}
-
 			// scrivo sul logFile
 			char writeFileStr[512] = "Il client ";
 			char writeFileFdStr[32];
@@ -1585,72 +2200,32 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
 				goto cleanup;
 			}	
 
-			// se ancora non c'e' abbastanza spazio nella cache, espelli altri file
-			while (getSize(queue) + size > queue->maxSize) {
-				if (getSize(queue) == 0 || getLen(queue) == 0) {
-					// non dovrebbe mai accadere poiche' si controlla prima se il file puo' essere contenuto nella cache
-					errno = EINVAL;
-					goto cleanup;
-				}
-
-				#ifdef DEBUG
-				printf("writeFile: cache ancora piena (queue->size = %ld), espello un elemento.\n", getSize(queue));
-				fflush(stdout);
-				#endif
-
-				// libero la memoria del file appena mandato
-				if (espulso) {
-					destroyFile(espulso);
-				}
-
-				espulso = dequeue(queue);
-
-				if (espulso == NULL) {
-					perror("dequeue");
-					goto cleanup;
-				}
-
-				// aggiorno il file delle statistiche
-				updateStats(logFileT, queue, 1);
-
-				if (sendFile(espulso, fd_c, logFileT) == -1) {
+			for (int i = 0; i < nVictims; i++) {
+				if (sendFile(victims[i], fd_c, version, logFileT) == -1) {
 					perror("sendFile");
 					goto cleanup;
 				}
 			}
 
-			// avverto il client che ho finito di mandare file, inviando la stringa ".FINE"
-			char fine[6] = ".FINE";
-			memset(buf, 0, BUFSIZE);
-			memcpy(buf, fine, 6);
-
-			if (writen(fd_c, buf, BUFSIZE) == -1) {
-				perror("writen");
-				goto cleanup;
-			}
-
-			// ricevo dal client il contenuto del file da scrivere
-			if ((readn(fd_c, content, size)) == -1) {
-				perror("readn");
+			// avverto il client che ho finito di mandare file
+			if (sendEnd(fd_c, version) == -1) {
+				perror("sendEnd");
 				goto cleanup;
 			}
 
-			// fai l'append del file
-			if (append) {
-				if (appendFileInQueue(queue, filepath, content, size, fd_c) == -1) {
-					perror("appendFileInQueue");
-					memcpy(res, er, 3);
-					goto cleanup;
-				}
+			// libero i file espulsi prima di ricevere il nuovo contenuto, che occupera' il loro spazio
+			for (int i = 0; i < nVictims; i++) {
+				destroyFile(victims[i]);
 			}
+			free(victims);
+			victims = NULL;
+			nVictims = 0;
 
-			// oppure fai la write
-			else {
-				if (writeFileInQueue(queue, filepath, content, size, fd_c) == -1) {
-					perror("writeFileInQueue");
-					memcpy(res, er, 3);
-					goto cleanup;
-				}
+			// ricevo dal client il contenuto del file, facendo la write (o l'append) un blocco alla volta
+			if (version < PROTO_V3 && receiveContent(fd_c, in, queue, filepath, size, !append, &reservation) == -1) {
+				perror("receiveContent");
+				memcpy(res, er, 3);
+				goto cleanup;
 			}
 
 			// aggiorno il file delle statistiche
@@ -1685,15 +2260,9 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
 
 		// se non ci sono stati errori e non ho dovuto espellere alcun file, eseguo la richiesta del client
 		else {
-			// ricevo dal client il contenuto del file da scrivere
-			if ((readn(fd_c, content, size)) == -1) {
-				perror("readn");
-				goto cleanup;
-			}
-
-			// scrivi il file
-			if (appendFileInQueue(queue, filepath, content, size, fd_c) == -1) {
-				perror("writeFileT");
+			// ricevo dal client il contenuto del file e lo scrivo un blocco alla volta
+			if (version < PROTO_V3 && receiveContent(fd_c, in, queue, filepath, size, 0, &reservation) == -1) {
+				perror("receiveContent");
 				goto cleanup;
 			}
 
@@ -1722,21 +2291,22 @@ void writeFile(char *filepath, size_t size, queueT *queue, long fd_c, logT *logF
 
 	// libera la memoria
 	cleanup: 
-		if (espulso) {
-			destroyFile(espulso);
+		// se la scrittura non e' andata a buon fine, rendo disponibile lo spazio riservato
+		cancelReservation(queue, &reservation);
+
+		for (int i = 0; i < nVictims; i++) {
+			destroyFile(victims[i]);
 		}
+		free(victims);
 
-		free(buf);
-		free(content);
-		free(res);
+		return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
 // imposta un file nello storage in modalita' locked
-void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
-	void *res = malloc(BUFSIZE);
+int lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
-	void *buf = NULL;
 
 	memcpy(res, ok, 3);
 
@@ -1748,11 +2318,8 @@ void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_
 	}
 
 	// cerco nello storage il file da impostare in modalita' locked
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-
 	// se il file non e' presente, errore
-	if (findF == NULL) {
+	if (exists(queue, filepath) != 1) {
 		errno = ENOENT;
 		memcpy(res, er, 3);
 		goto send;
@@ -1769,13 +2336,14 @@ void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_
 
 			if (pthread_mutex_lock(lock) == -1) {
 				perror("lock");
-				goto cleanup;
+				return 0;
 			}
 
 			if (addWaiting(waiting, filepath, fd_c) == -1) {
 				perror("addWaiting");
 				pthread_mutex_unlock(lock);
-				goto cleanup;
+				memcpy(res, er, 3);
+				goto send;
 			}
 
 			else {
@@ -1788,7 +2356,7 @@ void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_
 				perror("unlock");
 			}
 
-			goto cleanup;
+			return 1;
 		}
 
 		// altrimenti c'e' stato un errore diverso
@@ -1798,19 +2366,17 @@ void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_
 	}
 
 	send:
-		buf = malloc(BUFSIZE);
-		memcpy(buf, res, 3);
 
-		if (writen(fd_c, buf, 3) == -1) {
+		if (writen(fd_c, res, 3) == -1) {
 			perror("writen");
-			goto cleanup;
+			return 0;
 		}
 
 		// se c'e' stato un errore, invio errno al client
 		if (strcmp(res, "er") == 0) {			
 			if (writen(fd_c, &errno, sizeof(int)) == -1) {
 				perror("writen");
-				goto cleanup;
+				return 0;
 			}
 
 			// scrivo sul logFile
@@ -1840,26 +2406,14 @@ void lockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_
 			}
 		}
 
-	cleanup:
-		if (buf) {
-			free(buf);
-		}
-
-		if (findF) {
-			destroyFile(findF);
-		}
-
-		if (res) {
-			free(res);
-		}
+	return 0;
 }
 
 // resetta il flag O_LOCK di un file nello storage
-void unlockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
-	void *res = malloc(BUFSIZE);
+int unlockFile(char *filepath, queueT *queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
+	char res[3];			// risposta da inviare al client
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
-	void *buf = NULL;
 
 	memcpy(res, ok, 3);
 
@@ -1871,11 +2425,8 @@ void unlockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthrea
 	}
 
 	// cerco nello storage il file sul quale resettare il flag O_LOCK
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-
 	// se il file non e' presente, errore
-	if (findF == NULL) {
+	if (exists(queue, filepath) != 1) {
 		errno = ENOENT;
 		memcpy(res, er, 3);
 		goto send;
@@ -1888,19 +2439,17 @@ void unlockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthrea
 	}
 
 	send:
-		buf = malloc(BUFSIZE);
-		memcpy(buf, res, 3);
 
-		if (writen(fd_c, buf, 3) == -1) {
+		if (writen(fd_c, res, 3) == -1) {
 			perror("writen");
-			goto cleanup;
+			return -1;
 		}
 
 		// se c'e' stato un errore, invio errno al client
 		if (strcmp(res, "er") == 0) {			
 			if (writen(fd_c, &errno, sizeof(int)) == -1) {
 				perror("writen");
-				goto cleanup;
+				return -1;
 			}
 
 			// scrivo sul logFile
@@ -1931,43 +2480,36 @@ void unlockFile(char *filepath, queueT *queue, long fd_c, logT *logFileT, pthrea
 
 			if (pthread_mutex_lock(lock) == -1) {
 				perror("lock");
-				goto cleanup;
+				return 0;
 			}
 
 			// segnalo a un client nella lista d'attesa che il file e' stato unlockato
 			long wait = -1;
 			wait = removeFirstWaiting(waiting, filepath);
+
+			if (pthread_mutex_unlock(lock) == -1) {
+				perror("unlock");
+			}
+
+			// come in closeFile, la lockFile per il client svegliato viene fatta senza la lock della lista d'attesa
 			if (wait != -1) {
 				#ifdef DEBUG
 				printf("Sveglio il client %ld.\n", wait);
 				fflush(stdout);
 				#endif
 
-				lockFile(filepath, queue, wait, logFileT, lock, waiting);
-			}
-
-			if (pthread_mutex_unlock(lock) == -1) {
-				perror("unlock");
+				if (lockFile(filepath, queue, wait, logFileT, lock, waiting) == 0) {
+					rearmClient(epfd, wait, 1);
+				}
 			}
 		}
 
-	cleanup:
-		if (buf) {
-			free(buf);
-		}
-
-		if (findF) {
-			destroyFile(findF);
-		}
-
-		if (res) {
-			free(res);
-		}
+		return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
 // chiudi un file nello storage
-void closeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
-	void *res = malloc(BUFSIZE);
+int closeFile(char *filepath, queueT* queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
+	char res[3];			// risposta da inviare al client
 	int found = 0;
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
@@ -1978,15 +2520,11 @@ void closeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread
 	if (!filepath || !queue || !logFileT || !lock || !waiting) {
 		errno = EINVAL;
 		memcpy(res, er, 3);
-		goto cleanup;
+		return -1;
 	}
 
 	// cerco se il file e' presente nel server
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-	if (findF != NULL) {
-		found = 1;
-	}
+	found = (exists(queue, filepath) == 1);
 
 	// se il file e' presente, chiudilo
 	if (found) {
@@ -1994,8 +2532,6 @@ void closeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread
 		if (closeFileInQueue(queue, filepath, fd_c) == -1) {
 			memcpy(res, er, 3);
 		}
-
-		destroyFile(findF);
 	}
 
 	// se il file non e' presente, errore
@@ -2004,12 +2540,9 @@ void closeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread
 		memcpy(res, er, 3);
 	}
 
-	void *buf = NULL;
-	buf = malloc(BUFSIZE);
-	memcpy(buf, res, 3);
 
 	// invio risposta al client
-	if (writen(fd_c, buf, 3) == -1) {
+	if (writen(fd_c, res, 3) == -1) {
 		perror("writen");
 	}
 
@@ -2047,38 +2580,37 @@ void closeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread
 
 		if (pthread_mutex_lock(lock) == -1) {
 			perror("lock");
-			goto cleanup;
+			return 0;
 		}
 
 		// segnalo a un client nella lista d'attesa che il file e' stato unlockato
 		long wait = -1;
 		wait = removeFirstWaiting(waiting, filepath);
+
+		if (pthread_mutex_unlock(lock) == -1) {
+			perror("unlock");
+		}
+
+		/* la lockFile per il client svegliato viene fatta dopo aver rilasciato la lock della lista d'attesa, che la lockFile
+		riacquisisce se il file e' stato nel frattempo lockato da un altro client: se la ottiene, il client viene riattivato */
 		if (wait != -1) {
 			#ifdef DEBUG
 			printf("Sveglio il client %ld.\n", wait);
 			fflush(stdout);
 			#endif
-			lockFile(filepath, queue, wait, logFileT, lock, waiting);
-		}
 
-		if (pthread_mutex_unlock(lock) == -1) {
-			perror("unlock");
+			if (lockFile(filepath, queue, wait, logFileT, lock, waiting) == 0) {
+				rearmClient(epfd, wait, 1);
+			}
 		}
 	}
 
-	cleanup:
-		if (buf) {
-			free(buf);
-		}
-
-		if (res) {
-			free(res);
-		}
+	return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
 // rimuovi un file dallo storage
-void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
-	void *res = malloc(BUFSIZE);
+int removeFile(char *filepath, queueT* queue, long fd_c, int epfd, logT *logFileT, pthread_mutex_t *lock, waitingT **waiting) {
+	char res[3];			// risposta da inviare al client
 	int found = 0;
 	char ok[3] = "ok";		// messaggio che verra' mandato al client se l'operazione ha avuto successo
 	char er[3] = "er";		// messaggio che verra' mandato al client se c'e' stato un errore
@@ -2089,15 +2621,11 @@ void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthrea
 	if (!filepath || !queue || !logFileT || !lock || !waiting) {
 		errno = EINVAL;
 		memcpy(res, er, 3);
-		goto cleanup;
+		return -1;
 	}
 
 	// cerco se il file e' presente nel server
-	fileT *findF = NULL;
-	findF = find(queue, filepath);
-	if (findF != NULL) {
-		found = 1;
-	}
+	found = (exists(queue, filepath) == 1);
 
 	// se il file e' presente, rimuovilo
 	if (found) {
@@ -2106,8 +2634,6 @@ void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthrea
 			perror("removeFileFromQueue");
 			memcpy(res, er, 3);
 		}
-
-		destroyFile(findF);
 	}
 
 	// se il file non e' presente, errore
@@ -2117,12 +2643,9 @@ void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthrea
 	}
 
 	fflush(stdout);
-	void *buf = NULL;
-	buf = malloc(BUFSIZE);
-	memcpy(buf, res, 3);
 
 	// invio risposta al client
-	if (writen(fd_c, buf, 3) == -1) {
+	if (writen(fd_c, res, 3) == -1) {
 		perror("writen");
 	}
 
@@ -2160,82 +2683,229 @@ void removeFile(char *filepath, queueT* queue, long fd_c, logT *logFileT, pthrea
 
 		if (pthread_mutex_lock(lock) == -1) {
 			perror("lock");
-			goto cleanup;
+			return 0;
 		}
 
 		// segnalo a un client nella lista d'attesa che il file e' stato rimosso
 		long wait = -1;
 		wait = removeFirstWaiting(waiting, filepath);
+
+		if (pthread_mutex_unlock(lock) == -1) {
+			perror("unlock");
+		}
+
+		/* la lockFile per il client svegliato viene fatta dopo aver rilasciato la lock della lista d'attesa, che la lockFile
+		riacquisisce se il file e' stato nel frattempo lockato da un altro client: se la ottiene, il client viene riattivato */
 		if (wait != -1) {
 			#ifdef DEBUG
 			printf("Sveglio il client %ld.\n", wait);
 			fflush(stdout);
 			#endif
-			lockFile(filepath, queue, wait, logFileT, lock, waiting);
-		}
 
-		if (pthread_mutex_unlock(lock) == -1) {
-			perror("unlock");
+			if (lockFile(filepath, queue, wait, logFileT, lock, waiting) == 0) {
+				rearmClient(epfd, wait, 1);
+			}
 		}
 	}
 
-	cleanup:
-	if (buf) {
-		free(buf);
-	}
-	
-	if (res) {
-		free(res);
-	}
+	return (strcmp(res, "er") == 0) ? -1 : 0;
 }
 
-// funzione ausiliaria che invia un file al client
-int sendFile(fileT *f, long fd_c, logT *logFileT) {
-	void *buf = NULL;
-	buf = malloc(BUFSIZE);
-
-	// invio prima il filepath...
-	#ifdef DEBUG
-	printf("Invio il filepath: %s\n", f->filepath);
-	fflush(stdout);
-	#endif
+/**
+ * Esegue le n richieste di un batch, che seguono la richiesta OP_BATCH, rispondendo a ciascuna come se fosse stata 
+ * inviata da sola. Un batch non valido fa chiudere la connessione, perche' le sue richieste non possono essere 
+ * distinte da quelle successive: restituisce -1 in quel caso, 0 altrimenti.
+ */
+int batch(long n, int version, threadT *t) {
+	// controllo la validita' degli argomenti
+	if (!t || version < PROTO_V4 || n < 0 || n > PROTO_MAXBATCH) {
+		errno = EBADMSG;
+		return -1;
+	}
 
-	memset(buf, 0, BUFSIZE);
-	memcpy(buf, f->filepath, strlen(f->filepath)+1);
+	long fd_c = t->args[0];
+	int epfd = (int) t->args[3];
+	char ok[3] = "ok";
+	char er[3] = "er";
+	char buf[REQSIZE];
+	int status = 0;		// esito della richiesta precedente
+	long failed = 0;
 
-	if (writen(fd_c, buf, BUFSIZE) == -1) {
+	if (writen(fd_c, ok, 3) == -1) {
 		perror("writen");
-		free(buf);
 		return -1;
 	}
 
-	// ... poi la dimensione del file...
+	for (long i = 0; i < n; i++) {
+		requestT req;
+		memset(buf, '\0', REQSIZE);
+
+		// le richieste del batch usano la sua versione del protocollo e operano tutte su un file
+		if (readRequest(fd_c, &t->in, buf, &req) == -1 || req.version != version || !req.path) {
+			errno = EBADMSG;
+			return -1;
+		}
+
+		int chain = req.flags & BATCH_CHAIN;
+		req.flags &= ~BATCH_CHAIN;
+
+		// ogni risposta e' preceduta dall'id della richiesta
+		if (writen(fd_c, &req.id, sizeof(uint32_t)) == -1) {
+			perror("writen");
+			return -1;
+		}
+
+		// se la richiesta precedente e' fallita, quella concatenata non viene eseguita (il suo contenuto viene scartato)
+		if (chain && status == -1) {
+			int err = ECANCELED;
+
+			if (((req.op == OP_WRITE || req.op == OP_APPEND) && discardContent(fd_c, &t->in, req.size) == -1) || 
+				writen(fd_c, er, 3) == -1 || writen(fd_c, &err, sizeof(int)) == -1) {
+				perror("batch");
+				return -1;
+			}
+
+			// scrivo sul logFile
+			char cancelStr[LOGLINESIZE];
+			snprintf(cancelStr, LOGLINESIZE, "Il client %ld: richiesta %u del batch (file %s) annullata, la precedente e' fallita.\n", 
+				fd_c, req.id, req.path);
+			if (writeLog(t->logFileT, cancelStr) == -1) {
+				perror("writeLog");
+			}
+
+			failed++;
+			continue;
+		}
+
+		switch (req.op) {
+			case OP_OPEN:
+				status = openFile(req.path, req.flags, t->queue, fd_c, version, t->logFileT);
+				break;
+
+			case OP_READ:
+				status = readFile(req.path, t->queue, fd_c, version, t->logFileT);
+				break;
+
+			case OP_WRITE:
+			case OP_APPEND:
+				status = writeFile(req.path, req.size, t->queue, fd_c, &t->in, version, t->logFileT, req.op == OP_APPEND);
+				break;
+
+			case OP_UNLOCK:
+				status = unlockFile(req.path, t->queue, fd_c, epfd, t->logFileT, t->lock, t->waiting);
+				break;
+
+			case OP_CLOSE:
+				status = closeFile(req.path, t->queue, fd_c, epfd, t->logFileT, t->lock, t->waiting);
+				break;
+
+			case OP_REMOVE:
+				status = removeFile(req.path, t->queue, fd_c, epfd, t->logFileT, t->lock, t->waiting);
+				break;
+
+			// le altre operazioni non possono far parte di un batch (lockFile, per esempio, potrebbe sospenderlo)
+			default:
+				errno = EBADMSG;
+				return -1;
+		}
+
+		if (status == -1) {
+			failed++;
+		}
+	}
+
+	// scrivo sul logFile
+	char batchStr[LOGLINESIZE];
+	snprintf(batchStr, LOGLINESIZE, "Il client %ld ha inviato un batch di %ld richieste, %ld terminate con errore.\n", fd_c, n, failed);
+	if (writeLog(t->logFileT, batchStr) == -1) {
+		perror("writeLog");
+	}
+
+	return 0;
+}
+
+// blocco di zeri dal quale vengono inviati i bytes di riempimento del protocollo testuale
+static const char zeros[64 * 1024];
+
+// descrive len bytes di riempimento con buffer che puntano a zeros, restituisce il numero di buffer usati
+static int padIov(struct iovec *iov, size_t len) {
+	int n = 0;
+
+	while (len > 0) {
+		iov[n].iov_base = (void*) zeros;
+		iov[n].iov_len = (len < sizeof(zeros)) ? len : sizeof(zeros);
+		len -= iov[n].iov_len;
+		n++;
+	}
+
+	return n;
+}
+
+// funzione ausiliaria che invia un file al client. Il chiamante deve possedere un riferimento al file (acquireFile o
+// file espulso), quindi il file non puo' essere liberato durante l'invio. La lock del file viene tenuta solo per 
+// prendere una copia del contenuto (un riferimento alla lista di chunk), non durante l'invio: un client lento non blocca
+// le scritture su quel file. Frame, path e contenuto vengono inviati con writev, senza copie intermedie
+int sendFile(fileT *f, long fd_c, int version, logT *logFileT) {
+	struct iovec iov[SENDFILE_IOV];
+	fileFrameT frame;
+	contentT content;
+	int first = 0;		// numero di buffer (frame e path) che precedono il contenuto nella prima writev
+
+	acquireContent(f, &content);
+
 	#ifdef DEBUG
-	printf("Invio la size: %zu\n", f->size);
+	printf("Invio il file: %s (%zu bytes)\n", f->filepath, content.size);
 	fflush(stdout);
 	#endif
 
-	if (writen(fd_c, &f->size, sizeof(size_t)) == -1) {
-		perror("writen");
-		free(buf);
-		return -1;
+	// protocolli binari: il frame e il path vengono inviati insieme al primo blocco del contenuto
+	if (version >= PROTO_V2) {
+		memset(&frame, 0, sizeof(fileFrameT));
+		frame.pathLen = (uint32_t) strlen(f->filepath);
+		frame.size = content.size;
+
+		iov[0].iov_base = &frame;
+		iov[0].iov_len = sizeof(fileFrameT);
+		iov[1].iov_base = f->filepath;
+		iov[1].iov_len = frame.pathLen;
+		first = 2;
 	}
 
-	// ...e infine il contenuto
-	memset(buf, 0, BUFSIZE);
-	memcpy(buf, f->content, f->size);
-	if (writen(fd_c, buf, f->size) == -1) {
-		perror("writen");
-		free(buf);
-		return -1;
+	// protocollo testuale: il filepath occupa BUFSIZE bytes (completati dagli zeri), seguito dalla dimensione del file
+	else {
+		iov[0].iov_base = f->filepath;
+		iov[0].iov_len = strlen(f->filepath) + 1;
+		first = 1 + padIov(iov + 1, BUFSIZE - iov[0].iov_len);
+		iov[first].iov_base = &content.size;
+		iov[first].iov_len = sizeof(size_t);
+		first++;
 	}
 
+	// ...e infine il contenuto, inviato direttamente dal file (al piu' SENDFILE_IOV buffer per ogni chiamata a writev)
+	size_t sent = 0;
+
+	do {
+		int iovcnt = SENDFILE_IOV - first;
+		sent += contentCopyIov(&content, sent, iov + first, &iovcnt);
+
+		if (writevn(fd_c, iov, first + iovcnt) == -1) {
+			perror("writevn");
+			releaseContent(&content);
+			return -1;
+		}
+
+		first = 0;
+	} while (sent < content.size);
+
+	size_t sentSize = content.size;
+	releaseContent(&content);
+
 	// scrivo sul logFile
 	char sendFileStr[512] = "Il file ";
 	char sendFileFdStr[32];
 	char sendFileSizeStr[32];
 	snprintf(sendFileFdStr, sizeof(fd_c)+1, "%ld", fd_c);
-	snprintf(sendFileSizeStr, sizeof(f->size)+1, "%ld", f->size);
+	snprintf(sendFileSizeStr, sizeof(sentSize)+1, "%ld", sentSize);
 	strncat(sendFileStr, f->filepath, strlen(f->filepath)+1);
 	strncat(sendFileStr, ", di dimensione ", 20);
 	strncat(sendFileStr, sendFileSizeStr, strlen(sendFileSizeStr)+1);
@@ -2247,10 +2917,29 @@ int sendFile(fileT *f, long fd_c, logT *logFileT) {
 		perror("writeLog");
 	}	
 
-	free(buf);
 	return 0;
 }
 
+// invia al client la fine di una sequenza di file
+int sendEnd(long fd_c, int version) {
+	// protocolli binari: un frame vuoto con il flag FRAME_END
+	if (version >= PROTO_V2) {
+		fileFrameT frame;
+		memset(&frame, 0, sizeof(fileFrameT));
+		frame.flags = FRAME_END;
+
+		return (writen(fd_c, &frame, sizeof(fileFrameT)) == -1) ? -1 : 0;
+	}
+
+	// protocollo testuale: il path ".FINE" su BUFSIZE bytes
+	struct iovec iov[SENDFILE_IOV];
+	iov[0].iov_base = ".FINE";
+	iov[0].iov_len = 6;
+	int iovcnt = 1 + padIov(iov + 1, BUFSIZE - 6);
+
+	return (writevn(fd_c, iov, iovcnt) == -1) ? -1 : 0;
+}
+
 // aggiunge una coppia client/file alla coda dei client in attesa di ottenere la lock
 int addWaiting(waitingT **waiting, char *file, int fd) {
 	// controllo la validita' dell'argomento